@@ -96,12 +96,13 @@ void ota_setup() {
         });
     OTA.onError([](ota_error_t error) {
         char msg[32];
-        sprintf(msg, "Error[%u]: ", error);
-        if (error == OTA_AUTH_ERROR) sprintf(msg, "%sAuth Failed", msg);
-        else if (error == OTA_BEGIN_ERROR) sprintf(msg, "%sBegin Failed", msg);
-        else if (error == OTA_CONNECT_ERROR) sprintf(msg, "%sConnect Failed", msg);
-        else if (error == OTA_RECEIVE_ERROR) sprintf(msg, "%sReceive Failed", msg);
-        else if (error == OTA_END_ERROR) sprintf(msg, "%sEnd Failed", msg);
+        const char* reason = "";
+        if (error == OTA_AUTH_ERROR) reason = "Auth Failed";
+        else if (error == OTA_BEGIN_ERROR) reason = "Begin Failed";
+        else if (error == OTA_CONNECT_ERROR) reason = "Connect Failed";
+        else if (error == OTA_RECEIVE_ERROR) reason = "Receive Failed";
+        else if (error == OTA_END_ERROR) reason = "End Failed";
+        snprintf(msg, sizeof(msg), "Error[%u]: %s", error, reason);
         Serial.println(msg);
 
         xtp_ssd1306_setCursor(0, 5);  // Row 5 (approx 40px)
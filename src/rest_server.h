@@ -5,20 +5,164 @@
 #include <utility/w5100.h>
 #include "xtp_timing.h"
 
+// Request headers kept per connection, and the buffer holding their names and values
+#ifndef HTTP_MAX_ARGS
 #define HTTP_MAX_ARGS 32
+#endif
+#ifndef HTTP_HEADER_BUFFER_SIZE
+#define HTTP_HEADER_BUFFER_SIZE 512
+#endif
+#ifndef HTTP_MAX_ENDPOINTS
 #define HTTP_MAX_ENDPOINTS 32
+#endif
+#ifndef HTTP_MAX_REMAPS
 #define HTTP_MAX_REMAPS 32
+#endif
 #define HTTP_MAX_BODY_SIZE 1024
 
 #ifndef HTTP_RES_CHUNK_SIZE
 #define HTTP_RES_CHUNK_SIZE 2048
 #endif /* HTTP_RES_CHUNK_SIZE */
 
+// Cache-Control sent with assets that carry an ETag - by default browsers keep them but
+// revalidate on every load, which costs a 304 header exchange instead of the body
+#ifndef HTTP_ASSET_CACHE_CONTROL
+#define HTTP_ASSET_CACHE_CONTROL "no-cache"
+#endif
+
+// Response header plus the start of the body, written to the socket in one piece
+#ifndef HTTP_RESPONSE_BUFFER_SIZE
+#define HTTP_RESPONSE_BUFFER_SIZE 512
+#endif
+
+// Staging buffer for chunked responses - small writes are collected into one chunk of up to this size
+#ifndef HTTP_CHUNK_BUFFER_SIZE
+#define HTTP_CHUNK_BUFFER_SIZE 256
+#endif
+
 // Socket timeout for stuck connections (ms)
 #ifndef HTTP_CLIENT_TIMEOUT_MS
 #define HTTP_CLIENT_TIMEOUT_MS 500
 #endif
 
+// Pre-rendered status lines with their reason phrases, nullptr for codes not listed
+inline const char* http_status_line(int code) {
+    switch (code) {
+        case 100: return "HTTP/1.1 100 Continue\r\n";
+        case 101: return "HTTP/1.1 101 Switching Protocols\r\n";
+        case 200: return "HTTP/1.1 200 OK\r\n";
+        case 201: return "HTTP/1.1 201 Created\r\n";
+        case 202: return "HTTP/1.1 202 Accepted\r\n";
+        case 204: return "HTTP/1.1 204 No Content\r\n";
+        case 206: return "HTTP/1.1 206 Partial Content\r\n";
+        case 301: return "HTTP/1.1 301 Moved Permanently\r\n";
+        case 302: return "HTTP/1.1 302 Found\r\n";
+        case 303: return "HTTP/1.1 303 See Other\r\n";
+        case 304: return "HTTP/1.1 304 Not Modified\r\n";
+        case 307: return "HTTP/1.1 307 Temporary Redirect\r\n";
+        case 308: return "HTTP/1.1 308 Permanent Redirect\r\n";
+        case 400: return "HTTP/1.1 400 Bad Request\r\n";
+        case 401: return "HTTP/1.1 401 Unauthorized\r\n";
+        case 403: return "HTTP/1.1 403 Forbidden\r\n";
+        case 404: return "HTTP/1.1 404 Not Found\r\n";
+        case 405: return "HTTP/1.1 405 Method Not Allowed\r\n";
+        case 406: return "HTTP/1.1 406 Not Acceptable\r\n";
+        case 408: return "HTTP/1.1 408 Request Timeout\r\n";
+        case 409: return "HTTP/1.1 409 Conflict\r\n";
+        case 411: return "HTTP/1.1 411 Length Required\r\n";
+        case 413: return "HTTP/1.1 413 Payload Too Large\r\n";
+        case 414: return "HTTP/1.1 414 URI Too Long\r\n";
+        case 415: return "HTTP/1.1 415 Unsupported Media Type\r\n";
+        case 429: return "HTTP/1.1 429 Too Many Requests\r\n";
+        case 500: return "HTTP/1.1 500 Internal Server Error\r\n";
+        case 501: return "HTTP/1.1 501 Not Implemented\r\n";
+        case 503: return "HTTP/1.1 503 Service Unavailable\r\n";
+        case 504: return "HTTP/1.1 504 Gateway Timeout\r\n";
+        default: return nullptr;
+    }
+}
+
+// Response bytes the W5500 can't take yet wait in a per-connection queue, drained in the SENDING state.
+// It bounds what a handler may write at once: a send() too large for it is answered with 500, larger
+// bodies go out through sendStatic(), sendStream() or a chunk producer as the client takes them.
+#ifndef HTTP_TX_BUFFER_SIZE
+#define HTTP_TX_BUFFER_SIZE 1024
+#endif
+// Bytes pulled from a sendStream() source per read (one flash page)
+#ifndef HTTP_STREAM_READ_SIZE
+#define HTTP_STREAM_READ_SIZE 256
+#endif
+// Close a connection whose client has not accepted any response bytes for this long (ms)
+#ifndef HTTP_SEND_STALL_TIMEOUT_MS
+#define HTTP_SEND_STALL_TIMEOUT_MS 2000
+#endif
+// Time a deferred request has to complete its response before the client gets 504 Gateway Timeout (ms)
+#ifndef HTTP_DEFERRED_TIMEOUT_MS
+#define HTTP_DEFERRED_TIMEOUT_MS 5000
+#endif
+// Server-Sent Events: streams open at once (each also holds one of the HTTP_MAX_CONNECTIONS), bytes of
+// events queued per stream, largest single event, and the idle time after which a keep-alive comment goes out
+#ifndef HTTP_SSE_MAX_STREAMS
+#define HTTP_SSE_MAX_STREAMS 2
+#endif
+#ifndef HTTP_SSE_QUEUE_SIZE
+#define HTTP_SSE_QUEUE_SIZE 512
+#endif
+#ifndef HTTP_SSE_MAX_EVENT_SIZE
+#define HTTP_SSE_MAX_EVENT_SIZE 256
+#endif
+#ifndef HTTP_SSE_HEARTBEAT_MS
+#define HTTP_SSE_HEARTBEAT_MS 15000
+#endif
+static_assert(HTTP_SSE_MAX_EVENT_SIZE <= HTTP_TX_BUFFER_SIZE, "HTTP_SSE_MAX_EVENT_SIZE must fit the HTTP_TX_BUFFER_SIZE queue an event goes out through");
+
+// Persistent connections: idle time allowed between requests, and requests served per connection
+#ifndef HTTP_KEEP_ALIVE_TIMEOUT_MS
+#define HTTP_KEEP_ALIVE_TIMEOUT_MS 5000
+#endif
+
+#ifndef HTTP_KEEP_ALIVE_MAX_REQUESTS
+#define HTTP_KEEP_ALIVE_MAX_REQUESTS 100
+#endif
+
+// Admission control: every client IP gets a bucket of HTTP_RATE_LIMIT_BURST requests, refilled at
+// HTTP_RATE_LIMIT_RPS per second (0 = no limit). A client with an empty bucket gets 429 and is closed.
+// Off by default - a dashboard polling a handful of endpoints at 10 Hz already makes 60-80 requests per
+// second from one IP, so pick limits above the expected polling load when enabling it.
+#ifndef HTTP_RATE_LIMIT_RPS
+#define HTTP_RATE_LIMIT_RPS 0
+#endif
+#ifndef HTTP_RATE_LIMIT_BURST
+#define HTTP_RATE_LIMIT_BURST 50
+#endif
+// Client IPs tracked at once - the one seen least recently makes room for a new one
+#ifndef HTTP_RATE_LIMIT_CLIENTS
+#define HTTP_RATE_LIMIT_CLIENTS 8
+#endif
+
+// Load shedding: once HTTP work has taken this long in one loop (us), the remaining connections wait for
+// the next loop. Over HTTP_LOAD_LIMIT_PERCENT of a HTTP_LOAD_WINDOW_MS window, new requests get 503.
+// The limit is off by default (0) - how much of the loop HTTP may take depends on what else the
+// application runs in it, so set it (setLoadLimit()) once that is known.
+#ifndef HTTP_LOOP_BUDGET_US
+#define HTTP_LOOP_BUDGET_US 2000
+#endif
+#ifndef HTTP_LOAD_LIMIT_PERCENT
+#define HTTP_LOAD_LIMIT_PERCENT 0
+#endif
+#ifndef HTTP_LOAD_WINDOW_MS
+#define HTTP_LOAD_WINDOW_MS 100
+#endif
+
+// Refusals written as is to clients turned away by admission control, before the socket is closed
+const char HTTP_RESPONSE_TOO_MANY_REQUESTS[] = "HTTP/1.1 429 Too Many Requests\r\nRetry-After: 1\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+const char HTTP_RESPONSE_SERVICE_UNAVAILABLE[] = "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 1\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+// Per-connection receive buffer for the request line and headers (pipelined requests queue here)
+#ifndef HTTP_RX_BUFFER_SIZE
+#define HTTP_RX_BUFFER_SIZE 512
+#endif
+
 // Interval to check for stuck sockets (ms) - reduced for faster cleanup
 #ifndef HTTP_SOCKET_CLEANUP_INTERVAL_MS
 #define HTTP_SOCKET_CLEANUP_INTERVAL_MS 1000
@@ -39,6 +183,9 @@ static uint32_t _last_socket_cache_update = 0;
 #define HTTP_SOCKET_CACHE_INTERVAL_MS 50
 #endif
 
+// Smallest power of two holding `capacity` entries at no more than 50% load
+constexpr int http_table_size(int capacity, int size = 8) { return size >= capacity * 2 ? size : http_table_size(capacity, size * 2); }
+
 // Update cached socket status (call periodically to avoid SPI overhead)
 inline void updateSocketStatusCache() {
     uint32_t now = millis();
@@ -67,40 +214,392 @@ inline uint16_t cyclic_sock_port(uint8_t sock) {
     return (sock < 8) ? _cached_socket_port[sock] : 0;
 }
 
-enum HTTPMethod { HTTP_GET, HTTP_POST };
+enum HTTPMethod { HTTP_GET, HTTP_POST, HTTP_PUT, HTTP_DELETE, HTTP_HEAD, HTTP_OPTIONS };
+#define HTTP_METHOD_COUNT 6
+
+inline const char* http_method_name(HTTPMethod method) {
+    static const char* const names[HTTP_METHOD_COUNT] = { "GET", "POST", "PUT", "DELETE", "HEAD", "OPTIONS" };
+    return (unsigned) method < HTTP_METHOD_COUNT ? names[method] : "";
+}
+
+#define HTTP_ALLOWED_METHODS "GET, POST, PUT, DELETE, HEAD, OPTIONS"
+
+// CORS defaults for enableCors(): request headers a cross-origin client may send, and how long (s)
+// the browser may cache a preflight answer
+#ifndef HTTP_CORS_ALLOW_HEADERS
+#define HTTP_CORS_ALLOW_HEADERS "Content-Type"
+#endif
+#ifndef HTTP_CORS_MAX_AGE_S
+#define HTTP_CORS_MAX_AGE_S 86400
+#endif
+
+// Request line URI buffer (path + query string) per connection
+#ifndef HTTP_MAX_URI_LENGTH
+#define HTTP_MAX_URI_LENGTH 128
+#endif
+// Segments of all pattern routes (`/api/io/:pin`, `/static/*`) share this node pool
+#ifndef HTTP_MAX_ROUTE_NODES
+#define HTTP_MAX_ROUTE_NODES 32
+#endif
+#ifndef HTTP_MAX_PATH_PARAMS
+#define HTTP_MAX_PATH_PARAMS 4
+#endif
+
+// Case-insensitive FNV-1a of the first `length` characters of a header name (all of it by default)
+constexpr uint32_t http_header_hash(const char* name, int length = -1, uint32_t hash = 2166136261u) {
+    return length == 0 || (length < 0 && *name == '\0') ? hash
+        : http_header_hash(name + 1, length < 0 ? -1 : length - 1, (hash ^ (uint8_t) (*name >= 'A' && *name <= 'Z' ? *name + 32 : *name)) * 16777619u);
+}
+
+// Slice of a request buffer - valid until the connection starts its next request, not NUL terminated
+struct HttpView {
+    const char* data = nullptr;
+    uint16_t length = 0;
+
+    bool valid() const { return data != nullptr; }
+    bool equals(const char* str) const { return valid() && strlen(str) == length && strncmp(data, str, length) == 0; }
+    long toInt(long fallback = 0) const {
+        char tmp[16];
+        if (!valid() || length == 0 || length >= sizeof(tmp)) return fallback;
+        copyTo(tmp, sizeof(tmp));
+        char* end;
+        long value = strtol(tmp, &end, 10);
+        return *end == '\0' ? value : fallback;
+    }
+    // Copy into a NUL terminated buffer (truncated to size - 1), returns the copied length
+    int copyTo(char* out, int size) const {
+        if (size <= 0) return 0;
+        int n = valid() ? min((int) length, size - 1) : 0;
+        memcpy(out, data, n);
+        out[n] = '\0';
+        return n;
+    }
+};
+
+// Response queue of one connection - a ring that hands out contiguous spans for direct socket writes
+class HttpTxBuffer {
+public:
+    uint8_t buffer[HTTP_TX_BUFFER_SIZE];
+    uint16_t head = 0;   // Write position
+    uint16_t tail = 0;   // Read position
+    uint16_t count = 0;
+
+    void reset() { head = tail = count = 0; }
+    uint16_t available() const { return count; }
+    uint16_t freeSpace() const { return HTTP_TX_BUFFER_SIZE - count; }
+    bool isEmpty() const { return count == 0; }
+
+    // Copy in as much of `data` as fits, returns the number of bytes taken
+    int write(const uint8_t* data, int len) {
+        int n = min(len, (int) freeSpace());
+        int first = min(n, HTTP_TX_BUFFER_SIZE - head);
+        memcpy(&buffer[head], data, first);
+        memcpy(buffer, data + first, n - first);
+        head = (head + n) % HTTP_TX_BUFFER_SIZE;
+        count += n;
+        return n;
+    }
+
+    // Queued bytes stored contiguously from the read position
+    const uint8_t* peek(int& len) const {
+        len = min((int) count, HTTP_TX_BUFFER_SIZE - tail);
+        return &buffer[tail];
+    }
+
+    void consume(int len) {
+        tail = (tail + len) % HTTP_TX_BUFFER_SIZE;
+        count -= len;
+    }
+};
+
+// Framed events waiting for an event stream's socket, each stored as a 2 byte length and its bytes.
+// A new event that does not fit pushes out the oldest ones - a slow client misses events, never the latest.
+class HttpEventQueue {
+public:
+    uint8_t buffer[HTTP_SSE_QUEUE_SIZE];
+    uint16_t head = 0;   // Write position
+    uint16_t tail = 0;   // Read position
+    uint16_t count = 0;
+    uint16_t events = 0;
+    uint32_t dropped = 0;
+
+    void reset() { head = tail = count = events = 0; dropped = 0; }
+    bool isEmpty() const { return events == 0; }
+
+    // Length of the oldest event, 0 when empty
+    int front() const { return events > 0 ? buffer[tail] | buffer[(tail + 1) % HTTP_SSE_QUEUE_SIZE] << 8 : 0; }
+
+    // False if the event is larger than the whole queue
+    bool push(const uint8_t* data, int len) {
+        if (len <= 0 || len + 2 > HTTP_SSE_QUEUE_SIZE) return false;
+        while (HTTP_SSE_QUEUE_SIZE - count < len + 2) {
+            pop(nullptr);
+            dropped++;
+        }
+        uint8_t size[2] = { (uint8_t) len, (uint8_t) (len >> 8) };
+        copyIn(size, 2);
+        copyIn(data, len);
+        events++;
+        return true;
+    }
+
+    // Remove the oldest event, copying it to `out` when given, returns its length
+    int pop(uint8_t* out) {
+        int len = front();
+        if (len == 0) return 0;
+        tail = (tail + 2) % HTTP_SSE_QUEUE_SIZE;
+        if (out != nullptr) {
+            int first = min(len, HTTP_SSE_QUEUE_SIZE - tail);
+            memcpy(out, &buffer[tail], first);
+            memcpy(out + first, buffer, len - first);
+        }
+        tail = (tail + len) % HTTP_SSE_QUEUE_SIZE;
+        count -= len + 2;
+        events--;
+        return len;
+    }
+
+private:
+    void copyIn(const uint8_t* data, int len) {
+        int first = min(len, HTTP_SSE_QUEUE_SIZE - head);
+        memcpy(&buffer[head], data, first);
+        memcpy(buffer, data + first, len - first);
+        head = (head + len) % HTTP_SSE_QUEUE_SIZE;
+        count += len;
+    }
+};
+
+// Access log: a fixed-size record per finished request in a RAM ring (/api/access-log), printed to
+// Serial a line at a time in the background, only while the UART takes it without blocking
+#ifndef HTTP_ACCESS_LOG_SIZE
+#define HTTP_ACCESS_LOG_SIZE 32
+#endif
+#ifndef HTTP_ACCESS_LOG_SERIAL
+#define HTTP_ACCESS_LOG_SERIAL 1   // 0 = RAM only
+#endif
+// Time a loop may spend printing access log lines (us)
+#ifndef HTTP_ACCESS_LOG_BUDGET_US
+#define HTTP_ACCESS_LOG_BUDGET_US 200
+#endif
+
+struct HttpAccessEntry {
+    uint32_t ms;             // millis() when the request finished
+    uint32_t ip;
+    uint32_t bytes;          // Response bytes, header included
+    uint32_t duration_us;    // From the complete request to its response going out
+    uint16_t route;          // Endpoint index, HTTP_MAX_ENDPOINTS when no route matched
+    uint16_t status;
+    uint8_t method;
+    uint8_t aborted;         // The client went away (or stopped reading) before the response was out
+};
+
+struct HttpAccessLog {
+    HttpAccessEntry entries[HTTP_ACCESS_LOG_SIZE];
+    uint32_t written = 0;    // Records ever written - record `n` is kept until `n + HTTP_ACCESS_LOG_SIZE` is written
+    uint32_t printed = 0;    // Records printed to Serial (or lost before they could be)
+
+    HttpAccessEntry& append() { return entries[written++ % HTTP_ACCESS_LOG_SIZE]; }
+    const HttpAccessEntry& at(uint32_t n) const { return entries[n % HTTP_ACCESS_LOG_SIZE]; }
+    uint32_t oldest() const { return written > HTTP_ACCESS_LOG_SIZE ? written - HTTP_ACCESS_LOG_SIZE : 0; }
+};
+
+// Number of requests served in parallel - each connection holds its own URI/header/body/TX
+// buffers (~4 KB with the defaults above), and shares the W5500's 8 sockets with
+// the WebSocket server and OTA
+#ifndef HTTP_MAX_CONNECTIONS
+#define HTTP_MAX_CONNECTIONS 4
+#endif
 
 // DIY implementation of a REST server
 class RestServer {
 public:
     // State machine states - declared first so all methods can use them
     enum State { 
-        WAITING,           // Waiting for new client connection
+        WAITING,           // Connection slot is free, waiting for a new client
         RECEIVING,         // Receiving request headers and body
         PROCESSING,        // Matching endpoint
         HANDLING,          // Executing handler
+        DEFERRED,          // Handler returned without a response - completed later (defer())
+        STREAMING,         // Event stream (beginEvents()) - queued events go out as the socket takes them
+        SENDING,           // Draining the queued response as the socket frees TX space
         FAILED,            // No matching endpoint found
         CLOSING,           // Gracefully closing connection
         FORCE_CLOSING      // Force closing stuck connection
     };
     
+    enum ParseStage : uint8_t { PARSE_REQUEST_LINE, PARSE_HEADERS, PARSE_BODY };
+
+    struct Argument {
+        const char* name;
+        const char* value;
+    };
+
+    // Request header kept in Connection::headers, found by the hash of its name
+    struct HeaderField {
+        uint32_t hash;
+        uint16_t name;           // Offsets of the NUL terminated name and value in Connection::headers
+        uint16_t value;
+        uint16_t value_length;
+    };
+
+    // `:name` / `*` segment captured by a pattern route
+    struct PathParam {
+        HttpView name;
+        HttpView value;
+    };
+    
+    struct Endpoint;
+    // Response body source for sendStream(): fills `buffer` with up to `length` bytes from `position`, returns the count
+    typedef int (*BodyReader)(uint32_t position, uint8_t* buffer, int length);
+    // Next part of a chunked response (continueChunked()): called with the request bound each time
+    // the queue has gone out, writes with writeChunk()/printfChunk() and returns false once the body is complete.
+    // `cursor` and `items` are its own, say where it is in what it lists and how many entries it has written.
+    typedef bool (*ChunkProducer)(uint32_t& cursor, uint32_t& items);
+    // Completes a deferred request: called every loop with the request bound, sends the response and returns true once done
+    typedef bool (*DeferredPoll)(void* context);
+
+    // Handle to a deferred request for whatever completes it (resume()) - goes stale once the request is answered or dropped
+    struct Deferred {
+        uint8_t connection = 0xFF;
+        uint16_t id = 0;
+        bool valid() const { return connection != 0xFF; }
+    };
+
+    // Open event stream and the connection it belongs to
+    struct EventStream {
+        uint8_t connection = 0xFF;
+        bool closing = false;            // endEvents() - close once the queue is out
+        uint32_t sent_ms = 0;            // Last time anything was written to the stream
+        HttpEventQueue queue;
+    };
+
+    // Per-connection request context - every accepted socket advances through
+    // the state machine on its own, so a slow client cannot stall the others
+    struct Connection {
+        EthernetClient client;
+        State state = WAITING;
+        IPAddress ip;
+        HTTPMethod method = HTTP_GET;
+        char uri[HTTP_MAX_URI_LENGTH] = "";  // Path only - the query string is split off into `query`
+        HttpView query;
+        int paramc = 0;
+        PathParam params[HTTP_MAX_PATH_PARAMS];
+        int argc = 0;                    // Request headers kept
+        HeaderField fields[HTTP_MAX_ARGS];
+        char headers[HTTP_HEADER_BUFFER_SIZE];
+        int headers_length = 0;
+        char body[HTTP_MAX_BODY_SIZE + 1] = "";
+        int body_length = 0;
+        uint32_t last_ms = 0;
+        uint32_t state_entered_ms = 0;
+        char rx[HTTP_RX_BUFFER_SIZE];    // Received bytes not parsed yet (pipelined requests)
+        int rx_length = 0;
+        bool rx_pending = false;         // rx holds bytes the parser has not looked at yet
+        bool keep_alive = false;         // Keep the socket open after the current response
+        uint16_t requests = 0;           // Requests completed on this connection
+        Endpoint* endpoint = nullptr;    // Resolved once the headers are in
+        // Response going out: the first tx_head queued bytes, then a caller-owned body (sendStatic) or one
+        // read on demand (sendStream), then the rest of the queue - and more from tx_producer once all is out
+        HttpTxBuffer tx;
+        uint16_t tx_head = 0;            // Queued bytes ahead of the pending body
+        const uint8_t* tx_static = nullptr;
+        uint32_t tx_static_length = 0;   // Body bytes not sent yet
+        BodyReader tx_reader = nullptr;
+        uint32_t tx_position = 0;        // Next tx_reader position
+        ChunkProducer tx_producer = nullptr;
+        uint32_t tx_cursor = 0;          // tx_producer's own counters
+        uint32_t tx_items = 0;
+        bool tx_cut = false;             // The response did not fit - the rest of it is dropped
+        int tx_room = -1;                // W5500 TX space left as of the last check, -1 = unknown
+        uint32_t tx_progress_ms = 0;     // Last time the client accepted response bytes
+        // Request parser progress - RECEIVING resumes from here when more bytes arrive
+        ParseStage parse_stage = PARSE_REQUEST_LINE;
+        bool skip_line = false;          // Dropping the rest of a header line longer than rx
+        bool http11 = false;
+        bool expect_continue = false;    // Client waits for `100 Continue` before sending the body
+        int content_length = -1;
+        int body_remaining = 0;          // Body bytes still to be read
+        // Current request, for the per-route statistics
+        uint16_t status = 0;             // Response status code
+        uint32_t tx_bytes = 0;           // Response bytes, header included
+        uint32_t receive_us = 0;         // CPU time spent parsing the request
+        uint32_t handler_us = 0;
+        uint32_t send_us = 0;            // CPU time spent draining the response in SENDING
+        uint32_t request_us = 0;         // micros() when the request was complete
+        // Deferred request waiting for its response
+        DeferredPoll deferred_poll = nullptr;
+        void* deferred_context = nullptr;
+        uint32_t deferred_timeout_ms = 0;
+        uint16_t deferred_id = 0;
+        int8_t stream = -1;              // Event stream slot while STREAMING
+    };
+    
     EthernetServer* server;
     uint32_t _requests_success = 0;
     uint32_t _requests_failed = 0;
     uint32_t _transmitted_bytes = 0;
-    char _uri[64];
-    IPAddress _ip;
-    HTTPMethod _method;
-    int _argc;
-    struct Argument {
-        char name[64];
-        char value[64];
-    } _args[HTTP_MAX_ARGS];
+    HttpAccessLog _access_log;
+    uint32_t _requests_limited = 0;   // Turned away with 429
+    uint32_t _requests_shed = 0;      // Turned away with 503
+
+    // Per-client token buckets, in thousandths of a request
+    struct RateBucket {
+        uint32_t ip = 0;
+        uint32_t tokens = 0;
+        uint32_t last_ms = 0;
+    };
+    RateBucket _rate_buckets[HTTP_RATE_LIMIT_CLIENTS];
+    uint16_t _rate_limit_rps = HTTP_RATE_LIMIT_RPS;
+    uint16_t _rate_limit_burst = HTTP_RATE_LIMIT_BURST;
+
+    uint32_t _loop_budget_us = HTTP_LOOP_BUDGET_US;
+    uint8_t _load_limit_percent = HTTP_LOAD_LIMIT_PERCENT;
+    uint32_t _load_us = 0;            // HTTP work in the current load window
+    uint32_t _load_window_ms = 0;
+    bool _overloaded = false;         // The last window went over the load limit
+    int _next_connection = 0;         // Where the next loop starts advancing connections (round robin)
 
-    char body[HTTP_MAX_BODY_SIZE];
+    // Chunked response being written by the current handler: size line, data, CRLF
+    static const int CHUNK_HEADER_SIZE = 10; // Up to 8 hex digits + CRLF
+    char _chunk_buffer[CHUNK_HEADER_SIZE + HTTP_CHUNK_BUFFER_SIZE + 7]; // + CRLF and the terminating chunk
+    int _chunk_length = 0;
+    bool _chunked = false;     // false for HTTP/1.0 clients - the body is written as is
+
+    // Response header being assembled, with as much of the body as fits, for a single socket write
+    char _response_buffer[HTTP_RESPONSE_BUFFER_SIZE];
+    int _response_length = 0;
+    
+    Connection _connections[HTTP_MAX_CONNECTIONS];
+    EventStream _streams[HTTP_SSE_MAX_STREAMS];
+    Connection* _conn = nullptr; // Connection currently being advanced
+    Connection* _resumed_from = nullptr; // Connection bound before resume(), restored by complete()
+    uint32_t _resumed_us = 0;
+    uint16_t _deferred_ids = 0;
+    
+    // Request being handled - bound to the active connection by bindConnection()
+    // so handlers keep using rest.client, rest.body, rest.readHeader() etc.
+    EthernetClient client;
+    char* _uri;
+    IPAddress _ip;
+    HTTPMethod _method = HTTP_GET;
+    char* body;
     int body_length = 0;
 
 
+    // Batched request (captureRoute()) whose response goes into the current chunked response
+    bool _capture = false;
+    bool _capture_escape = false;    // The body is not JSON - written as a JSON string
+    bool _capture_started = false;   // Status and type are out
+    uint32_t _capture_bytes = 0;
+
+    // Pre-rendered header lines: CORS for every response (empty while disabled), and the OPTIONS answer
+    char _cors_headers[128] = "";
+    char _cors_preflight[192] = "Allow: " HTTP_ALLOWED_METHODS "\r\n";
+
     typedef void (*EndpointHandler)(void);
+    // Receives a request body piece by piece as it arrives: `offset` bytes came before, `total` is its Content-Length.
+    // Returns the bytes it took - the rest is offered again on a later loop (the client is held off meanwhile).
+    typedef int (*BodyHandler)(const uint8_t* data, int length, uint32_t offset, uint32_t total);
 
     EndpointHandler _notFoundHandler;
     bool _notFoundHandler_defined = false;
@@ -109,19 +608,55 @@ public:
         const char* uri;
         HTTPMethod method;
         EndpointHandler handler;
+        BodyHandler body_handler;      // Set for endpoints that stream their body instead of buffering it
+        uint32_t hash;
     };
 
     Endpoint _endpoints[HTTP_MAX_ENDPOINTS]; // max endpoints
+
+#ifdef XTP_TIMING_TELEMETRY
+    // Per-route counters and latency histograms (/api/timing/routes)
+    struct RouteStats {
+        uint32_t hits = 0;
+        uint32_t errors = 0;             // 4xx/5xx responses and aborted sends
+        uint32_t bytes = 0;
+        XtpHistogram receive;
+        XtpHistogram handler;
+        XtpHistogram send;
+    };
+    RouteStats _route_stats[HTTP_MAX_ENDPOINTS + 1]; // The last one counts requests no route matched
+#endif
     int _endpoints_count = 0;
 
     struct Remap {
         const char* from;
         const char* to;
+        uint32_t hash;
     };
 
     Remap _remaps[HTTP_MAX_REMAPS]; // max 32 remaps
     int _remaps_count = 0;
 
+    // Open addressing indexes into _endpoints/_remaps (entry + 1, 0 = empty slot), built at registration.
+    // At least twice the capacity so probe runs stay short; a power of two so the probe wraps with a mask.
+    static constexpr int ENDPOINT_TABLE_SIZE = http_table_size(HTTP_MAX_ENDPOINTS);
+    static constexpr int REMAP_TABLE_SIZE = http_table_size(HTTP_MAX_REMAPS);
+    uint16_t _endpoint_table[ENDPOINT_TABLE_SIZE] = {0};
+    uint16_t _remap_table[REMAP_TABLE_SIZE] = {0};
+
+    // Pattern routes form a trie of path segments; node 0 is the root `/`
+    enum RouteSegment : uint8_t { SEGMENT_STATIC, SEGMENT_PARAM, SEGMENT_WILDCARD };
+    struct RouteNode {
+        const char* label = nullptr;   // Segment text in the registered URI (without `:`)
+        uint8_t label_length = 0;
+        RouteSegment type = SEGMENT_STATIC;
+        int16_t child = -1;            // First child - static before param before wildcard
+        int16_t sibling = -1;
+        int16_t endpoint[HTTP_METHOD_COUNT] = { -1, -1, -1, -1, -1, -1 };
+    };
+    RouteNode _route_nodes[HTTP_MAX_ROUTE_NODES];
+    int _route_nodes_count = 1;
+
     // Socket health monitoring
     uint32_t _socket_timestamps[8] = {0}; // Track when each socket became active
     uint8_t _socket_states[8] = {0};      // Previous socket states
@@ -129,15 +664,49 @@ public:
     uint32_t _server_restart_count = 0;
     uint8_t _server_socket = 0xFF;        // Track which socket the server is using
     
-    // State machine variables
-    uint32_t _last_ms = 0;
-    uint32_t _state_entered_ms = 0;
-    State state = WAITING;
-    EthernetClient client;
-    
-    RestServer(EthernetServer& server) { this->server = &server; }
+    RestServer(EthernetServer& server) {
+        this->server = &server;
+        bindConnection(_connections[0]);
+    }
     void begin() { _last_socket_cleanup = millis(); }
     
+    // Make `c` the current connection and point the request accessors at it
+    void bindConnection(Connection& c) {
+        _conn = &c;
+        client = c.client;
+        _uri = c.uri;
+        _ip = c.ip;
+        _method = c.method;
+        body = c.body;
+        body_length = c.body_length;
+    }
+    
+    // Number of connections currently being served
+    int activeConnections() {
+        int count = 0;
+        for (int i = 0; i < HTTP_MAX_CONNECTIONS; i++) {
+            if (_connections[i].state != WAITING) count++;
+        }
+        return count;
+    }
+    
+    // Is the socket owned by one of our connections (its timeouts are handled per connection)
+    bool ownsSocket(uint8_t sock) {
+        for (int i = 0; i < HTTP_MAX_CONNECTIONS; i++) {
+            if (_connections[i].state != WAITING && _connections[i].client.getSocketNumber() == sock) return true;
+        }
+        return false;
+    }
+    
+    // Is a sendStream() body from `reader` still going out with positions in [from, to)
+    bool streaming(BodyReader reader, uint32_t from, uint32_t to) {
+        for (int i = 0; i < HTTP_MAX_CONNECTIONS; i++) {
+            Connection& c = _connections[i];
+            if (c.state != WAITING && c.tx_reader == reader && c.tx_static_length > 0 && c.tx_position < to && c.tx_position + c.tx_static_length > from) return true;
+        }
+        return false;
+    }
+    
     // Force close a specific socket on W5500
     void forceCloseSocket(uint8_t sock) {
         if (sock >= 8) return;
@@ -204,6 +773,9 @@ public:
             // Only cleanup socket if it belongs to this HTTP server (port 80)
             if (port != 80) continue;
 
+            // Sockets we are serving are closed by their own connection timeouts
+            if (ownsSocket(sock)) continue;
+            
             if (is_transitional && socket_age > HTTP_SOCKET_STALE_TIMEOUT_MS) {
                 forceCloseSocket(sock);
                 stuck_sockets++;
@@ -230,17 +802,16 @@ public:
         }
     }
     
-    // Get socket number from EthernetClient (accessing private member via hack)
-    // The socket is stored as the first byte of the EthernetClient object
+    // Get socket number from EthernetClient
     uint8_t getClientSocket(EthernetClient& c) {
-        return *((uint8_t*)&c);  // First byte is _sock
+        return c.getSocketNumber();
     }
     
     // Non-blocking socket close - forces immediate W5500 socket disconnect
     // This bypasses the TCP FIN/ACK handshake that can block for 500ms+
     void forceSocketDisconnect() {
-        if (!client) return;
-        uint8_t sock = getClientSocket(client);
+        if (!_conn->client) return;
+        uint8_t sock = getClientSocket(_conn->client);
         if (sock < 8) {
             // Send DISCON command (graceful but non-blocking initiation)
             W5100.execCmdSn(sock, Sock_DISCON);
@@ -249,37 +820,248 @@ public:
     
     // Hard close socket - immediate close without any TCP handshake
     void hardCloseSocket() {
-        if (!client) return;
-        uint8_t sock = getClientSocket(client);
+        if (!_conn->client) return;
+        uint8_t sock = getClientSocket(_conn->client);
         if (sock < 8) {
             W5100.execCmdSn(sock, Sock_CLOSE);
             W5100.writeSnIR(sock, 0xFF);  // Clear interrupt flags
         }
+        _conn->client = EthernetClient();
         client = EthernetClient();
     }
     
     // Safe client stop - use hard close to immediately free the socket
     // Graceful TCP close can leave socket in TIME_WAIT for seconds
     void initiateClientClose() {
-        hardCloseSocket();  // Immediate close, no TCP handshake wait
-        state = WAITING;    // Go directly to WAITING, skip CLOSING state
+        releaseStream();
+        hardCloseSocket();       // Immediate close, no TCP handshake wait
+        resetTx();
+        _conn->state = WAITING;  // Free the slot directly, skip CLOSING state
+    }
+
+    // Handler done - wait in SENDING until the queued response is out, then finish the request
+    void finishResponse() {
+        // A chunked response the handler left open (or its header, still unsent) is completed here,
+        // or by its producer in SENDING
+        if (_conn->tx_producer != nullptr) {
+            sendChunk(false);
+            flushResponse();
+            _chunked = false;
+        } else if (_chunked || _chunk_length > 0 || _response_length > 0) {
+            endChunked();
+        }
+        if (_conn->tx.isEmpty() && _conn->tx_static_length == 0 && _conn->tx_producer == nullptr) {
+            finishRequest();
+            return;
+        }
+        _conn->tx_progress_ms = millis();
+        enterState(SENDING);
+    }
+    
+    // Account the finished (or aborted) request to its route and clear the per-request figures
+    void recordRequest(bool aborted) {
+        Connection& c = *_conn;
+        HttpAccessEntry& entry = _access_log.append();
+        entry.ms = millis();
+        entry.ip = (uint32_t) c.ip;
+        entry.bytes = c.tx_bytes;
+        entry.duration_us = micros() - c.request_us;
+        entry.route = c.endpoint != nullptr ? c.endpoint - _endpoints : HTTP_MAX_ENDPOINTS;
+        entry.status = c.status;
+        entry.method = c.method;
+        entry.aborted = aborted;
+#ifdef XTP_TIMING_TELEMETRY
+        RouteStats& stats = _route_stats[c.endpoint != nullptr ? c.endpoint - _endpoints : HTTP_MAX_ENDPOINTS];
+        stats.hits++;
+        if (aborted || c.status >= 400) stats.errors++;
+        stats.bytes += c.tx_bytes;
+        stats.receive.record(c.receive_us);
+        stats.handler.record(c.handler_us);
+        stats.send.record(c.send_us);
+#endif
+        c.status = 0;
+        c.tx_bytes = 0;
+        c.receive_us = 0;
+        c.handler_us = 0;
+        c.send_us = 0;
+    }
+
+    // Called from a handler instead of sending a response: the request stays open and is answered later,
+    // either by `poll` (called with `context` every loop until it returns true) or by whoever holds the
+    // returned handle, through resume() and complete(). Unanswered after `timeout_ms` it gets a 504.
+    Deferred defer(DeferredPoll poll = nullptr, void* context = nullptr, uint32_t timeout_ms = HTTP_DEFERRED_TIMEOUT_MS) {
+        if (_capture) {
+            send(501, "text/plain", "Deferred handlers can not be batched");
+            return Deferred();
+        }
+        Connection& c = *_conn;
+        c.deferred_poll = poll;
+        c.deferred_context = context;
+        c.deferred_timeout_ms = timeout_ms;
+        c.deferred_id = ++_deferred_ids;
+        enterState(DEFERRED);
+        Deferred d;
+        d.connection = &c - _connections;
+        d.id = c.deferred_id;
+        return d;
+    }
+
+    // Bind a deferred request so send(), sendHeader(), body etc. work on it. False once it has been
+    // answered, timed out or its client went away - the handle is stale then and must not be completed.
+    bool resume(Deferred d) {
+        if (d.connection >= HTTP_MAX_CONNECTIONS) return false;
+        Connection& c = _connections[d.connection];
+        if (c.state != DEFERRED || c.deferred_id != d.id) return false;
+        _resumed_from = _conn;
+        _resumed_us = micros();
+        bindConnection(c);
+        c.tx_room = -1;
+        return true;
+    }
+
+    // Response to a resumed request is written - send it and rebind whatever request was current before
+    void complete() {
+        Connection& c = *_conn;
+        if (c.state != DEFERRED) return;
+        c.handler_us += micros() - _resumed_us;
+        finishResponse();
+        if (_resumed_from != nullptr) bindConnection(*_resumed_from);
+        _resumed_from = nullptr;
+    }
+
+    // Called from a handler instead of sending a response: answers `200 text/event-stream` and keeps the
+    // connection open as an event stream until the client goes away or endEvents(). Returns the stream
+    // for sendEvent(), or -1 (after a 503) when HTTP_SSE_MAX_STREAMS are open already.
+    int beginEvents() {
+        if (_capture) {
+            send(501, "text/plain", "Event streams can not be batched");
+            return -1;
+        }
+        if (headOnly()) {
+            sendHeader(200, "text/event-stream", -1, false, "Cache-Control: no-cache\r\n");
+            return -1;
+        }
+        int i = 0;
+        while (i < HTTP_SSE_MAX_STREAMS && _streams[i].connection != 0xFF) i++;
+        if (i == HTTP_SSE_MAX_STREAMS) {
+            send(503, "text/plain", "Too many event streams");
+            return -1;
+        }
+        Connection& c = *_conn;
+        EventStream& stream = _streams[i];
+        stream.connection = &c - _connections;
+        stream.closing = false;
+        stream.sent_ms = millis();
+        stream.queue.reset();
+        c.stream = i;
+        // No length - the stream ends with the connection
+        sendHeader(200, "text/event-stream", -1, false, "Cache-Control: no-cache\r\n");
+        c.tx_progress_ms = millis();
+        enterState(STREAMING);
+        return i;
+    }
+
+    // Queue an event for one stream (`event` nullptr for the default "message" type). Never blocks -
+    // false if the stream is closed or closing, or the event is larger than HTTP_SSE_MAX_EVENT_SIZE.
+    bool sendEvent(int stream, const char* data, const char* event = nullptr) {
+        if (stream < 0 || stream >= HTTP_SSE_MAX_STREAMS || _streams[stream].connection == 0xFF || _streams[stream].closing) return false;
+        uint8_t frame[HTTP_SSE_MAX_EVENT_SIZE];
+        int length = renderEvent(frame, sizeof(frame), data, event);
+        return length > 0 && _streams[stream].queue.push(frame, length);
+    }
+
+    // Queue an event for every open stream, returns the number of streams it went to
+    int broadcastEvent(const char* data, const char* event = nullptr) {
+        uint8_t frame[HTTP_SSE_MAX_EVENT_SIZE];
+        int length = renderEvent(frame, sizeof(frame), data, event);
+        int streams = 0;
+        for (int i = 0; length > 0 && i < HTTP_SSE_MAX_STREAMS; i++) {
+            if (_streams[i].connection != 0xFF && !_streams[i].closing && _streams[i].queue.push(frame, length)) streams++;
+        }
+        return streams;
+    }
+
+    // Close the stream once the events queued so far are out
+    void endEvents(int stream) {
+        if (stream >= 0 && stream < HTTP_SSE_MAX_STREAMS && _streams[stream].connection != 0xFF) _streams[stream].closing = true;
+    }
+
+    int eventStreams() {
+        int count = 0;
+        for (int i = 0; i < HTTP_SSE_MAX_STREAMS; i++) {
+            if (_streams[i].connection != 0xFF) count++;
+        }
+        return count;
+    }
+
+    // `event: <event>` and a `data:` line per line of `data`, returns the length or 0 if it does not fit
+    static int renderEvent(uint8_t* frame, int size, const char* data, const char* event) {
+        int n = 0;
+        if (event != nullptr) {
+            n = snprintf((char*) frame, size, "event: %s\n", event);
+            if (n >= size) return 0;
+        }
+        for (const char* line = data; line != nullptr;) {
+            const char* end = strchr(line, '\n');
+            int len = end != nullptr ? end - line : strlen(line);
+            if (n + 6 + len + 2 > size) return 0;
+            memcpy(&frame[n], "data: ", 6);
+            memcpy(&frame[n + 6], line, len);
+            n += 6 + len;
+            frame[n++] = '\n';
+            line = end != nullptr ? end + 1 : nullptr;
+        }
+        frame[n++] = '\n';
+        return n;
+    }
+
+    // Free the event stream slot of the current connection
+    void releaseStream() {
+        if (_conn->stream < 0) return;
+        _streams[_conn->stream].connection = 0xFF;
+        _conn->stream = -1;
+    }
+
+    // Response sent - keep the connection for the next (possibly already pipelined) request, or close it
+    void finishRequest() {
+        recordRequest(false);
+        if (!_conn->keep_alive || !_conn->client.connected()) {
+            initiateClientClose();
+            return;
+        }
+        resetTx();
+        _conn->requests++;
+        _conn->last_ms = millis();
+        enterState(RECEIVING);
     }
     
+    // Answer the current request with an empty error response and close the connection
+    void rejectRequest(int code) {
+        _conn->keep_alive = false;
+        renderHeader(code, "text/plain", 0, false);
+        _conn->client.write((const uint8_t*) _response_buffer, _response_length);
+        _response_length = 0;
+        _requests_failed++;
+        initiateClientClose();
+    }
+
     // Force immediate client cleanup (use when we can't wait)
     void forceClientClose() {
+        releaseStream();
         hardCloseSocket();
-        state = WAITING;
+        resetTx();
+        _conn->state = WAITING;
     }
     
     // Enter a new state (tracks timing)
     void enterState(State newState) {
-        state = newState;
-        _state_entered_ms = millis();
+        _conn->state = newState;
+        _conn->state_entered_ms = millis();
     }
     
     // Time spent in current state
     uint32_t timeInState() {
-        return millis() - _state_entered_ms;
+        return millis() - _conn->state_entered_ms;
     }
     
     // Debug: Print all socket statuses
@@ -295,329 +1077,818 @@ public:
         }
     }
 
-    void on(const char* uri, HTTPMethod method, EndpointHandler handler) {
-        if (_endpoints_count >= HTTP_MAX_ENDPOINTS) return; // max endpoints (for now)
+    // FNV-1a, used to index endpoints and remaps by URI
+    static uint32_t hashUri(const char* uri) {
+        uint32_t hash = 2166136261u;
+        while (*uri) {
+            hash ^= (uint8_t) *uri++;
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    static uint32_t endpointSlot(uint32_t hash, HTTPMethod method) { return (hash ^ ((uint32_t) method * 0x9E3779B1u)) & (ENDPOINT_TABLE_SIZE - 1); }
+
+    void on(const char* uri, HTTPMethod method, EndpointHandler handler, BodyHandler body_handler = nullptr) {
+        if (uri == nullptr || _endpoints_count >= HTTP_MAX_ENDPOINTS) return; // max endpoints (for now)
+        if (strchr(uri, ':') != nullptr || strchr(uri, '*') != nullptr) {
+            addRoute(uri, method, handler, body_handler);
+            return;
+        }
+        uint32_t hash = hashUri(uri);
+        uint32_t slot = endpointSlot(hash, method);
+        while (_endpoint_table[slot]) {
+            Endpoint& existing = _endpoints[_endpoint_table[slot] - 1];
+            // The first registration of a URI/method pair wins
+            if (existing.hash == hash && existing.method == method && strcmp(existing.uri, uri) == 0) return;
+            slot = (slot + 1) & (ENDPOINT_TABLE_SIZE - 1);
+        }
         _endpoints[_endpoints_count].uri = uri;
         _endpoints[_endpoints_count].method = method;
         _endpoints[_endpoints_count].handler = handler;
+        _endpoints[_endpoints_count].body_handler = body_handler;
+        _endpoints[_endpoints_count].hash = hash;
         _endpoints_count++;
+        _endpoint_table[slot] = _endpoints_count;
+    }
+
+    // Endpoint registered for exactly this URI and method, or nullptr
+    Endpoint* findEndpoint(const char* uri, HTTPMethod method) {
+        uint32_t hash = hashUri(uri);
+        uint32_t slot = endpointSlot(hash, method);
+        while (_endpoint_table[slot]) {
+            Endpoint& endpoint = _endpoints[_endpoint_table[slot] - 1];
+            if (endpoint.hash == hash && endpoint.method == method && strcmp(endpoint.uri, uri) == 0) return &endpoint;
+            slot = (slot + 1) & (ENDPOINT_TABLE_SIZE - 1);
+        }
+        return nullptr;
+    }
+
+    // Insert a pattern route into the trie: `:name` matches one segment, a trailing `*` the rest of the path
+    void addRoute(const char* uri, HTTPMethod method, EndpointHandler handler, BodyHandler body_handler) {
+        int node = 0;
+        const char* segment = uri[0] == '/' ? uri + 1 : uri;
+        while (true) {
+            const char* end = strchr(segment, '/');
+            int length = end ? end - segment : strlen(segment);
+            RouteSegment type = segment[0] == ':' ? SEGMENT_PARAM : segment[0] == '*' ? SEGMENT_WILDCARD : SEGMENT_STATIC;
+            if (type != SEGMENT_STATIC) { segment++; length--; }
+            if (type == SEGMENT_WILDCARD) end = nullptr; // Nothing can follow a wildcard
+            if (length > 255) return;
+
+            // Reuse a matching child, otherwise insert one keeping the type order
+            int16_t* link = &_route_nodes[node].child;
+            int child = -1;
+            while (*link >= 0) {
+                RouteNode& n = _route_nodes[*link];
+                if (n.type == type && n.label_length == length && strncmp(n.label, segment, length) == 0) { child = *link; break; }
+                if (n.type > type) break;
+                link = &n.sibling;
+            }
+            if (child < 0) {
+                if (_route_nodes_count >= HTTP_MAX_ROUTE_NODES) return; // max route nodes (for now)
+                child = _route_nodes_count++;
+                RouteNode& n = _route_nodes[child];
+                n.label = segment;
+                n.label_length = length;
+                n.type = type;
+                n.sibling = *link;
+                *link = child;
+            }
+            node = child;
+            if (end == nullptr) break;
+            segment = end + 1;
+        }
+        // The first registration of a URI/method pair wins
+        if (_route_nodes[node].endpoint[method] >= 0) return;
+        _endpoints[_endpoints_count].uri = uri;
+        _endpoints[_endpoints_count].method = method;
+        _endpoints[_endpoints_count].handler = handler;
+        _endpoints[_endpoints_count].body_handler = body_handler;
+        _endpoints[_endpoints_count].hash = 0;
+        _route_nodes[node].endpoint[method] = _endpoints_count++;
+    }
+
+    // Walk the trie one path segment at a time, preferring static segments over params over
+    // wildcards, recording captured segments in c.params
+    Endpoint* matchRoute(int node, const char* segment, HTTPMethod method, Connection& c) {
+        const char* end = strchr(segment, '/');
+        int length = end ? end - segment : strlen(segment);
+        for (int child = _route_nodes[node].child; child >= 0; child = _route_nodes[child].sibling) {
+            RouteNode& n = _route_nodes[child];
+            int paramc = c.paramc;
+            if (n.type == SEGMENT_STATIC) {
+                if (n.label_length != length || strncmp(n.label, segment, length) != 0) continue;
+            } else if (n.type == SEGMENT_PARAM) {
+                if (length == 0 || c.paramc >= HTTP_MAX_PATH_PARAMS) continue;
+                c.params[c.paramc].name = { n.label, n.label_length };
+                c.params[c.paramc].value = { segment, (uint16_t) length };
+                c.paramc++;
+            } else {
+                if (n.endpoint[method] < 0 || c.paramc >= HTTP_MAX_PATH_PARAMS) continue;
+                c.params[c.paramc].name = { n.label_length ? n.label : "*", (uint8_t)(n.label_length ? n.label_length : 1) };
+                c.params[c.paramc].value = { segment, (uint16_t) strlen(segment) };
+                c.paramc++;
+                return &_endpoints[n.endpoint[method]];
+            }
+            if (end == nullptr) {
+                if (n.endpoint[method] >= 0) return &_endpoints[n.endpoint[method]];
+            } else {
+                Endpoint* endpoint = matchRoute(child, end + 1, method, c);
+                if (endpoint != nullptr) return endpoint;
+            }
+            c.paramc = paramc; // Backtrack
+        }
+        return nullptr;
     }
 
+    // Endpoint for the URI: exact routes, then the remap target, then pattern routes
+    Endpoint* resolveEndpoint(const char* uri, HTTPMethod method) {
+        _conn->paramc = 0;
+        Endpoint* endpoint = findEndpoint(uri, method);
+        if (endpoint != nullptr) return endpoint;
+        const char* alt_uri = getMap(uri);
+        if (alt_uri != nullptr) endpoint = findEndpoint(alt_uri, method);
+        if (endpoint != nullptr || _route_nodes_count <= 1) return endpoint;
+        return matchRoute(0, uri[0] == '/' ? uri + 1 : uri, method, *_conn);
+    }
+
+    int endpointCount() const { return _endpoints_count; }
+
+    // GET routes also answer HEAD (without the body) unless the URI has a HEAD route of its own
     void get(const char* uri, EndpointHandler handler) { on(uri, HTTP_GET, handler); }
     void post(const char* uri, EndpointHandler handler) { on(uri, HTTP_POST, handler); }
+    // POST whose body goes to `body_handler` in pieces as it arrives (any size, nothing is buffered);
+    // `handler` runs once the whole body has been received and sends the response
+    void post(const char* uri, EndpointHandler handler, BodyHandler body_handler) { on(uri, HTTP_POST, handler, body_handler); }
+    void put(const char* uri, EndpointHandler handler) { on(uri, HTTP_PUT, handler); }
+    void put(const char* uri, EndpointHandler handler, BodyHandler body_handler) { on(uri, HTTP_PUT, handler, body_handler); }
+    void del(const char* uri, EndpointHandler handler) { on(uri, HTTP_DELETE, handler); }
+
+    // Allow cross-origin requests from `origin`: every response carries Access-Control-Allow-Origin and
+    // OPTIONS preflights without a route of their own are answered from a header block rendered here
+    void enableCors(const char* origin = "*", const char* allow_headers = HTTP_CORS_ALLOW_HEADERS, uint32_t max_age_s = HTTP_CORS_MAX_AGE_S) {
+        bool any = strcmp(origin, "*") == 0;
+        snprintf(_cors_headers, sizeof(_cors_headers), "Access-Control-Allow-Origin: %s\r\n%s", origin, any ? "" : "Vary: Origin\r\n");
+        snprintf(_cors_preflight, sizeof(_cors_preflight),
+            "Allow: " HTTP_ALLOWED_METHODS "\r\nAccess-Control-Allow-Methods: " HTTP_ALLOWED_METHODS "\r\n"
+            "Access-Control-Allow-Headers: %s\r\nAccess-Control-Max-Age: %lu\r\n", allow_headers, (unsigned long) max_age_s);
+    }
+
+    void disableCors() {
+        _cors_headers[0] = '\0';
+        strcpy(_cors_preflight, "Allow: " HTTP_ALLOWED_METHODS "\r\n");
+    }
 
     void remap(const char* from, const char* to) {
-        if (_remaps_count >= HTTP_MAX_REMAPS) return; // max 32 remaps (for now)
+        if (from == nullptr || to == nullptr || _remaps_count >= HTTP_MAX_REMAPS) return; // max 32 remaps (for now)
+        uint32_t hash = hashUri(from);
+        uint32_t slot = hash & (REMAP_TABLE_SIZE - 1);
+        while (_remap_table[slot]) {
+            Remap& existing = _remaps[_remap_table[slot] - 1];
+            if (existing.hash == hash && strcmp(existing.from, from) == 0) return;
+            slot = (slot + 1) & (REMAP_TABLE_SIZE - 1);
+        }
         _remaps[_remaps_count].from = from;
         _remaps[_remaps_count].to = to;
+        _remaps[_remaps_count].hash = hash;
         _remaps_count++;
+        _remap_table[slot] = _remaps_count;
     }
 
     const char* getMap(const char* from) {
-        for (int i = 0; i < _remaps_count; i++) {
-            if (_remaps[i].from == nullptr || _remaps[i].to == nullptr) continue;
-            if (strcmp(_remaps[i].from, from) == 0) return _remaps[i].to;
+        uint32_t hash = hashUri(from);
+        uint32_t slot = hash & (REMAP_TABLE_SIZE - 1);
+        while (_remap_table[slot]) {
+            Remap& remap = _remaps[_remap_table[slot] - 1];
+            if (remap.hash == hash && strcmp(remap.from, from) == 0) return remap.to;
+            slot = (slot + 1) & (REMAP_TABLE_SIZE - 1);
         }
         return nullptr;
     }
 
-    void parseMethod(char* method) {
-        method[0] = '\0';
+    // Copy the space/line delimited token at buf[pos] into out, returns the position after the token
+    // and its trailing space, or -1 if it is longer than max_len - 1 (out then holds what fit)
+    int readToken(const char* buf, int len, int pos, char* out, int max_len) {
         int i = 0;
-        while (client.available()) {
-            char c = client.read();
-            if (c == ' ' || c == '\n') break;
-            if (i >= 15) break;
-            method[i++] = c;
+        while (pos < len && buf[pos] != ' ' && buf[pos] != '\r' && buf[pos] != '\n') {
+            if (i == max_len - 1) {
+                out[i] = '\0';
+                return -1;
+            }
+            out[i++] = buf[pos++];
         }
-        method[i] = '\0';
+        out[i] = '\0';
+        if (pos < len && buf[pos] == ' ') pos++;
+        return pos;
     }
 
-    void parseUri(char* uri) {
-        uri[0] = '\0';
-        int i = 0;
-        while (client.available()) {
-            char c = client.read();
-            if (c == ' ' || c == '\n') break;
-            if (i >= 63) break;
-            uri[i++] = c;
+    // Case-insensitive search for a token in a comma separated header value
+    bool containsToken(const char* value, int length, const char* token) {
+        int token_len = strlen(token);
+        for (int i = 0; i + token_len <= length; i++) {
+            if (strncasecmp(&value[i], token, token_len) == 0) return true;
         }
-        uri[i] = '\0';
+        return false;
     }
 
     int indexOf(const char* str, char c) {
-        uint32_t len = strlen(str);
+        int len = strlen(str);
         for (int i = 0; i < len; i++) {
             if (str[i] == c) return i;
         }
         return -1;
     }
 
-    const char* readHeader(const char* name) {
-        for (int i = 0; i < _argc; i++) {
-            if (strcmp(name, _args[i].name) == 0) return _args[i].value;
+    // Request header `name` (in any case), nullptr if the request did not carry it
+    const HeaderField* findHeader(const char* name) {
+        Connection& c = *_conn;
+        uint32_t hash = http_header_hash(name);
+        for (int i = 0; i < c.argc; i++) {
+            const HeaderField& field = c.fields[i];
+            if (field.hash == hash && strcasecmp(&c.headers[field.name], name) == 0) return &field;
         }
         return nullptr;
     }
 
+    const char* readHeader(const char* name) {
+        const HeaderField* field = findHeader(name);
+        return field != nullptr ? &_conn->headers[field->value] : nullptr;
+    }
+
+    HttpView header(const char* name) {
+        const HeaderField* field = findHeader(name);
+        if (field == nullptr) return HttpView();
+        return { &_conn->headers[field->value], field->value_length };
+    }
+
+    // The request's Accept-Encoding lists `coding` (or `*`) without `;q=0`. Without the header only the
+    // identity encoding is taken as acceptable, as most servers do for pre-compressed files.
+    bool acceptsEncoding(const char* coding) {
+        HttpView accept = header("Accept-Encoding");
+        int coding_len = strlen(coding);
+        for (int i = 0; i < accept.length;) {
+            while (i < accept.length && (accept.data[i] == ' ' || accept.data[i] == ',')) i++;
+            int start = i;
+            while (i < accept.length && accept.data[i] != ',' && accept.data[i] != ';' && accept.data[i] != ' ') i++;
+            int len = i - start;
+            bool match = (len == coding_len && strncasecmp(&accept.data[start], coding, len) == 0) || (len == 1 && accept.data[start] == '*');
+            // Parameters up to the next entry - only a zero quality matters
+            bool refused = false;
+            while (i < accept.length && accept.data[i] != ',') {
+                if (accept.data[i] == '=' && i > 0 && (accept.data[i - 1] == 'q' || accept.data[i - 1] == 'Q')) {
+                    refused = atof(&accept.data[i + 1]) <= 0;
+                }
+                i++;
+            }
+            if (match && !refused) return true;
+        }
+        return false;
+    }
+
+    // Keep a request header for readHeader() - whole or not at all, once the buffer or the field table is full
+    void storeHeader(Connection& c, const char* name, int name_length, const char* value, int value_length) {
+        if (c.argc >= HTTP_MAX_ARGS || c.headers_length + name_length + value_length + 2 > HTTP_HEADER_BUFFER_SIZE) return;
+        HeaderField& field = c.fields[c.argc++];
+        field.hash = http_header_hash(name, name_length);
+        field.name = c.headers_length;
+        memcpy(&c.headers[c.headers_length], name, name_length);
+        c.headers_length += name_length;
+        c.headers[c.headers_length++] = '\0';
+        field.value = c.headers_length;
+        field.value_length = value_length;
+        memcpy(&c.headers[c.headers_length], value, value_length);
+        c.headers_length += value_length;
+        c.headers[c.headers_length++] = '\0';
+    }
+
+    // Accept new clients into free connection slots. EthernetServer::accept()
+    // returns each established socket once, even before it has sent data.
+    void acceptClients() {
+        for (int i = 0; i < HTTP_MAX_CONNECTIONS; i++) {
+            Connection& c = _connections[i];
+            if (c.state != WAITING) continue;
+            
+            XTP_TIMING_START(XTP_TIME_HTTP_ACCEPT);
+            EthernetClient newClient = server->accept();
+            XTP_TIMING_END(XTP_TIME_HTTP_ACCEPT);
+            if (!newClient) return;
+            
+            startConnection(c, newClient);
+        }
+        
+        // All slots busy - a waiting client takes over the longest idle keep-alive connection
+        Connection* idle = nullptr;
+        for (int i = 0; i < HTTP_MAX_CONNECTIONS; i++) {
+            Connection& c = _connections[i];
+            if (c.state != RECEIVING || c.requests == 0 || c.rx_length > 0) continue;
+            if (idle == nullptr || c.last_ms < idle->last_ms) idle = &c;
+        }
+        if (idle == nullptr) return;
+        
+        XTP_TIMING_START(XTP_TIME_HTTP_ACCEPT);
+        EthernetClient newClient = server->accept();
+        XTP_TIMING_END(XTP_TIME_HTTP_ACCEPT);
+        if (!newClient) return;
+        
+        bindConnection(*idle);
+        initiateClientClose();
+        startConnection(*idle, newClient);
+    }
+    
+    // Start serving a newly accepted client in the free slot `c`
+    void startConnection(Connection& c, EthernetClient& newClient) {
+        bindConnection(c);
+        c.client = newClient;
+        client = newClient;
+        c.rx_length = 0;
+        c.rx_pending = false;
+        resetTx();
+        c.parse_stage = PARSE_REQUEST_LINE;
+        c.skip_line = false;
+        c.requests = 0;
+        c.keep_alive = false;
+        c.status = 0;
+        c.tx_bytes = 0;
+        c.receive_us = 0;
+        c.handler_us = 0;
+        c.send_us = 0;
+        
+        // Verify client is actually connected
+        if (!newClient.connected()) {
+            forceClientClose();
+            return;
+        }
+        
+        c.ip = newClient.remoteIP();
+        c.last_ms = millis();
+        enterState(RECEIVING);
+        // Turn the client away before reading anything if it could not be served anyway
+        admitRequest(false);
+    }
+    
     // Handle incoming requests with a state machine to avoid blocking the event loop of the microcontroller
     void handleClient() {
         XTP_TIMING_START(XTP_TIME_HTTP_HANDLE);
-        uint32_t t = millis();
+        uint32_t start_us = micros();
         
         // Periodic socket health check
         cleanupStuckSockets();
         
-        switch (state) {
-            
-        case WAITING:
-            // Make sure we don't have a stale client object
-            if (client) {
-                forceClientClose();
-            }
-            
-            XTP_TIMING_START(XTP_TIME_HTTP_ACCEPT);
-            client = server->available();
-            XTP_TIMING_END(XTP_TIME_HTTP_ACCEPT);
-            if (!client) {
-                XTP_TIMING_END(XTP_TIME_HTTP_HANDLE);
-                return;
-            }
-            
-            // Verify client is actually connected
-            if (!client.connected()) {
-                forceClientClose();
-                XTP_TIMING_END(XTP_TIME_HTTP_HANDLE);
-                return;
+        acceptClients();
+        
+        // Advance every open connection by one step, until the loop budget is spent -
+        // the next loop then starts with the connections that missed their turn
+        for (int n = 0; n < HTTP_MAX_CONNECTIONS; n++) {
+            int i = (_next_connection + n) % HTTP_MAX_CONNECTIONS;
+            if (_connections[i].state == WAITING) continue;
+            bindConnection(_connections[i]);
+            handleConnection();
+            if (_loop_budget_us > 0 && micros() - start_us > _loop_budget_us) {
+                _next_connection = (i + 1) % HTTP_MAX_CONNECTIONS;
+                break;
             }
+        }
+        trackLoad(micros() - start_us);
+#if HTTP_ACCESS_LOG_SERIAL
+        printAccessLog();
+#endif
+        XTP_TIMING_END(XTP_TIME_HTTP_HANDLE);
+    } // handleClient
+
+    // Access log record `n` as a Serial line, cut to fit the 64 byte UART TX buffer of the STM32 core
+    int accessLogLine(uint32_t n, char* buffer, size_t bufferSize) {
+        const HttpAccessEntry& e = _access_log.at(n);
+        IPAddress ip(e.ip);
+        int length = snprintf(buffer, bufferSize, "[HTTP] %d.%d.%d.%d %s %s %u %lu B %lu us%s\n",
+            ip[0], ip[1], ip[2], ip[3], http_method_name((HTTPMethod) e.method),
+            e.route < HTTP_MAX_ENDPOINTS ? _endpoints[e.route].uri : "-", e.status, (unsigned long) e.bytes, (unsigned long) e.duration_us,
+            e.aborted ? " aborted" : "");
+        if (length >= (int) bufferSize) {
+            length = bufferSize - 1;
+            buffer[length - 1] = '\n';
+        }
+        return length;
+    }
+
+    // Print access log lines while the UART has room for them and the budget lasts
+    void printAccessLog() {
+        uint32_t start_us = micros();
+        char line[64];
+        while (_access_log.printed < _access_log.written && micros() - start_us < HTTP_ACCESS_LOG_BUDGET_US) {
+            uint32_t oldest = _access_log.oldest();
+            bool lost = _access_log.printed < oldest;
+            int length = lost
+                ? snprintf(line, sizeof(line), "[HTTP] %lu access log records lost\n", (unsigned long) (oldest - _access_log.printed))
+                : accessLogLine(_access_log.printed, line, sizeof(line));
+            if (Serial.availableForWrite() < length) break;
+            Serial.write((const uint8_t*) line, length);
+            _access_log.printed = lost ? oldest : _access_log.printed + 1;
+        }
+    }
+
+    // Access log record `n` as one `{...}` entry of /api/access-log
+    int accessLogJson(uint32_t n, char* buffer, size_t bufferSize, bool first) {
+        const HttpAccessEntry& e = _access_log.at(n);
+        IPAddress ip(e.ip);
+        return snprintf(buffer, bufferSize,
+            "%s{\"id\":%lu,\"ms\":%lu,\"ip\":\"%d.%d.%d.%d\",\"method\":\"%s\",\"uri\":\"%s\",\"status\":%u,\"bytes\":%lu,\"us\":%lu,\"aborted\":%s}",
+            first ? "" : ",", (unsigned long) n, (unsigned long) e.ms, ip[0], ip[1], ip[2], ip[3], http_method_name((HTTPMethod) e.method),
+            e.route < HTTP_MAX_ENDPOINTS ? _endpoints[e.route].uri : "", e.status, (unsigned long) e.bytes, (unsigned long) e.duration_us,
+            e.aborted ? "true" : "false");
+    }
+
+    // Add `elapsed_us` of HTTP work to the load window; at its end, decide whether new requests are shed
+    void trackLoad(uint32_t elapsed_us) {
+        _load_us += elapsed_us;
+        uint32_t window_ms = millis() - _load_window_ms;
+        if (window_ms < HTTP_LOAD_WINDOW_MS) return;
+        bool overloaded = _load_limit_percent > 0 && _load_us / 10 > window_ms * _load_limit_percent;
+        if (overloaded != _overloaded) {
+            Serial.printf("[HTTP] %s (%lu%% of %lu ms)\n", overloaded ? "Overloaded, shedding new requests" : "Load back under the limit",
+                          _load_us / 10 / window_ms, window_ms);
+        }
+        _overloaded = overloaded;
+        _load_us = 0;
+        _load_window_ms += window_ms;
+    }
+
+    // Spend one of the `ip` bucket's requests (or with `take` false, only check that one is left)
+    bool takeToken(IPAddress ip, bool take) {
+        if (_rate_limit_rps == 0) return true;
+        uint32_t t = millis();
+        uint32_t burst = (uint32_t) _rate_limit_burst * 1000;
+        RateBucket* bucket = &_rate_buckets[0];
+        for (int i = 0; i < HTTP_RATE_LIMIT_CLIENTS; i++) {
+            RateBucket& b = _rate_buckets[i];
+            if (b.ip == (uint32_t) ip) { bucket = &b; break; }
+            if (t - b.last_ms > t - bucket->last_ms || b.ip == 0) bucket = &b;
+        }
+        if (bucket->ip != (uint32_t) ip) {
+            bucket->ip = (uint32_t) ip;
+            bucket->tokens = burst;
+        } else {
+            // `rps` requests per second are `rps` thousandths per millisecond
+            uint64_t tokens = bucket->tokens + (uint64_t) (t - bucket->last_ms) * _rate_limit_rps;
+            bucket->tokens = tokens > burst ? burst : (uint32_t) tokens;
+        }
+        bucket->last_ms = t;
+        if (bucket->tokens < 1000) return false;
+        if (take) bucket->tokens -= 1000;
+        return true;
+    }
+
+    // Admission control for the current connection - turns the client away with a pre-rendered refusal
+    // while the server is overloaded or the client is over its rate. `take` charges the request.
+    bool admitRequest(bool take) {
+        const char* refusal = nullptr;
+        if (_overloaded) {
+            refusal = HTTP_RESPONSE_SERVICE_UNAVAILABLE;
+            _requests_shed++;
+        } else if (!takeToken(_conn->ip, take)) {
+            refusal = HTTP_RESPONSE_TOO_MANY_REQUESTS;
+            _requests_limited++;
+        }
+        if (refusal == nullptr) return true;
+        _conn->client.write((const uint8_t*) refusal, strlen(refusal));
+        initiateClientClose();
+        return false;
+    }
+
+    // `rps` 0 turns the per-client rate limit off
+    void setRateLimit(uint16_t rps, uint16_t burst) {
+        _rate_limit_rps = rps;
+        _rate_limit_burst = burst;
+        for (int i = 0; i < HTTP_RATE_LIMIT_CLIENTS; i++) _rate_buckets[i] = RateBucket();
+    }
+
+    // `percent` 0 turns load shedding off, `loop_budget_us` 0 lets every connection advance in every loop
+    void setLoadLimit(uint8_t percent, uint32_t loop_budget_us = HTTP_LOOP_BUDGET_US) {
+        _load_limit_percent = percent;
+        _loop_budget_us = loop_budget_us;
+        _overloaded = false;
+    }
+    
+    // Advance the current connection (_conn) by one state
+    void handleConnection() {
+        Connection& c = *_conn;
+        uint32_t t = millis();
+        uint32_t t_us = micros();
+        
+        switch (c.state) {
             
-            _ip = client.remoteIP();
-            _last_ms = t;
-            enterState(RECEIVING);
+        case WAITING:
             break;
 
         case RECEIVING:
-            // Check timeout
-            if (t - _last_ms > HTTP_CLIENT_TIMEOUT_MS) {
-                Serial.printf("[HTTP] Timeout in RECEIVING after %lu ms\n", t - _last_ms);
-                _requests_failed++;
-                initiateClientClose();
-                XTP_TIMING_END(XTP_TIME_HTTP_HANDLE);
-                return;
+            // Check timeout - an idle keep-alive connection waits longer for its next request,
+            // otherwise the clock restarts whenever more of the request arrives
+            {
+                bool idle = c.requests > 0 && c.parse_stage == PARSE_REQUEST_LINE && c.rx_length == 0;
+                if (idle && t - c.last_ms > HTTP_KEEP_ALIVE_TIMEOUT_MS) {
+                    initiateClientClose();
+                    return;
+                }
+                if (!idle && t - c.last_ms > HTTP_CLIENT_TIMEOUT_MS) {
+                    Serial.printf("[HTTP] Timeout in RECEIVING after %lu ms\n", t - c.last_ms);
+                    _requests_failed++;
+                    initiateClientClose();
+                    return;
+                }
             }
-            
+
             // Check if client is still connected
             {
                 XTP_TIMING_START(XTP_TIME_W5500_STATUS);
-                bool is_connected = client.connected();
-                bool has_data = is_connected && client.available();
+                bool is_connected = c.client.connected();
+                bool has_data = is_connected && c.client.available();
                 XTP_TIMING_END(XTP_TIME_W5500_STATUS);
-                
+
                 if (!is_connected) {
-                    Serial.println("[HTTP] Client disconnected during RECEIVING");
+                    if (c.requests == 0) Serial.println("[HTTP] Client disconnected during RECEIVING");
                     forceClientClose();
-                    XTP_TIMING_END(XTP_TIME_HTTP_HANDLE);
                     return;
                 }
-                
-                // Wait for data to arrive (non-blocking)
-                if (!has_data) {
-                    XTP_TIMING_END(XTP_TIME_HTTP_HANDLE);
-                    return;
+
+                // Bulk read into the connection's receive buffer
+                int space = HTTP_RX_BUFFER_SIZE - 1 - c.rx_length;
+                int received = 0;
+                if (has_data && space > 0) {
+                    received = c.client.read((uint8_t*) &c.rx[c.rx_length], space);
+                    if (received > 0) {
+                        c.rx_length += received;
+                        c.last_ms = t;
+                    }
                 }
+
+                // Nothing new to parse (non-blocking) unless a pipelined request is already buffered
+                if (received <= 0 && !c.rx_pending) return;
+                c.rx_pending = false;
             }
-            
+
             XTP_TIMING_START(XTP_TIME_HTTP_RECEIVE);
             {
-                char method[16];
-                Serial.printf("[%d.%d.%d.%d]: ", _ip[0], _ip[1], _ip[2], _ip[3]);
-                parseMethod(method);
-                parseUri(_uri);
-                
-                // Skip whitespace and CRLF
-                while (client.available()) {
-                    char c = client.peek();
-                    if (c == ' ' || c == '\r' || c == '\n') {
-                        client.read();
-                    } else {
+                EthernetClient& client = c.client;
+                char* buf = c.rx;
+                int len = c.rx_length;
+                int pos = 0;
+                bool complete = false;
+
+                // Resume where the previous pass stopped: request line and headers are consumed one
+                // complete line at a time, the body as its bytes arrive
+                while (!complete) {
+                    if (c.parse_stage == PARSE_BODY) {
+                        int n = min(len - pos, c.body_remaining);
+                        if (c.endpoint != nullptr && c.endpoint->body_handler != nullptr) {
+                            // Streaming endpoint - hand the bytes over straight from the receive buffer
+                            if (n > 0) {
+                                int taken = c.endpoint->body_handler((const uint8_t*) &buf[pos], n, c.content_length - c.body_remaining, c.content_length);
+                                taken = constrain(taken, 0, n);
+                                if (taken > 0) c.last_ms = t;
+                                c.rx_pending = taken < n; // Offer the rest again next loop, even if nothing new arrives
+                                n = taken;
+                            }
+                        } else {
+                            // Body bytes beyond HTTP_MAX_BODY_SIZE are read and dropped
+                            int keep = min(n, HTTP_MAX_BODY_SIZE - c.body_length);
+                            memcpy(&c.body[c.body_length], &buf[pos], keep);
+                            c.body_length += keep;
+                        }
+                        c.body_remaining -= n;
+                        pos += n;
+                        // A POST without Content-Length ends with whatever has arrived
+                        complete = c.body_remaining == 0 || c.content_length < 0;
                         break;
                     }
-                }
-                
-                bool is_get = strcmp(method, "GET") == 0;
-                bool is_post = strcmp(method, "POST") == 0;
-                if (is_get) {
-                    _method = HTTP_GET;
-                } else if (is_post) {
-                    _method = HTTP_POST;
-                } else {
-                    Serial.printf("[HTTP] Unsupported method: %s\n", method);
-                    client.print("HTTP/1.1 405 Method Not Allowed\r\n");
-                    client.print("Connection: close\r\n");
-                    client.print("\r\n");
-                    _requests_failed++;
-                    initiateClientClose();
-                    XTP_TIMING_END(XTP_TIME_HTTP_HANDLE);
-                    return;
-                }
-                
-                // Parse headers and body (optimized with bulk reads)
-                if (is_get || is_post) {
-                    _argc = 0;
-                    uint32_t parse_deadline = t + 100;
-                    
-                    // Read all available data into a local buffer for faster parsing
-                    char headerBuf[512];
-                    int headerLen = 0;
-                    int available = client.available();
-                    if (available > 0) {
-                        headerLen = min(available, (int)sizeof(headerBuf) - 1);
-                        client.read((uint8_t*)headerBuf, headerLen);
-                        headerBuf[headerLen] = '\0';
+
+                    char* newline = (char*) memchr(&buf[pos], '\n', len - pos);
+                    if (newline == nullptr) {
+                        if (pos == 0 && len >= HTTP_RX_BUFFER_SIZE - 1) {
+                            // A line longer than the whole receive buffer
+                            if (c.parse_stage == PARSE_REQUEST_LINE) {
+                                Serial.printf("[%d.%d.%d.%d]: [HTTP] Request line too long\n", c.ip[0], c.ip[1], c.ip[2], c.ip[3]);
+                                XTP_TIMING_END(XTP_TIME_HTTP_RECEIVE);
+                                rejectRequest(414);
+                                return;
+                            }
+                            // Drop an oversized header (long cookies) and carry on from the next line
+                            c.skip_line = true;
+                            pos = len;
+                        }
+                        break;
                     }
-                    
-                    // Parse headers from buffer
-                    int pos = 0;
-                    while (pos < headerLen && _argc < HTTP_MAX_ARGS) {
-                        // Skip whitespace and newlines
-                        while (pos < headerLen && (headerBuf[pos] == ' ' || headerBuf[pos] == '\r' || headerBuf[pos] == '\n')) {
-                            pos++;
+                    char* line = &buf[pos];
+                    int line_len = newline - line;
+                    if (line_len > 0 && line[line_len - 1] == '\r') line_len--;
+                    pos = newline - buf + 1;
+                    if (c.skip_line) {
+                        c.skip_line = false;
+                        continue;
+                    }
+
+                    if (c.parse_stage == PARSE_REQUEST_LINE) {
+                        if (line_len == 0) continue; // Stray CRLF between pipelined requests
+
+                        // Request line: METHOD SP URI SP HTTP/1.x
+                        char method[16];
+                        int p = readToken(line, line_len, 0, method, sizeof(method));
+                        int m = 0;
+                        while (m < HTTP_METHOD_COUNT && (p < 0 || strcmp(method, http_method_name((HTTPMethod) m)) != 0)) m++;
+                        if (m < HTTP_METHOD_COUNT) {
+                            c.method = (HTTPMethod) m;
+                        } else {
+                            Serial.printf("[%d.%d.%d.%d]: ", c.ip[0], c.ip[1], c.ip[2], c.ip[3]);
+                            Serial.printf("[HTTP] Unsupported method: %s\n", method);
+                            XTP_TIMING_END(XTP_TIME_HTTP_RECEIVE);
+                            rejectRequest(405);
+                            return;
+                        }
+                        p = readToken(line, line_len, p, c.uri, sizeof(c.uri));
+                        if (p < 0) {
+                            // Answered rather than truncated - a cut URI could match another route
+                            Serial.printf("[%d.%d.%d.%d]: ", c.ip[0], c.ip[1], c.ip[2], c.ip[3]);
+                            Serial.printf("[HTTP] URI longer than %d characters\n", HTTP_MAX_URI_LENGTH - 1);
+                            XTP_TIMING_END(XTP_TIME_HTTP_RECEIVE);
+                            rejectRequest(414);
+                            return;
                         }
-                        if (pos >= headerLen) break;
-                        
-                        // Check if it's a header (starts with A-Z)
-                        char c = headerBuf[pos];
-                        bool isHeader = c >= 'A' && c <= 'Z';
-                        if (!isHeader) break;  // End of headers
-                        
-                        // Read header name
-                        int nameStart = pos;
-                        while (pos < headerLen && headerBuf[pos] != ':' && headerBuf[pos] != '\r' && headerBuf[pos] != '\n') {
-                            pos++;
+                        c.http11 = line_len - p >= 8 && strncmp(&line[p], "HTTP/1.1", 8) == 0;
+                        // Split off the query string - routes match on the path alone
+                        char* query = strchr(c.uri, '?');
+                        c.query = HttpView();
+                        if (query != nullptr) {
+                            *query = '\0';
+                            c.query = { query + 1, (uint16_t) strlen(query + 1) };
                         }
-                        int nameLen = pos - nameStart;
-                        if (nameLen > 63) nameLen = 63;
-                        
-                        if (pos < headerLen && headerBuf[pos] == ':') {
-                            pos++;  // Skip ':'
-                            // Skip leading space after colon
-                            while (pos < headerLen && headerBuf[pos] == ' ') pos++;
-                            
-                            // Check if we should skip this header (common unneeded ones)
-                            bool skipHeader = false;
-                            if (nameLen == 6 && strncmp(&headerBuf[nameStart], "Accept", 6) == 0) skipHeader = true;
-                            else if (nameLen == 10 && strncmp(&headerBuf[nameStart], "User-Agent", 10) == 0) skipHeader = true;
-                            else if (nameLen == 10 && strncmp(&headerBuf[nameStart], "Connection", 10) == 0) skipHeader = true;
-                            else if (nameLen == 15 && strncmp(&headerBuf[nameStart], "Accept-Encoding", 15) == 0) skipHeader = true;
-                            else if (nameLen == 15 && strncmp(&headerBuf[nameStart], "Accept-Language", 15) == 0) skipHeader = true;
-                            else if (nameLen == 13 && strncmp(&headerBuf[nameStart], "Cache-Control", 13) == 0) skipHeader = true;
-                            else if (nameLen == 3 && strncmp(&headerBuf[nameStart], "DNT", 3) == 0) skipHeader = true;
-                            
-                            // Read value
-                            int valueStart = pos;
-                            while (pos < headerLen && headerBuf[pos] != '\r' && headerBuf[pos] != '\n') {
-                                pos++;
+
+                        c.argc = 0;
+                        c.headers_length = 0;
+                        c.keep_alive = c.http11;   // HTTP/1.1 defaults to persistent connections
+                        c.content_length = -1;
+                        c.expect_continue = false;
+                        c.body_length = 0;
+                        c.endpoint = nullptr;
+                        c.parse_stage = PARSE_HEADERS;
+                        continue;
+                    }
+
+                    // Blank line ends the headers
+                    if (line_len == 0) {
+                        // Route before the body arrives so it can be streamed to the endpoint
+                        c.endpoint = resolveEndpoint(c.uri, c.method);
+                        if (c.endpoint == nullptr && c.method == HTTP_HEAD) c.endpoint = resolveEndpoint(c.uri, HTTP_GET);
+                        bool streaming = c.endpoint != nullptr && c.endpoint->body_handler != nullptr;
+
+                        // Body: Content-Length bytes, or (POST/PUT without a length) everything already received
+                        if (c.content_length < 0 && (c.method == HTTP_POST || c.method == HTTP_PUT)) {
+                            if (streaming) {
+                                Serial.printf("[%d.%d.%d.%d]: ", c.ip[0], c.ip[1], c.ip[2], c.ip[3]);
+                                Serial.printf("[HTTP] %s %s without Content-Length\n", http_method_name(c.method), c.uri);
+                                XTP_TIMING_END(XTP_TIME_HTTP_RECEIVE);
+                                rejectRequest(411);
+                                return;
                             }
-                            int valueLen = pos - valueStart;
-                            if (valueLen > 63) valueLen = 63;
-                            
-                            if (!skipHeader) {
-                                // Store header
-                                memcpy(_args[_argc].name, &headerBuf[nameStart], nameLen);
-                                _args[_argc].name[nameLen] = '\0';
-                                memcpy(_args[_argc].value, &headerBuf[valueStart], valueLen);
-                                _args[_argc].value[valueLen] = '\0';
-                                _argc++;
+                            c.keep_alive = false;
+                            c.body_remaining = HTTP_MAX_BODY_SIZE;
+                        } else {
+                            c.body_remaining = max(c.content_length, 0);
+                        }
+
+                        // Answer `Expect: 100-continue` before the client commits to sending the body
+                        if (c.expect_continue && c.body_remaining > 0) {
+                            if (c.endpoint == nullptr) {
+                                // 404 right away - the client will not send a body we have not asked for
+                                c.body_remaining = 0;
+                                c.keep_alive = false;
+                            } else if (!streaming && c.content_length > HTTP_MAX_BODY_SIZE) {
+                                Serial.printf("[%d.%d.%d.%d]: ", c.ip[0], c.ip[1], c.ip[2], c.ip[3]);
+                                Serial.printf("[HTTP] %s %s body of %d bytes too large\n", http_method_name(c.method), c.uri, c.content_length);
+                                XTP_TIMING_END(XTP_TIME_HTTP_RECEIVE);
+                                rejectRequest(413);
+                                return;
+                            } else {
+                                client.print("HTTP/1.1 100 Continue\r\n\r\n");
                             }
                         }
-                        
-                        // Skip to next line
-                        while (pos < headerLen && headerBuf[pos] != '\n') pos++;
-                        if (pos < headerLen) pos++;  // Skip newline
-                    }
-                    
-                    // Read body (remaining data after headers)
-                    body_length = 0;
-                    // Check for body in buffer (after \r\n\r\n)
-                    if (pos < headerLen) {
-                        int remaining = headerLen - pos;
-                        if (remaining > HTTP_MAX_BODY_SIZE) remaining = HTTP_MAX_BODY_SIZE;
-                        memcpy(body, &headerBuf[pos], remaining);
-                        body_length = remaining;
+
+                        c.parse_stage = PARSE_BODY;
+                        complete = c.body_remaining == 0;
+                        continue;
                     }
-                    // Read any additional body data from socket
-                    uint32_t bodyDeadline = millis() + 20;  // Short timeout for body
-                    while (client.available() && body_length < HTTP_MAX_BODY_SIZE && millis() < bodyDeadline) {
-                        int toRead = min(client.available(), HTTP_MAX_BODY_SIZE - body_length);
-                        body_length += client.read((uint8_t*)&body[body_length], toRead);
+
+                    // Header line: Name: value
+                    const char* colon = (const char*) memchr(line, ':', line_len);
+                    if (colon == nullptr) continue;
+                    const char* name = line;
+                    int nameLen = colon - line;
+                    const char* value = colon + 1;
+                    // Skip leading space after colon
+                    while (value < line + line_len && *value == ' ') value++;
+                    int valueLen = line + line_len - value;
+
+                    // Headers the server acts on itself
+                    if (nameLen == 10 && strncasecmp(name, "Connection", 10) == 0) {
+                        if (containsToken(value, valueLen, "close")) c.keep_alive = false;
+                        else if (containsToken(value, valueLen, "keep-alive")) c.keep_alive = true;
+                    } else if (nameLen == 14 && strncasecmp(name, "Content-Length", 14) == 0) {
+                        // Digits only (strtoul would also take a sign or leading space), nothing after them
+                        // but spaces, and no second header that disagrees - otherwise the body is unframed
+                        char* end = (char*) value;
+                        unsigned long length = isdigit((unsigned char) *value) ? strtoul(value, &end, 10) : 0;
+                        while (end < line + line_len && *end == ' ') end++;
+                        if (end == value || end != line + line_len || length > INT32_MAX || (c.content_length >= 0 && (unsigned long) c.content_length != length)) {
+                            Serial.printf("[%d.%d.%d.%d]: ", c.ip[0], c.ip[1], c.ip[2], c.ip[3]);
+                            Serial.printf("[HTTP] Invalid Content-Length: %.*s\n", valueLen, value);
+                            XTP_TIMING_END(XTP_TIME_HTTP_RECEIVE);
+                            rejectRequest(400);
+                            return;
+                        }
+                        c.content_length = (int) length;
+                    } else if (nameLen == 6 && strncasecmp(name, "Expect", 6) == 0) {
+                        c.expect_continue = containsToken(value, valueLen, "100-continue");
                     }
-                    body[body_length] = '\0';
+
+                    // Check if we should skip this header (common unneeded ones)
+                    bool skipHeader = false;
+                    if (nameLen == 6 && strncasecmp(name, "Accept", 6) == 0) skipHeader = true;
+                    else if (nameLen == 10 && strncasecmp(name, "User-Agent", 10) == 0) skipHeader = true;
+                    else if (nameLen == 10 && strncasecmp(name, "Connection", 10) == 0) skipHeader = true;
+                    else if (nameLen == 15 && strncasecmp(name, "Accept-Language", 15) == 0) skipHeader = true;
+                    else if (nameLen == 13 && strncasecmp(name, "Cache-Control", 13) == 0) skipHeader = true;
+                    else if (nameLen == 3 && strncasecmp(name, "DNT", 3) == 0) skipHeader = true;
+
+                    if (!skipHeader) storeHeader(c, name, nameLen, value, valueLen);
                 }
+
+                // Keep the unparsed tail (partial line or the next pipelined request) at the front of rx
+                c.rx_length = len - pos;
+                memmove(c.rx, &buf[pos], c.rx_length);
+
+                if (!complete) {
+                    c.receive_us += micros() - t_us;
+                    XTP_TIMING_END(XTP_TIME_HTTP_RECEIVE);
+                    return;
+                }
+
+                c.body[c.body_length] = '\0';
+                c.keep_alive = c.keep_alive && c.requests + 1 < HTTP_KEEP_ALIVE_MAX_REQUESTS;
+                c.rx_pending = c.rx_length > 0;
+                c.parse_stage = PARSE_REQUEST_LINE;
             }
+            c.receive_us += micros() - t_us;
             XTP_TIMING_END(XTP_TIME_HTTP_RECEIVE);
-            _last_ms = t;
+            if (!admitRequest(true)) return;
+            c.last_ms = t;
+            c.request_us = micros();
             enterState(PROCESSING);
             break;
 
         case PROCESSING:
             // Check timeout
-            if (t - _last_ms > HTTP_CLIENT_TIMEOUT_MS) {
-                Serial.printf("[HTTP] Timeout in PROCESSING after %lu ms\n", t - _last_ms);
+            if (t - c.last_ms > HTTP_CLIENT_TIMEOUT_MS) {
+                Serial.printf("[HTTP] Timeout in PROCESSING after %lu ms\n", t - c.last_ms);
                 _requests_failed++;
                 initiateClientClose();
-                XTP_TIMING_END(XTP_TIME_HTTP_HANDLE);
                 return;
             }
             
             // Verify client is still connected
             {
                 XTP_TIMING_START(XTP_TIME_W5500_STATUS);
-                bool still_connected = client.connected();
+                bool still_connected = c.client.connected();
                 XTP_TIMING_END(XTP_TIME_W5500_STATUS);
                 if (!still_connected) {
                     Serial.println("[HTTP] Client disconnected before processing");
                     forceClientClose();
-                    XTP_TIMING_END(XTP_TIME_HTTP_HANDLE);
                     return;
                 }
             }
             
             // Find matching endpoint
             {
-                bool found = false;
-                for (int i = 0; i < _endpoints_count; i++) {
-                    auto& endpoint = _endpoints[i];
-                    auto uri = endpoint.uri;
-                    auto method = endpoint.method;
-                    bool uri_match = strcmp(uri, _uri) == 0;
-                    if (!uri_match) {
-                        const char* alt_uri = getMap(_uri);
-                        if (alt_uri != nullptr)
-                            uri_match = strcmp(uri, alt_uri) == 0;
-                    }
-                    bool method_match = method == _method;
+                Endpoint* endpoint = c.endpoint;
+                if (endpoint != nullptr) {
+                    _requests_success++;
+                    _transmitted_bytes = 0;
+                    uint32_t handler_start_us = micros();
+                    c.tx_room = -1;
                     
-                    if (uri_match && method_match) {
-                        _requests_success++;
-                        _transmitted_bytes = 0;
-                        Serial.printf("  %s %s", method == HTTP_GET ? "GET" : "POST", uri);
-                        uint32_t handler_start = millis();
-                        
-                        // Execute handler
-                        XTP_TIMING_START(XTP_TIME_HTTP_HANDLER);
-                        endpoint.handler();
-                        XTP_TIMING_END(XTP_TIME_HTTP_HANDLER);
-                        
-                        uint32_t elapsed_ms = millis() - handler_start;
-                        Serial.printf(" - %u bytes in %lu ms\n", _transmitted_bytes, elapsed_ms);
-                        
-                        found = true;
-                        initiateClientClose();
-                        break;
-                    }
-                }
-                
-                if (!found) {
+                    // Execute handler
+                    XTP_TIMING_START(XTP_TIME_HTTP_HANDLER);
+                    endpoint->handler();
+                    XTP_TIMING_END(XTP_TIME_HTTP_HANDLER);
+                    
+                    c.handler_us = micros() - handler_start_us;
+                    if (c.state == DEFERRED || c.state == STREAMING) break;
+                    finishResponse();
+                } else if (c.method == HTTP_OPTIONS) {
+                    // Preflight (or plain OPTIONS) for any path, without routing
+                    uint32_t handler_start_us = micros();
+                    c.tx_room = -1;
+                    sendHeader(204, nullptr, -1, false, _cors_preflight);
+                    c.handler_us = micros() - handler_start_us;
+                    finishResponse();
+                } else {
                     enterState(FAILED);
                 }
             }
@@ -625,27 +1896,129 @@ public:
 
         case FAILED:
             _requests_failed++;
-            Serial.printf("  %s %s - 404 Not Found\n", _method == HTTP_GET ? "GET" : "POST", _uri);
-            
-            if (client.connected()) {
-                if (_notFoundHandler_defined) {
-                    _notFoundHandler();
-                } else {
-                    client.print("HTTP/1.1 404 Not Found\r\n");
-                    client.print("Content-Type: text/plain\r\n");
-                    client.print("Connection: close\r\n");
-                    client.print("\r\n");
-                    client.print("Error 404, page not found");
+            if (c.client.connected()) {
+                c.tx_room = -1;
+                sendNotFound();
+            }
+            c.handler_us = micros() - t_us;
+            finishResponse();
+            break;
+
+        case DEFERRED:
+            // The handler answers later - poll it, or wait for resume()/complete(), without holding up the loop
+            {
+                XTP_TIMING_START(XTP_TIME_W5500_STATUS);
+                bool is_connected = c.client.connected();
+                XTP_TIMING_END(XTP_TIME_W5500_STATUS);
+                if (!is_connected) {
+                    Serial.printf("[HTTP] Client disconnected while %s was deferred\n", c.uri);
+                    recordRequest(true);
+                    forceClientClose();
+                    return;
+                }
+
+                if (timeInState() > c.deferred_timeout_ms) {
+                    Serial.printf("[HTTP] Deferred %s timed out after %lu ms\n", c.uri, timeInState());
+                    _requests_failed++;
+                    c.tx_room = -1;
+                    send(504, "text/plain", "", 0);
+                    finishResponse();
+                    break;
+                }
+
+                if (c.deferred_poll != nullptr) {
+                    c.tx_room = -1;
+                    XTP_TIMING_START(XTP_TIME_HTTP_HANDLER);
+                    bool done = c.deferred_poll(c.deferred_context);
+                    XTP_TIMING_END(XTP_TIME_HTTP_HANDLER);
+                    c.handler_us += micros() - t_us;
+                    if (done && c.state == DEFERRED) finishResponse();
+                }
+            }
+            break;
+
+        case STREAMING:
+            // Move whole events from the stream's queue into tx as it frees up, a comment line when idle
+            {
+                EventStream& stream = _streams[c.stream];
+                XTP_TIMING_START(XTP_TIME_W5500_STATUS);
+                bool is_connected = c.client.connected();
+                XTP_TIMING_END(XTP_TIME_W5500_STATUS);
+                if (!is_connected) {
+                    // The usual end of an event stream
+                    recordRequest(false);
+                    forceClientClose();
+                    return;
+                }
+
+                XTP_TIMING_START(XTP_TIME_HTTP_SEND);
+                uint8_t frame[HTTP_SSE_MAX_EVENT_SIZE];
+                if (c.tx.isEmpty()) c.tx_progress_ms = t;
+                while (!stream.queue.isEmpty() && stream.queue.front() <= c.tx.freeSpace()) {
+                    int n = stream.queue.pop(frame);
+                    c.tx.write(frame, n);
+                    c.tx_bytes += n;
+                    stream.sent_ms = t;
+                }
+                if (c.tx.isEmpty() && t - stream.sent_ms >= HTTP_SSE_HEARTBEAT_MS) {
+                    c.tx.write((const uint8_t*) ":\n\n", 3);
+                    c.tx_bytes += 3;
+                    stream.sent_ms = t;
+                }
+                bool sent = c.tx.isEmpty() || drainTx();
+                XTP_TIMING_END(XTP_TIME_HTTP_SEND);
+                c.send_us += micros() - t_us;
+                if (sent && stream.closing && stream.queue.isEmpty()) {
+                    recordRequest(false);
+                    initiateClientClose();
+                } else if (!sent && millis() - c.tx_progress_ms > HTTP_SEND_STALL_TIMEOUT_MS) {
+                    Serial.printf("[HTTP] Event stream stalled for %lu ms, closing\n", millis() - c.tx_progress_ms);
+                    recordRequest(true);
+                    forceClientClose();
+                }
+            }
+            break;
+
+        case SENDING:
+            {
+                XTP_TIMING_START(XTP_TIME_W5500_STATUS);
+                bool is_connected = c.client.connected();
+                XTP_TIMING_END(XTP_TIME_W5500_STATUS);
+                if (!is_connected) {
+                    Serial.println("[HTTP] Client disconnected during SENDING");
+                    recordRequest(true);
+                    forceClientClose();
+                    return;
+                }
+
+                XTP_TIMING_START(XTP_TIME_HTTP_SEND);
+                bool sent = drainTx();
+                while (sent && c.tx_producer != nullptr) {
+                    uint32_t written = c.tx_bytes;
+                    produceChunk();
+                    sent = drainTx();
+                    if (c.tx_bytes == written) break; // Nothing to send yet - ask again next loop
+                }
+                sent = sent && c.tx_producer == nullptr;
+                XTP_TIMING_END(XTP_TIME_HTTP_SEND);
+                c.send_us += micros() - t_us;
+                if (sent) {
+                    finishRequest();
+                } else if (millis() - c.tx_progress_ms > HTTP_SEND_STALL_TIMEOUT_MS) {
+                    // Not `t` - drainTx() may have stamped tx_progress_ms a millisecond later
+                    Serial.printf("[HTTP] Send stalled for %lu ms, closing\n", millis() - c.tx_progress_ms);
+                    _requests_failed++;
+                    recordRequest(true);
+                    forceClientClose();
                 }
             }
-            initiateClientClose();
             break;
 
         case CLOSING:
             XTP_TIMING_START(XTP_TIME_HTTP_CLOSE);
             {
                 // Check socket status directly - don't use client.connected() as it can block
-                uint8_t sock = getClientSocket(client);
+                uint8_t sock = getClientSocket(c.client);
                 uint8_t status = (sock < 8) ? W5100.readSnSR(sock) : 0;
                 bool isClosed = (status == 0x00 || status == 0x1C);  // CLOSED or CLOSE_WAIT
                 
@@ -655,6 +2028,7 @@ public:
                         // Still not closed after timeout - force hard close
                         hardCloseSocket();
                     } else {
+                        c.client = EthernetClient();
                         client = EthernetClient();
                     }
                     XTP_TIMING_END(XTP_TIME_HTTP_CLOSE);
@@ -671,10 +2045,10 @@ public:
             enterState(WAITING);
             break;
             
+        default:
+            break;
         } // switch(state)
-        XTP_TIMING_END(XTP_TIME_HTTP_HANDLE);
-    } // handleClient
-    
+    } // handleConnection
     // Get server statistics
     void getStats(uint32_t& success, uint32_t& failed, uint32_t& restarts) {
         success = _requests_success;
@@ -682,19 +2056,197 @@ public:
         restarts = _server_restart_count;
     }
 
-    void send(int code, const char* content_type, const char* content, int length) {
+    // Requests turned away by admission control: over the client's rate (429) and shed under load (503)
+    void getAdmissionStats(uint32_t& limited, uint32_t& shed) {
+        limited = _requests_limited;
+        shed = _requests_shed;
+    }
+
+    // `headers` - extra header lines, each ending with CRLF. The response has to fit what the socket and
+    // the TX queue take right now, a larger one is answered with 500 - see sendStatic() and sendStream().
+    void send(int code, const char* content_type, const char* content, int length, const char* headers = nullptr) {
+        if (_capture) {
+            renderHeader(code, content_type, length, false, headers);
+            captureWrite(content, length);
+            return;
+        }
+        XTP_TIMING_START(XTP_TIME_HTTP_SEND);
+        renderHeader(code, content_type, length, false, headers);
+        if (_response_length + (headOnly() ? 0 : length) > txCapacity()) {
+            Serial.printf("[HTTP] %d byte response does not fit the TX queue, answering 500\n", length);
+            content = "Response too large";
+            length = strlen(content);
+            renderHeader(500, "text/plain", length, false);
+        }
+        // The start of the body rides along with the header in the same socket write
+        int n = headOnly() ? length : appendResponse(content, length);
+        flushResponse();
+        txWrite((const uint8_t*) content + n, length - n);
+        _transmitted_bytes += length;
+        XTP_TIMING_END(XTP_TIME_HTTP_SEND);
+    }
+
+    // Like send(), but the body is only referenced, not copied - it must stay valid until the response
+    // has gone out (const data such as compiled web assets). Large bodies never block the loop.
+    void sendStatic(int code, const char* content_type, const char* content, int length, const char* headers = nullptr) {
+        if (_capture) {
+            send(code, content_type, content, length, headers);
+            return;
+        }
+        if (bodyPending(length)) return;
         XTP_TIMING_START(XTP_TIME_HTTP_SEND);
-        // Using batched response in chunks of HTTP_RES_CHUNK_SIZE bytes
-        for (int i = 0; i < length; i += HTTP_RES_CHUNK_SIZE) {
-            int len = length - i;
-            if (len > HTTP_RES_CHUNK_SIZE) len = HTTP_RES_CHUNK_SIZE;
-            if (i == 0) sendHeader(code, content_type, length);
-            client.write((const uint8_t*) &content[i], len);
-            bool done = i + len >= length;
+        renderHeader(code, content_type, length, false, headers);
+        int n = headOnly() ? length : appendResponse(content, length);
+        flushResponse();
+        startBody((const uint8_t*) content + n, nullptr, 0, max(length - n, 0));
+        _transmitted_bytes += length;
+        XTP_TIMING_END(XTP_TIME_HTTP_SEND);
+    }
+
+    // Like sendStatic(), but the body is pulled from `reader` (starting at `position`) only as fast as
+    // the client takes it, so it can come from external memory such as the SPI flash or be generated
+    void sendStream(int code, const char* content_type, BodyReader reader, uint32_t position, int length, const char* headers = nullptr) {
+        if (_capture) {
+            renderHeader(code, content_type, length, false, headers);
+            uint8_t buffer[HTTP_STREAM_READ_SIZE];
+            while (length > 0) {
+                int n = reader(position, buffer, min(length, (int) sizeof(buffer)));
+                if (n <= 0) break;
+                captureWrite((const char*) buffer, n);
+                position += n;
+                length -= n;
+            }
+            return;
         }
+        if (bodyPending(length)) return;
+        XTP_TIMING_START(XTP_TIME_HTTP_SEND);
+        renderHeader(code, content_type, length, false, headers);
+        flushResponse();
+        startBody(nullptr, reader, position, headOnly() ? 0 : max(length, 0));
         _transmitted_bytes += length;
         XTP_TIMING_END(XTP_TIME_HTTP_SEND);
-        // client.stop();
+    }
+
+    // One sendStatic()/sendStream() body at a time - another one while it is still going out cuts the response short
+    bool bodyPending(int length) {
+        if (_conn->tx_static_length == 0) return false;
+        cutTx("Second response body", length);
+        return true;
+    }
+
+    // The body goes out once the bytes queued so far have, and whatever is written after it waits behind it
+    void startBody(const uint8_t* data, BodyReader reader, uint32_t position, uint32_t length) {
+        Connection& c = *_conn;
+        if (c.tx_cut) return;
+        c.tx_head = c.tx.available();
+        c.tx_static = data;
+        c.tx_reader = reader;
+        c.tx_position = position;
+        c.tx_static_length = length;
+        c.tx_bytes += length;
+        drainTx();
+    }
+
+    // Response bytes that can be written right now: the W5500's free space (unless something is queued
+    // ahead of them) and the queue's
+    int txCapacity() {
+        Connection& c = *_conn;
+        if (c.tx_cut) return 0;
+        int room = c.tx.freeSpace();
+        if (c.tx.isEmpty() && c.tx_static_length == 0) {
+            if (c.tx_room < 0) c.tx_room = c.client.availableForWrite();
+            room += c.tx_room;
+        }
+        return room;
+    }
+
+    // Write response bytes without blocking: straight to the socket while the W5500 has room and nothing is
+    // queued ahead, the rest into the connection's queue for SENDING. More than the queue takes cuts the response short.
+    void txWrite(const uint8_t* data, int length) {
+        Connection& c = *_conn;
+        if (length <= 0 || c.tx_cut) return;
+        int written = 0;
+        if (c.tx.isEmpty() && c.tx_static_length == 0) {
+            if (c.tx_room < 0) c.tx_room = c.client.availableForWrite();
+            int n = min(length, c.tx_room);
+            if (n > 0) {
+                written = c.client.write(data, n);
+                c.tx_room -= written;
+            }
+        }
+        int queued = c.tx.write(data + written, length - written);
+        c.tx_bytes += written + queued;
+        if (written + queued < length) cutTx("TX queue full", length - written - queued);
+    }
+
+    // The response can't go out whole: drop the rest of it, and close the connection once the queue is out
+    // so the client sees it incomplete (short of its Content-Length or the terminating chunk)
+    void cutTx(const char* reason, int length) {
+        Connection& c = *_conn;
+        if (!c.tx_cut) Serial.printf("[HTTP] %s, %d response bytes dropped - closing\n", reason, length);
+        c.tx_cut = true;
+        c.keep_alive = false;
+    }
+
+    // Write as much of the response as the W5500 has room for, true once all of it is out
+    bool drainTx() {
+        Connection& c = *_conn;
+        c.tx_room = c.client.availableForWrite();
+        while (c.tx_room > 0) {
+            int n;
+            if (!c.tx.isEmpty() && (c.tx_static_length == 0 || c.tx_head > 0)) {
+                int len;
+                const uint8_t* span = c.tx.peek(len);
+                if (c.tx_static_length > 0) len = min(len, (int) c.tx_head);
+                n = c.client.write(span, min(len, c.tx_room));
+                if (n <= 0) break;
+                c.tx.consume(n);
+                if (c.tx_static_length > 0) c.tx_head -= n;
+            } else if (c.tx_reader != nullptr && c.tx_static_length > 0) {
+                n = writeStream();
+                if (n <= 0) break;
+            } else if (c.tx_static_length > 0) {
+                n = c.client.write(c.tx_static, (int) min(c.tx_static_length, (uint32_t) min(c.tx_room, HTTP_RES_CHUNK_SIZE)));
+                if (n <= 0) break;
+                c.tx_static += n;
+                c.tx_static_length -= n;
+            } else {
+                break;
+            }
+            c.tx_room -= n;
+            c.tx_progress_ms = millis();
+        }
+        return c.tx.isEmpty() && c.tx_static_length == 0;
+    }
+
+    // Read the next piece of a sendStream() body straight into the socket, returns the bytes written.
+    // What the socket does not take is read again next time; a failing source cuts the response short.
+    int writeStream() {
+        Connection& c = *_conn;
+        uint8_t buffer[HTTP_STREAM_READ_SIZE];
+        int length = c.tx_reader(c.tx_position, buffer, (int) min(c.tx_static_length, (uint32_t) min(c.tx_room, (int) sizeof(buffer))));
+        if (length <= 0) {
+            cutTx("Response body source failed", c.tx_static_length);
+            c.tx_static_length = 0;
+            c.tx_reader = nullptr;
+            c.tx.reset(); // What was to follow the body makes no sense without it
+            return 0;
+        }
+        int n = c.client.write(buffer, length);
+        c.tx_position += n;
+        c.tx_static_length -= n;
+        return n;
+    }
+
+    void resetTx() {
+        _conn->tx.reset();
+        _conn->tx_head = 0;
+        _conn->tx_static = nullptr;
+        _conn->tx_static_length = 0;
+        _conn->tx_reader = nullptr;
+        _conn->tx_producer = nullptr;
+        _conn->tx_cut = false;
+        _conn->tx_room = -1;
     }
 
     void sendBuffer(int code, const uint8_t* buffer, int length) {
@@ -712,28 +2264,426 @@ public:
     }
 
 
-    void sendHeader(int code, const char* content_type, int length = -1) {
-        client.printf("HTTP/1.1 %d %s\r\n", code, code >= 300 ? "NOT OK" : "OK");
-        client.printf("Content-Type: %s\r\n", content_type);
-        if (length >= 0) client.printf("Content-Length: %d\r\n", length);
-        client.printf("Connection: close\r\n\r\n");
+    void sendHeader(int code, const char* content_type, int length = -1, bool chunked = false, const char* headers = nullptr) {
+        renderHeader(code, content_type, length, chunked, headers);
+        if (!_capture) flushResponse();
+    }
+
+    // Assemble the status line and headers in _response_buffer (written by flushResponse).
+    // 1xx, 204 and 304 responses have no body - content_type and length are ignored.
+    void renderHeader(int code, const char* content_type, int length, bool chunked, const char* headers = nullptr) {
+        bool no_body = code < 200 || code == 204 || code == 304;
+        if (no_body) {
+            content_type = nullptr;
+            length = -1;
+            chunked = false;
+        }
+        if (_capture) {
+            captureHeader(code, content_type);
+            return;
+        }
+        // Without a length (or chunked framing) the client can only find the end of the body when we close
+        if (length < 0 && !chunked && !no_body) _conn->keep_alive = false;
+        _conn->status = code;
+        _response_length = 0;
+        const char* status_line = http_status_line(code);
+        if (status_line != nullptr) {
+            appendResponse(status_line);
+        } else {
+            appendResponse("HTTP/1.1 ");
+            appendResponseInt(code);
+            appendResponse(code < 300 ? " OK\r\n" : code < 400 ? " Redirect\r\n" : code < 500 ? " Client Error\r\n" : " Server Error\r\n");
+        }
+        if (content_type != nullptr) {
+            appendResponse("Content-Type: ");
+            appendResponse(content_type);
+            appendResponse("\r\n");
+        }
+        if (chunked) {
+            appendResponse("Transfer-Encoding: chunked\r\n");
+        } else if (length >= 0) {
+            appendResponse("Content-Length: ");
+            appendResponseInt(length);
+            appendResponse("\r\n");
+        }
+        if (headers != nullptr) appendResponse(headers);
+        appendResponse(_cors_headers);
+        if (_conn->keep_alive) {
+            appendResponse("Connection: keep-alive\r\nKeep-Alive: timeout=");
+            appendResponseInt(HTTP_KEEP_ALIVE_TIMEOUT_MS / 1000);
+            appendResponse(", max=");
+            appendResponseInt(HTTP_KEEP_ALIVE_MAX_REQUESTS - _conn->requests - 1);
+            appendResponse("\r\n\r\n");
+        } else {
+            appendResponse("Connection: close\r\n\r\n");
+        }
+    }
+
+    // Copy as much as fits after the rendered header, returns the number of bytes taken
+    int appendResponse(const char* data, int length) {
+        int n = min(length, HTTP_RESPONSE_BUFFER_SIZE - _response_length);
+        if (n <= 0) return 0;
+        memcpy(&_response_buffer[_response_length], data, n);
+        _response_length += n;
+        return n;
+    }
+
+    int appendResponse(const char* text) { return appendResponse(text, strlen(text)); }
+
+    void appendResponseInt(uint32_t value) {
+        char digits[10];
+        int i = sizeof(digits);
+        do {
+            digits[--i] = '0' + value % 10;
+            value /= 10;
+        } while (value > 0);
+        appendResponse(&digits[i], sizeof(digits) - i);
+    }
+
+    void flushResponse() {
+        if (_response_length == 0) return;
+        txWrite((const uint8_t*) _response_buffer, _response_length);
+        _response_length = 0;
+    }
+
+    // Chunked response, for bodies produced piece by piece without knowing the length up front:
+    //   rest.beginChunked(200, "application/json");
+    //   rest.printfChunk("{\"count\":%d,\"items\":[", count);
+    //   for (...) rest.printfChunk(...);
+    //   rest.writeChunk("]}");
+    //   rest.endChunked();
+    // HTTP/1.0 clients get the raw body followed by a close instead.
+    // The header waits to go out with the first chunk; a body that fits one chunk is a single write.
+    // All of it has to fit the TX queue (HTTP_TX_BUFFER_SIZE beyond what the socket takes at once),
+    // the response is cut short otherwise - longer bodies come from a producer:
+    //   rest.beginChunked(200, "application/json");
+    //   rest.writeChunk("[");
+    //   rest.continueChunked([](uint32_t& cursor, uint32_t& items) {
+    //       rest.printfChunk(...);           // entry by entry, up to a queue's worth per call
+    //       if (++cursor < count) return true;
+    //       rest.writeChunk("]");
+    //       return false;
+    //   });
+    // which is called again from the SENDING state each time the client has taken what it wrote.
+    void beginChunked(int code, const char* content_type) {
+        if (_capture) {
+            renderHeader(code, content_type, -1, true);
+            return;
+        }
+        _chunk_length = 0;
+        _chunked = _conn->http11;
+        renderHeader(code, content_type, -1, _chunked);
+    }
+
+    // The rest of the chunked response comes from `producer`, starting at `cursor` - the handler returns right after
+    void continueChunked(ChunkProducer producer, uint32_t cursor = 0) {
+        uint32_t items = 0;
+        if (_capture) {
+            while (producer(cursor, items)) {}
+        } else if (!headOnly()) {
+            _conn->tx_producer = producer;
+            _conn->tx_cursor = cursor;
+            _conn->tx_items = items;
+        }
+    }
+
+    // Let the producer write the next part of the body (the queue is empty), the terminating chunk after the last
+    void produceChunk() {
+        Connection& c = *_conn;
+        _chunk_length = 0;
+        _chunked = c.http11;
+        bool more = c.tx_producer(c.tx_cursor, c.tx_items);
+        if (!more) c.tx_producer = nullptr;
+        sendChunk(!more);
+        _chunked = false;
+    }
+
+    void writeChunk(const char* data, int length) {
+        if (_capture) {
+            captureWrite(data, length);
+            return;
+        }
+        stageChunk(data, length);
+    }
+
+    void stageChunk(const char* data, int length) {
+        if (length <= 0 || headOnly()) return;
+        if (_chunk_length + length > HTTP_CHUNK_BUFFER_SIZE) sendChunk(false);
+        if (length > HTTP_CHUNK_BUFFER_SIZE) {
+            // Too big to stage - goes out as a chunk of its own
+            XTP_TIMING_START(XTP_TIME_HTTP_SEND);
+            if (_chunked) {
+                char size_line[CHUNK_HEADER_SIZE + 1];
+                appendResponse(size_line, snprintf(size_line, sizeof(size_line), "%X\r\n", length));
+            }
+            flushResponse();
+            txWrite((const uint8_t*) data, length);
+            if (_chunked) txWrite((const uint8_t*) "\r\n", 2);
+            _transmitted_bytes += length;
+            XTP_TIMING_END(XTP_TIME_HTTP_SEND);
+            return;
+        }
+        memcpy(&_chunk_buffer[CHUNK_HEADER_SIZE + _chunk_length], data, length);
+        _chunk_length += length;
+    }
+
+    void writeChunk(const char* text) { writeChunk(text, strlen(text)); }
+
+    // Formatted output of up to HTTP_CHUNK_BUFFER_SIZE bytes per call (longer output is truncated)
+    void printfChunk(const char* format, ...) {
+        if (headOnly()) return;
+        if (_capture) {
+            char text[HTTP_CHUNK_BUFFER_SIZE + 1];
+            va_list args;
+            va_start(args, format);
+            int n = vsnprintf(text, sizeof(text), format, args);
+            va_end(args);
+            captureWrite(text, min(n, HTTP_CHUNK_BUFFER_SIZE));
+            return;
+        }
+        va_list args;
+        va_start(args, format);
+        va_list retry;
+        va_copy(retry, args);
+        int space = HTTP_CHUNK_BUFFER_SIZE - _chunk_length;
+        // The bytes reserved for the chunk's trailer leave room for vsnprintf's terminator
+        int n = vsnprintf(&_chunk_buffer[CHUNK_HEADER_SIZE + _chunk_length], space + 1, format, args);
+        if (n > space && _chunk_length > 0) {
+            flushChunk();
+            space = HTTP_CHUNK_BUFFER_SIZE;
+            n = vsnprintf(&_chunk_buffer[CHUNK_HEADER_SIZE], space + 1, format, retry);
+        }
+        va_end(retry);
+        va_end(args);
+        if (n > 0) _chunk_length += min(n, space);
+    }
+
+    // Send the staged bytes as one chunk (behind a pending header, ahead of the terminating
+    // chunk when `last`) with a single socket write
+    void flushChunk(bool last = false) {
+        if (!_capture) sendChunk(last);
+    }
+
+    void sendChunk(bool last) {
+        if (headOnly()) {
+            flushResponse();
+            return;
+        }
+        if (_chunk_length == 0 && !last) return;
+        XTP_TIMING_START(XTP_TIME_HTTP_SEND);
+        char* start = &_chunk_buffer[CHUNK_HEADER_SIZE];
+        int length = _chunk_length;
+        if (_chunked && _chunk_length > 0) {
+            // Size line goes right in front of the data, CRLF right after it
+            char size_line[CHUNK_HEADER_SIZE + 1];
+            int n = snprintf(size_line, sizeof(size_line), "%X\r\n", _chunk_length);
+            start -= n;
+            memcpy(start, size_line, n);
+            length += n;
+            memcpy(&start[length], "\r\n", 2);
+            length += 2;
+        }
+        if (_chunked && last) {
+            memcpy(&start[length], "0\r\n\r\n", 5);
+            length += 5;
+        }
+        if (_response_length + length <= HTTP_RESPONSE_BUFFER_SIZE) {
+            appendResponse(start, length);
+            flushResponse();
+        } else {
+            flushResponse();
+            txWrite((const uint8_t*) start, length);
+        }
+        _transmitted_bytes += _chunk_length;
+        _chunk_length = 0;
+        XTP_TIMING_END(XTP_TIME_HTTP_SEND);
+    }
+
+    void endChunked() {
+        if (_capture) return;
+        flushChunk(true);
+        _chunked = false;
     }
 
     void write(uint8_t* buffer, int length) {
-        client.write(buffer, length);
+        if (_capture) captureWrite((const char*) buffer, length);
+        else if (!headOnly()) txWrite(buffer, length);
+    }
+
+    // Run the GET route for `path` (query string included) as part of the current chunked response,
+    // which gets its answer as one `{"path":..,"status":..,"type":..,"body":..}` entry - JSON bodies
+    // as they are, anything else as a JSON string. Deferred handlers answer 501, nested batches nothing.
+    void captureRoute(const char* path, int length, bool first) {
+        if (_capture) return;
+        Connection& c = *_conn;
+        char uri[HTTP_MAX_URI_LENGTH];
+        length = min(length, (int) sizeof(uri) - 1);
+        memcpy(uri, path, length);
+        uri[length] = '\0';
+
+        // The batched request takes the place of the current one until its handler returns
+        char* saved_uri = _uri;
+        HttpView saved_query = c.query;
+        HTTPMethod saved_method = c.method;
+        int saved_paramc = c.paramc;
+        PathParam saved_params[HTTP_MAX_PATH_PARAMS];
+        memcpy(saved_params, c.params, sizeof(saved_params));
+        char* query = strchr(uri, '?');
+        c.query = HttpView();
+        if (query != nullptr) {
+            *query = '\0';
+            c.query = { query + 1, (uint16_t) strlen(query + 1) };
+        }
+        int saved_body_length = body_length;
+        _uri = uri;
+        c.method = HTTP_GET;
+        _method = HTTP_GET;
+        body_length = 0;
+
+        stageChunk(first ? "{\"path\":\"" : ",{\"path\":\"", first ? 9 : 10);
+        _capture_escape = true;
+        _capture_started = true;
+        captureWrite(uri, strlen(uri));
+        stageChunk("\",", 2);
+        _capture = true;
+        _capture_started = false;
+        _capture_bytes = 0;
+        Endpoint* endpoint = resolveEndpoint(uri, HTTP_GET);
+        if (endpoint != nullptr) endpoint->handler();
+        else sendNotFound();
+        if (!_capture_started) captureHeader(0, nullptr);
+        _capture = false;
+        if (_capture_escape) stageChunk("\"}", 2);
+        else if (_capture_bytes > 0) stageChunk("}", 1);
+        else stageChunk("null}", 5);
+
+        _uri = saved_uri;
+        body_length = saved_body_length;
+        c.query = saved_query;
+        c.method = saved_method;
+        _method = saved_method;
+        c.paramc = saved_paramc;
+        memcpy(c.params, saved_params, sizeof(saved_params));
+    }
+
+    // Status and type of a batched response - only the first header a handler renders counts
+    void captureHeader(int code, const char* content_type) {
+        if (_capture_started) return;
+        _capture_started = true;
+        char text[96];
+        int n = snprintf(text, sizeof(text), "\"status\":%d,\"type\":\"%s\",\"body\":", code, content_type != nullptr ? content_type : "");
+        stageChunk(text, min(n, (int) sizeof(text) - 1));
+        _capture_escape = content_type != nullptr && strncmp(content_type, "application/json", 16) != 0;
+        if (_capture_escape) stageChunk("\"", 1);
+    }
+
+    // Body bytes of a batched response, escaped for a JSON string unless the body is JSON itself
+    void captureWrite(const char* data, int length) {
+        if (!_capture_started || length <= 0) return;
+        _capture_bytes += length;
+        if (!_capture_escape) {
+            stageChunk(data, length);
+            return;
+        }
+        int start = 0;
+        for (int i = 0; i < length; i++) {
+            uint8_t ch = data[i];
+            if (ch >= 0x20 && ch < 0x7F && ch != '"' && ch != '\\') continue;
+            stageChunk(data + start, i - start);
+            char escaped[7];
+            if (ch == '"' || ch == '\\') snprintf(escaped, sizeof(escaped), "\\%c", ch);
+            else if (ch == '\n') strcpy(escaped, "\\n");
+            else if (ch == '\r') strcpy(escaped, "\\r");
+            else if (ch == '\t') strcpy(escaped, "\\t");
+            else snprintf(escaped, sizeof(escaped), "\\u%04x", ch);
+            stageChunk(escaped, strlen(escaped));
+            start = i + 1;
+        }
+        stageChunk(data + start, length - start);
     }
 
+    // HEAD request - response headers go out as for GET, body writes are dropped
+    bool headOnly() { return _conn->method == HTTP_HEAD; }
+
     void end() {
         client.stop();
     }
 
     String uri() { return _uri; }
+    const char* path() { return _uri; }   // Request path without the query string
+    int contentLength() { return _conn->content_length; }  // -1 without a Content-Length header
     HTTPMethod method() { return _method; }
-    int args() { return _argc; }
-    Argument arg(int i) { return _args[i]; }
-    const char* argName(int i) { return (const char*) _args[i].name; }
-    const char* argValue(int i) { return (const char*) _args[i].value; }
+    // Request headers kept for the handler, in the order received
+    int args() { return _conn->argc; }
+    Argument arg(int i) { return { argName(i), argValue(i) }; }
+    const char* argName(int i) { return &_conn->headers[_conn->fields[i].name]; }
+    const char* argValue(int i) { return &_conn->headers[_conn->fields[i].value]; }
+
+    // Segment captured by `:name` (or `*`) in the matched pattern route, invalid view if absent
+    HttpView pathParam(const char* name) {
+        for (int i = 0; i < _conn->paramc; i++) {
+            if (_conn->params[i].name.equals(name)) return _conn->params[i].value;
+        }
+        return HttpView();
+    }
+
+    // Raw (still percent-encoded) value of `name` in the query string; `?flag` gives a valid empty view
+    HttpView queryParam(const char* name) {
+        const char* p = _conn->query.data;
+        const char* end = p + _conn->query.length;
+        int name_length = strlen(name);
+        while (p != nullptr && p < end) {
+            const char* amp = (const char*) memchr(p, '&', end - p);
+            const char* pair_end = amp ? amp : end;
+            const char* eq = (const char*) memchr(p, '=', pair_end - p);
+            const char* key_end = eq ? eq : pair_end;
+            if (key_end - p == name_length && strncmp(p, name, name_length) == 0) {
+                if (eq == nullptr) return { pair_end, 0 };
+                return { eq + 1, (uint16_t)(pair_end - eq - 1) };
+            }
+            p = pair_end + 1;
+        }
+        return HttpView();
+    }
+
+    HttpView query() { return _conn->query; }
     void onNotFound(EndpointHandler handler) { _notFoundHandler = handler; _notFoundHandler_defined = true; }
+
+#ifdef XTP_TIMING_TELEMETRY
+    // One `{...}` entry of the /api/timing/routes list (route i, HTTP_MAX_ENDPOINTS for unmatched requests),
+    // returns its length (0 for routes without requests)
+    int routeStatsJson(int i, char* buffer, size_t bufferSize, bool first) {
+        const RouteStats& stats = _route_stats[i];
+        if (stats.hits == 0) return 0;
+        bool matched = i < HTTP_MAX_ENDPOINTS;
+        int offset = snprintf(buffer, bufferSize, "%s{\"uri\":\"%s\",\"method\":\"%s\",\"hits\":%lu,\"errors\":%lu,\"bytes\":%lu",
+            first ? "" : ",",
+            matched ? _endpoints[i].uri : "",
+            matched ? http_method_name(_endpoints[i].method) : "",
+            (unsigned long) stats.hits, (unsigned long) stats.errors, (unsigned long) stats.bytes);
+        const char* names[] = { ",\"receive_us\":", ",\"handler_us\":", ",\"send_us\":" };
+        const XtpHistogram* histograms[] = { &stats.receive, &stats.handler, &stats.send };
+        for (int h = 0; h < 3 && offset < (int) bufferSize; h++) {
+            offset += snprintf(buffer + offset, bufferSize - offset, "%s", names[h]);
+            if (offset < (int) bufferSize) offset += histograms[h]->json(buffer + offset, bufferSize - offset);
+        }
+        if (offset < (int) bufferSize) offset += snprintf(buffer + offset, bufferSize - offset, "}");
+        return offset;
+    }
+
+    void routeStatsReset() {
+        for (int i = 0; i <= HTTP_MAX_ENDPOINTS; i++) _route_stats[i] = RouteStats();
+    }
+#endif
+
+    // The onNotFound() handler, or the default 404 page
+    void sendNotFound() {
+        if (_notFoundHandler_defined) {
+            _notFoundHandler();
+        } else {
+            send(404, "text/plain", "Error 404, page not found");
+        }
+    }
 };
 
 
@@ -774,6 +2724,7 @@ const char* file_content_type(const char* file_name) {
     if (endsWith(file_name, ".gif", false)) return "image/gif";
     if (endsWith(file_name, ".ico", false)) return "image/x-icon";
     if (endsWith(file_name, ".svg", false)) return "image/svg+xml";
+    if (endsWith(file_name, ".webp", false)) return "image/webp";
     if (endsWith(file_name, ".ttf", false)) return "application/x-font-ttf";
     if (endsWith(file_name, ".otf", false)) return "application/x-font-otf";
     if (endsWith(file_name, ".woff", false)) return "application/font-woff";
@@ -795,31 +2746,60 @@ const char* file_content_type(const char* file_name) {
     return "text/plain";
 }
 
+// Files added one by one with addFile() (REST_SERVE_FILE); generated asset indexes have no limit
+#ifndef HTTP_MAX_FILES
+#define HTTP_MAX_FILES 30
+#endif
+
+// Static asset: name, precomputed RestServer::hashUri(name) and content type, data in flash.
+// Constructible at compile time, so a generated `const MyFile index[]` lives in flash as well.
 class MyFile {
 private:
-    char* _name;
+    const char* _name;
+    uint32_t _hash;
+    const char* _data;
     int32_t _length;
-    char* _data;
+    const char* _content_type;
+    bool _gzip;
+    const char* _etag;
 public:
-    MyFile(const char* name, const char* data, int32_t length = -1) {
-        _name = (char*) name;
-        _length = length;
-        if (_length == -1) _length = strlen(data);
-        _data = (char*) data;
-    }
-    const char* name() { return _name; }
-    int32_t length() { return _length; }
-    const char* data() { return _data; }
+    constexpr MyFile() : _name(nullptr), _hash(0), _data(nullptr), _length(0), _content_type(nullptr), _gzip(false), _etag(nullptr) {}
+    constexpr MyFile(const char* name, uint32_t hash, const char* data, int32_t length, const char* content_type, bool gzip = false, const char* etag = nullptr)
+        : _name(name), _hash(hash), _data(data), _length(length), _content_type(content_type), _gzip(gzip), _etag(etag) {}
+    const char* name() const { return _name; }
+    uint32_t hash() const { return _hash; }
+    int32_t length() const { return _length; }
+    const char* data() const { return _data; }
+    const char* contentType() const { return _content_type; }
+    bool gzip() const { return _gzip; }         // Data is gzip compressed (served with Content-Encoding: gzip)
+    const char* etag() const { return _etag; }  // Quoted content hash from web-compile.js, or nullptr
 };
 
 class MyFileSystem {
 private:
     bool __file_route_logging = false;
+    // Both lists are sorted by name hash and searched with a binary search plus an exact name compare
+    const MyFile* _index = nullptr;
+    int32_t _index_count = 0;
     int32_t _numOfFiles = 0;
-    MyFile* _files[30];
+    MyFile _files[HTTP_MAX_FILES];
+
+    static const MyFile* find(const MyFile* files, int32_t count, const char* name, uint32_t hash) {
+        int32_t low = 0;
+        int32_t high = count;
+        while (low < high) {
+            int32_t mid = (low + high) / 2;
+            if (files[mid].hash() < hash) low = mid + 1;
+            else high = mid;
+        }
+        for (; low < count && files[low].hash() == hash; low++) {
+            if (strcmp(files[low].name(), name) == 0) return &files[low];
+        }
+        return nullptr;
+    }
 public:
     MyFileSystem() {}
-    void addFile(const char* name, const char* data, int32_t length = -1) {
+    void addFile(const char* name, const char* data, int32_t length = -1, bool gzip = false, const char* etag = nullptr) {
         if (!__file_route_logging) {
             __file_route_logging = true;
             Serial.println("Routing files to web server");
@@ -829,24 +2809,74 @@ public:
 #else
         length = length < 0 ? strlen(data) : length;
 #endif
-        Serial.printf("  - \"%s\"  -> %d\n", name, length);
-        if (_numOfFiles >= 30) return;
-        _files[_numOfFiles++] = new MyFile(name, data, length);
+        Serial.printf("  - \"%s\"  -> %d%s\n", name, length, gzip ? " (gzip)" : "");
+        if (_numOfFiles >= HTTP_MAX_FILES) return;
+        uint32_t hash = RestServer::hashUri(name);
+        int32_t i = _numOfFiles++;
+        for (; i > 0 && _files[i - 1].hash() > hash; i--) _files[i] = _files[i - 1];
+        _files[i] = MyFile(name, hash, data, length, file_content_type(name), gzip, etag);
+    }
+    // Asset index generated by web-compile.js, sorted by name hash
+    void setIndex(const MyFile* index, int32_t count) {
+        _index = index;
+        _index_count = count;
+        Serial.printf("Routing %d files to web server\n", count);
     }
-    MyFile* getFile(const char* name) {
-        for (int32_t i = 0; i < _numOfFiles; i++) {
-            const char* name_existing = _files[i]->name();
-            if (startsWith(name_existing, name, true)) return _files[i];
+    const MyFile* getFile(const char* name) {
+        uint32_t hash = RestServer::hashUri(name);
+        const MyFile* file = find(_index, _index_count, name, hash);
+        if (file == nullptr) file = find(_files, _numOfFiles, name, hash);
+        return file;
+    }
+
+    // Serve the requested path from the asset index (the catch-all route of REST_SERVE_ASSETS)
+    void handleGetPath(RestServer& rest) {
+        const MyFile* file = getFile(rest.path());
+        if (file == nullptr) {
+            const char* alt_path = rest.getMap(rest.path());
+            if (alt_path != nullptr) file = getFile(alt_path);
         }
-        return NULL;
+        if (file == nullptr) {
+            rest.sendNotFound();
+            return;
+        }
+        sendFile(rest, file);
     }
 
     void handleGetFile(RestServer& rest, const char* file_name) {
-        MyFile* file = this->getFile(file_name);
-        if (file == NULL) {
+        const MyFile* file = this->getFile(file_name);
+        if (file == nullptr) {
             rest.send(404, "File Not Found");
             return;
         }
-        rest.send(200, file_content_type(file_name), file->data(), file->length());
+        sendFile(rest, file);
+    }
+
+    void sendFile(RestServer& rest, const MyFile* file) {
+        char headers[128];
+        if (assetHeaders(rest, file->etag(), file->gzip(), headers, sizeof(headers))) return;
+        rest.sendStatic(200, file->contentType(), file->data(), file->length(), headers);
+    }
+
+    // Render the cache validators and encoding of an asset into `headers`. The browser keeps the asset and
+    // revalidates it with If-None-Match - a match is answered with a bodyless 304 here and returns true.
+    // Compressed assets are only stored gzipped: a client that does not accept gzip gets 406 (also returns true),
+    // which is why web-compile.js gzips only the types it is told to (--gzip).
+    static bool assetHeaders(RestServer& rest, const char* etag, bool gzip, char* headers, int size) {
+        headers[0] = '\0';
+        if (etag != nullptr && etag[0] != '\0') {
+            snprintf(headers, size, "ETag: %s\r\nCache-Control: %s\r\n", etag, HTTP_ASSET_CACHE_CONTROL);
+            const char* if_none_match = rest.readHeader("If-None-Match");
+            if (if_none_match != nullptr && (strstr(if_none_match, etag) != nullptr || strcmp(if_none_match, "*") == 0)) {
+                rest.sendHeader(304, nullptr, -1, false, headers);
+                return true;
+            }
+        }
+        if (gzip && !rest.acceptsEncoding("gzip")) {
+            rest.send(406, "text/plain", "gzip required", 13, "Vary: Accept-Encoding\r\n");
+            return true;
+        }
+        if (gzip) strncat(headers, "Content-Encoding: gzip\r\nVary: Accept-Encoding\r\n", size - strlen(headers) - 1);
+        return false;
     }
 };
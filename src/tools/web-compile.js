@@ -14,6 +14,14 @@
 //   --output: the path and name of the output header file which will contain the complete compiled web server source code (default: './src_files.h')
 //   --function: the name of the function that has to be called in the web server source code to initialize the web server files (default: 'route_files')
 //   --build: the directory where the compiled files for SPIFFS will be stored (default: 'build')
+//   --gzip [<types>]: gzip text files when that makes them smaller - all of them, or only the listed types (e.g. `--gzip js,css`).
+//              Off by default: a gzipped file is stored only compressed, so clients that do not send
+//              `Accept-Encoding: gzip` get 406 for it
+//   --bundle: also write the files as a binary bundle for the SPI flash asset store (XTP_FLASH_ASSETS),
+//             uploaded with `curl --data-binary @<bundle_file> http://<device>/api/assets`
+// Every file gets a strong ETag (content hash) so the browser can revalidate it with a bodyless 304 response.
+// The files are listed in a `const MyFile __files[]` index sorted by name hash (FNV-1a, same as RestServer::hashUri),
+// which the firmware searches with a binary search - there is no limit on the number of files.
 // Example:
 //   node web-compile.js --input ./src --output ./src_files.h --function route_files --build ./build
 //
@@ -22,6 +30,8 @@
 const { promisify } = require('util')
 const path = require('path')
 const fs = require("fs")
+const zlib = require('zlib')
+const crypto = require('crypto')
 const readdir = promisify(fs.readdir)
 const stat = promisify(fs.stat)
 // const exec = promisify(require('child_process').exec)
@@ -70,20 +80,28 @@ const output_file = argv.o || argv.output || './src_files.h'
 // setup function: this is the name of the function that has to be called in the web server source code to initialize the web server files
 const setup_function_name = argv.f || argv.function || 'route_files'
 
+// gzip: serve pre-compressed files with "Content-Encoding: gzip" - opt-in, for every type (true) or the listed ones
+/** @type { boolean | string[] } */
+const gzip_types = argv.gzip === true || !argv.gzip ? !!argv.gzip : String(argv.gzip).toLowerCase().split(',')
+
+// bundle file: binary image of all files for the SPI flash asset store
+const bundle_file = argv.bundle || ''
+
 let file_index = 0
 // ESP8266WebServer file linking: this is the method which will be executed when running the "setup_function_name". That will link all the files to be served on the web server
-/** @param { string } name * @param { string | Buffer } input_data */
-const generate_http_server_file_hosting = (name, input_data) => {
-    // const uint32_t file_1_size = 10;
-    // const uint8_t file_1 [file_1_size + 1] PROGMEM = { 0x00, 0x01, ... }; // Buffer
-    // const uint8_t file_1 [file_1_size + 1] PROGMEM = "01..."; // String
-    // REST_SERVE_FILE("Test file", file_1_size, file_1);
+/** @param { string } name * @param { string | Buffer } input_data * @param { boolean } gzip * @param { string } etag */
+const generate_http_server_file_hosting = (name, input_data, gzip, etag) => {
+    // const int32_t __file_1_size = 10;
+    // const char __file_1[__file_1_size + 1] PROGMEM = { 0x00, 0x01, ... }; // Buffer
+    // const char __file_1[] PROGMEM = "01..."; // String
+    // MyFile("/test.txt", 0x811c9dc5u, __file_1, __file_1_size, "text/plain", true, "\"0123456789abcdef\""), // index entry
     const isString = typeof input_data === 'string'
-    const size = `const int32_t __file_${file_index}_size = ${isString ? -1 : input_data.length};` // @ts-ignore
-    const data = `const char __file_${file_index}[${isString ? '' : `__file_${file_index}_size + 1`}] PROGMEM = ${isString ? (input_data.startsWith('"') ? input_data : JSON.stringify(input_data)) : `{ ${input_data.join(', ')} }`};`
-    const setup = `REST_SERVE_FILE("${name}", __file_${file_index}, __file_${file_index}_size);`
+    const size = `const int32_t __file_${file_index}_size = ${servedBytes(input_data).length};` // @ts-ignore
+    const data = `const char __file_${file_index}[${isString ? '' : `__file_${file_index}_size + 1`}] PROGMEM = ${isString ? (input_data.startsWith('"') ? input_data : JSON.stringify(input_data)) : bytesLiteral(input_data)};`
+    const hash = nameHash(name)
+    const entry = `MyFile("${name}", 0x${hash.toString(16).padStart(8, '0')}u, __file_${file_index}, __file_${file_index}_size, "${contentType(name)}", ${gzip}, ${JSON.stringify(JSON.stringify(etag))}),`
     file_index++;
-    return { size, data, setup }
+    return { size, data, hash, entry }
 }
 
 // ###############################################################################################
@@ -122,6 +140,80 @@ const compressableType = type => {
     type = type.toLowerCase()
     return type === 'html' ? 'HTML' : type === 'js' ? 'JS' : type === 'css' ? 'CSS' : false
 }
+// Formats that are already compressed gain nothing from gzip
+const precompressed_types = ['png', 'jpg', 'jpeg', 'gif', 'webp', 'ico', 'woff', 'woff2', 'gz', 'zip']
+
+/** @type { (output: string | Buffer) => Buffer } */
+const servedBytes = output => {
+    if (typeof output !== 'string') return output
+    return Buffer.from(output.startsWith('"') ? JSON.parse(output) : output)
+}
+/** @type { (data: Buffer) => string } C string literal of binary data (octal escapes never run into the next character) */
+const bytesLiteral = data => {
+    let literal = '"'
+    for (const byte of data) {
+        const printable = byte >= 32 && byte < 127 && byte !== 34 && byte !== 92 && byte !== 63 // not `"`, `\` or `?` (trigraphs)
+        literal += printable ? String.fromCharCode(byte) : '\\' + byte.toString(8).padStart(3, '0')
+    }
+    return literal + '"'
+}
+/** @type { (name: string) => number } FNV-1a, must match RestServer::hashUri() */
+const nameHash = name => {
+    let hash = 2166136261
+    for (const byte of Buffer.from(name)) hash = Math.imul(hash ^ byte, 16777619) >>> 0
+    return hash
+}
+/** @type { { [type: string]: string } } */
+const content_types = {
+    html: 'text/html', css: 'text/css', js: 'application/javascript', json: 'application/json',
+    png: 'image/png', jpg: 'image/jpeg', jpeg: 'image/jpeg', gif: 'image/gif', ico: 'image/x-icon', svg: 'image/svg+xml', webp: 'image/webp',
+    ttf: 'application/x-font-ttf', otf: 'application/x-font-otf', woff: 'application/font-woff', woff2: 'application/font-woff2', eot: 'application/vnd.ms-fontobject',
+    mp3: 'audio/mpeg', mp4: 'video/mp4', m4a: 'audio/mp4', m4v: 'video/mp4', mov: 'video/quicktime', webm: 'video/webm',
+    wav: 'audio/wav', flac: 'audio/flac', opus: 'audio/opus', ogg: 'audio/ogg', ogv: 'video/ogg', ogm: 'video/ogg', ogx: 'application/ogg',
+}
+/** @type { (name: string) => string } Same table as file_content_type() in rest_server.h - keep the two in step */
+const contentType = name => content_types[(name.split('.').pop() || '').toLowerCase()] || 'text/plain'
+/** @type { (data: Buffer) => number } */
+const crc32 = data => {
+    let crc = 0xFFFFFFFF
+    for (const byte of data) {
+        crc ^= byte
+        for (let bit = 0; bit < 8; bit++) crc = (crc >>> 1) ^ (0xEDB88320 & -(crc & 1))
+    }
+    return (crc ^ 0xFFFFFFFF) >>> 0
+}
+
+// SPI flash bundle, as read by xtp_flash.h: FlashAssetsHeader (16 bytes), FlashAssetEntry (96 bytes) per file
+// sorted by name hash, then the file data. All fields little endian.
+/** @type { (files: { name: string, hash: number, data: Buffer, gzip: boolean, etag: string }[]) => Buffer } */
+const buildBundle = files => {
+    const HEADER_SIZE = 16
+    const ENTRY_SIZE = 96
+    files = files.slice().sort((a, b) => a.hash - b.hash)
+    const index = Buffer.alloc(files.length * ENTRY_SIZE)
+    let offset = HEADER_SIZE + index.length
+    files.forEach((file, i) => {
+        const entry = i * ENTRY_SIZE
+        if (Buffer.byteLength(file.name) > 59) throw `File name too long for the flash bundle: ${file.name}`
+        index.writeUInt32LE(file.hash, entry)
+        index.writeUInt32LE(offset, entry + 4)
+        index.writeUInt32LE(file.data.length, entry + 8)
+        index.writeUInt8(file.gzip ? 0x01 : 0x00, entry + 12)
+        index.write(JSON.stringify(file.etag), entry + 16, 19)
+        index.write(file.name, entry + 36, 59)
+        offset += file.data.length
+    })
+    const body = Buffer.concat([index, ...files.map(file => file.data)])
+    const header = Buffer.alloc(HEADER_SIZE)
+    header.write('XTPA', 0)
+    header.writeUInt16LE(1, 4)
+    header.writeUInt16LE(files.length, 6)
+    header.writeUInt32LE(HEADER_SIZE + body.length, 8)
+    header.writeUInt32LE(crc32(body), 12)
+    return Buffer.concat([header, body])
+}
+/** @type { (data: Buffer) => string } */
+const contentHash = data => crypto.createHash('sha256').update(data).digest('hex').substring(0, 16)
 
 // @ts-ignore
 var html_minifier = null // @ts-ignore
@@ -187,7 +279,10 @@ const main = async () => {
     rows.push(``)
 
     const global_definitions = []
-    const definition_linking = []
+    /** @type { { hash: number, entry: string }[] } */
+    const index_entries = []
+    /** @type { { name: string, hash: number, data: Buffer, gzip: boolean, etag: string }[] } */
+    const bundle_files = []
     const file_handling = []
 
     let total_size = 0
@@ -216,26 +311,36 @@ const main = async () => {
         if (compress_type) try { output = await compress[compress_type](contents) } catch (e) { compress_success = false }
         if (compress_type && !compress_success) output = contents
         const original = compress_success ? contents : output // @ts-ignore
-        const file_size = output.length - 2 + file.length + 1 // @ts-ignore
+        let file_size = output.length - 2 + file.length + 1 // @ts-ignore
         const original_size = compress_success ? original.length - 2 + file.length + 1 : file_size
+        const minified = output
+        // Gzip the served bytes when that makes them smaller
+        let gzip = false
+        if ((gzip_types === true || (Array.isArray(gzip_types) && gzip_types.includes(type))) && !precompressed_types.includes(type)) {
+            const raw = servedBytes(output)
+            const gzipped = zlib.gzipSync(raw, { level: 9 })
+            if (gzipped.length < raw.length) {
+                output = gzipped
+                file_size = gzipped.length + file.length + 1
+                gzip = true
+            }
+        }
+        const etag = contentHash(servedBytes(output))
         const rate = 100 - (file_size / original_size) * 100
         largest_file_size = file_size > largest_file_size ? file_size : largest_file_size
         total_size += file_size
         total_uncompressed_size += original_size
         results.push([target_file_path, file_size, !compress_type || compress_success]) // [file_path, file_size, success]
         global_definitions.push('')
-        global_definitions.push(`// Expected size: ${(file_size + '').padStart(8, ' ')} bytes - ${target_file_path} ${compress_type ? `(minified ${compress_type} from ${original_size} bytes ${compress_success ? `-> reduced by ${(rate > 0 ? '-' : '+') + (rate).toFixed(1)}% )` : `failed to compress, please read the README file for information)`}` : ''}`)
-        const { size, data, setup } = generate_http_server_file_hosting(target_file_path, output)
-
-        // const uint32_t file_1_size = 10;
-        // const uint8_t file_1 [file_1_size] PROGMEM = { '1', '2', '3', '4', '5', '6', '7', '8', '9', '0' };
-        // REST_SERVE_FILE("Test file", file_1_size, file_1);
+        global_definitions.push(`// Expected size: ${(file_size + '').padStart(8, ' ')} bytes - ${target_file_path} ${compress_type ? `(minified ${compress_type} from ${original_size} bytes ${compress_success ? `-> reduced by ${(rate > 0 ? '-' : '+') + (rate).toFixed(1)}% )` : `failed to compress, please read the README file for information)`}` : ''}${gzip ? ' (gzip)' : ''}`)
+        const { size, data, hash, entry } = generate_http_server_file_hosting(target_file_path, output, gzip, etag)
 
         global_definitions.push(size)
         global_definitions.push(data)
-        definition_linking.push(`    ${setup}`)
+        index_entries.push({ hash, entry })
+        bundle_files.push({ name: target_file_path, hash, data: servedBytes(output), gzip, etag })
         // Also store the file in the output directory for SPIFFS at "./build_directory/<file_path>"
-        if (compress_type) await saveFile(`${build_directory}${target_file_path}`, output)
+        if (compress_type) await saveFile(`${build_directory}${target_file_path}`, minified)
         // Copy original file to the output directory for SPIFFS at "./build_directory/<file_path>"
         if (!compress_type) {
             await saveFile(`${build_directory}${target_file_path}`, '')
@@ -256,8 +361,14 @@ const main = async () => {
 
     for (let i = 0; i < global_definitions.length; i++) rows.push(global_definitions[i])
     rows.push('')
+    // Asset index sorted by name hash for the binary search in MyFileSystem::getFile()
+    index_entries.sort((a, b) => a.hash - b.hash)
+    rows.push(`const MyFile __files[] = {`)
+    for (const { entry } of index_entries) rows.push(`    ${entry}`)
+    rows.push(`};`)
+    rows.push('')
     rows.push(`void ${setup_function_name}() {`)
-    for (let i = 0; i < definition_linking.length; i++) rows.push(definition_linking[i])
+    rows.push(`    REST_SERVE_ASSETS(__files, ${index_entries.length});`)
     rows.push(`}`)
     rows.push(``)
     rows.push(`#endif // __www_output_h__`)
@@ -266,6 +377,12 @@ const main = async () => {
     const output = rows.join("\n")
     fs.writeFileSync(output_file, output)
 
+    if (bundle_file) {
+        const bundle = buildBundle(bundle_files)
+        await saveFile(bundle_file, bundle)
+        console.log(`Flash asset bundle written to "${bundle_file}" [${bundle.length} bytes]`)
+    }
+
     console.log(`Source files generated in "include/src_files.h" and to be initialized with '${setup_function_name}()'`)
     console.log(`Expected flash usage of the source files: [${total_size} bytes]`)
     console.log(`-------------------------------------------------------------------------------`)
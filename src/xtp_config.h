@@ -7,9 +7,11 @@
 #include "mcu_tools.h"
 #include "iec_time.h"
 
+#ifndef STM32_UID_ADDRESS
 // #define STM32_UID_ADDRESS  0x1FFFF7E8    // STM32F1
 #define STM32_UID_ADDRESS  0x1FFF7A10    // STM32F4
 // #define STM32_UID_ADDRESS  DBGMCU_BASE  // STM32 universal ???
+#endif // STM32_UID_ADDRESS
 
 #ifndef OTA_STORAGE_STM32_SECTOR
 #define OTA_STORAGE_STM32_SECTOR 6
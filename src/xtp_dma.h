@@ -50,8 +50,8 @@ static inline void ___XTP_dma_common_init() {
     __HAL_RCC_ADC1_CLK_ENABLE();
 
     DMA2_Stream0->CR = 0;
-    DMA2_Stream0->PAR  = (uint32_t)&ADC1->DR;
-    DMA2_Stream0->M0AR = (uint32_t)xtpAdcBuf;
+    DMA2_Stream0->PAR  = (uint32_t)(uintptr_t)&ADC1->DR;
+    DMA2_Stream0->M0AR = (uint32_t)(uintptr_t)xtpAdcBuf;
     DMA2_Stream0->NDTR = XTP_ADC_N_CH;
     DMA2_Stream0->CR  |= (0 << 25) |                 // CHSEL = 0
                          (1 << 11) | (1 << 13) |     // PSIZE & MSIZE = 16-bit
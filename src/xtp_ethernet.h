@@ -67,6 +67,7 @@ struct EthernetStateMachine {
     uint32_t lastDhcpRetry = 0;        // Timestamp of last DHCP retry attempt
     uint8_t retryCount = 0;
     uint8_t initCycle = 0;
+    void (*onStateChange)() = nullptr;  // Called after every state change (the HTTP server chains any hook set before its setup)
     
     // Timing constants (in milliseconds)
     static constexpr uint32_t HARD_RESET_LOW_TIME = 5;
@@ -88,6 +89,7 @@ struct EthernetStateMachine {
             previousState = state;
             state = newState;
             stateEnteredAt = millis();
+            if (onStateChange) onStateChange();
         }
     }
     
@@ -16,6 +16,53 @@ uint8_t _flash_retain_image[RETAINED_DATA_SIZE];
 void _flash_write(bool force = false);
 void _flash_read();
 
+#ifdef XTP_FLASH_ASSETS
+// Web asset bundle in the SPI flash, built by `web-compile.js --bundle` and uploaded with POST /api/assets.
+// Layout: FlashAssetsHeader, `count` FlashAssetEntry records sorted by name hash, then the file data.
+// There are two slots: an upload goes to the one not being served, and its header is programmed last,
+// after the CRC of everything else checked out. Only then is the old bundle's header cleared, so the
+// old bundle is served until the new one is complete, and an interrupted upload changes nothing.
+#ifndef FLASH_ASSETS_ADDRESS
+#define FLASH_ASSETS_ADDRESS 0x10000 // Sector aligned, clear of the retained data
+#endif // FLASH_ASSETS_ADDRESS
+#ifndef FLASH_ASSETS_SIZE
+#define FLASH_ASSETS_SIZE 0x70000 // 448 KB per slot, the second one follows the first
+#endif // FLASH_ASSETS_SIZE
+#define FLASH_SECTOR_SIZE 4096
+#define FLASH_ASSETS_MAGIC 0x41505458 // "XTPA"
+#define FLASH_ASSETS_VERSION 1
+#define FLASH_ASSET_GZIP 0x01
+
+struct FlashAssetsHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+    uint32_t size;      // Whole bundle, header included
+    uint32_t crc;       // CRC-32 of everything after the header
+};
+
+struct FlashAssetEntry {
+    uint32_t hash;      // FNV-1a of the name, as RestServer::hashUri()
+    uint32_t offset;    // File data, from the start of the bundle
+    uint32_t length;
+    uint8_t flags;
+    uint8_t reserved[3];
+    char etag[20];      // Quoted content hash
+    char name[60];
+};
+
+uint16_t flash_assets_count = 0;  // Files in the stored bundle, 0 = none
+uint32_t flash_assets_size = 0;
+uint32_t flash_assets_address = FLASH_ASSETS_ADDRESS; // Slot of the stored bundle
+bool flash_assets_available = false; // Both slots fit the chip - checked by flash_assets_load()
+
+// Set by the HTTP server: is a response still streaming from flash in [from, to). An upload does not
+// erase the slot it goes to while one is - that is the previous bundle, still being read by address.
+bool (*flash_assets_in_use)(uint32_t from, uint32_t to) = nullptr;
+
+void flash_assets_load();
+#endif // XTP_FLASH_ASSETS
+
 bool flash_initialized = false;
 void flash_setup() {
     if (flash_initialized) return;
@@ -33,6 +80,9 @@ void flash_setup() {
     _flash_read();
     uint32_t elapsed = micros() - t;
     Serial.printf("FLASH retained data [%d] read in %d us\n", RETAINED_DATA_SIZE, elapsed);
+#ifdef XTP_FLASH_ASSETS
+    flash_assets_load();
+#endif // XTP_FLASH_ASSETS
     if (retainedData.reboot_count == -1) {
         Serial.println("FLASH retained data not found. Writing default data");
         memcpy(&retainedData, &retainedDataDefault, RETAINED_DATA_SIZE);
@@ -135,3 +185,201 @@ void _flash_read() {
     flash.readByteArray(RETAINED_DATA_FLASH_ADDRESS, _flash_retain_image, RETAINED_DATA_SIZE);
     memcpy(&retainedData, _flash_retain_image, RETAINED_DATA_SIZE);
 }
+
+#ifdef XTP_FLASH_ASSETS
+uint32_t flash_crc32(uint32_t crc, const uint8_t* data, int length) {
+    crc = ~crc;
+    for (int i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+// CRC-32 of a stored bundle after its header, read back in pieces
+bool _flash_assets_verify(uint32_t address, const FlashAssetsHeader& header) {
+    uint8_t buffer[256];
+    uint32_t crc = 0;
+    for (uint32_t position = sizeof(header); position < header.size; position += sizeof(buffer)) {
+        uint32_t length = min((uint32_t) sizeof(buffer), header.size - position);
+        if (!flash.readByteArray(address + position, buffer, length)) return false;
+        crc = flash_crc32(crc, buffer, length);
+    }
+    return crc == header.crc;
+}
+
+// Serve whichever slot holds a valid bundle. Both only do when power was lost between programming the
+// new header and clearing the old one - either bundle is complete then. The whole bundle is read back
+// against its CRC (a fraction of a second for a full slot), so bits lost in the chip are not served.
+void flash_assets_load() {
+    flash_assets_count = 0;
+    flash_assets_size = 0;
+    flash_assets_available = FLASH_ASSETS_ADDRESS + 2 * FLASH_ASSETS_SIZE <= (uint32_t) flashInfo.size;
+    if (!flash_assets_available) {
+        Serial.printf("FLASH web assets disabled: the slots need %lu bytes, the chip has %lu\n", (unsigned long) (FLASH_ASSETS_ADDRESS + 2 * FLASH_ASSETS_SIZE), (unsigned long) flashInfo.size);
+        return;
+    }
+    for (int slot = 0; slot < 2; slot++) {
+        FlashAssetsHeader header;
+        uint32_t address = FLASH_ASSETS_ADDRESS + slot * FLASH_ASSETS_SIZE;
+        flash.readByteArray(address, (uint8_t*) &header, sizeof(header));
+        if (header.magic != FLASH_ASSETS_MAGIC || header.version != FLASH_ASSETS_VERSION) continue;
+        if (header.size < sizeof(header) || header.size > FLASH_ASSETS_SIZE || sizeof(header) + header.count * sizeof(FlashAssetEntry) > header.size) continue;
+        if (!_flash_assets_verify(address, header)) {
+            Serial.printf("FLASH web assets in slot %d fail their CRC check\n", slot);
+            continue;
+        }
+        flash_assets_count = header.count;
+        flash_assets_size = header.size;
+        flash_assets_address = address;
+        Serial.printf("FLASH web assets: %d files, %lu bytes\n", flash_assets_count, flash_assets_size);
+        return;
+    }
+}
+
+// Read from the asset slots at an absolute flash address (a RestServer::BodyReader). Responses stream
+// by address, so one that started before a new bundle was committed finishes with the old files.
+// Called from the HTTP server, which runs with the W5500 selected.
+int flash_assets_read_at(uint32_t address, uint8_t* buffer, int length) {
+    if (address < FLASH_ASSETS_ADDRESS || address >= FLASH_ASSETS_ADDRESS + 2 * FLASH_ASSETS_SIZE) return 0;
+    length = min((uint32_t) length, FLASH_ASSETS_ADDRESS + 2 * FLASH_ASSETS_SIZE - address);
+    spi_select(SPI_Flash);
+    bool ok = flash.readByteArray(address, buffer, length);
+    spi_select(SPI_Ethernet);
+    return ok ? length : -1;
+}
+
+// Read bytes of the stored bundle
+int flash_assets_read(uint32_t position, uint8_t* buffer, int length) {
+    if (position >= flash_assets_size) return 0;
+    return flash_assets_read_at(flash_assets_address + position, buffer, min((uint32_t) length, flash_assets_size - position));
+}
+
+// Binary search of the stored index for an exact name
+bool flash_assets_find(const char* name, uint32_t hash, FlashAssetEntry& entry) {
+    int low = 0;
+    int high = flash_assets_count;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        uint32_t mid_hash;
+        if (flash_assets_read(sizeof(FlashAssetsHeader) + mid * sizeof(FlashAssetEntry), (uint8_t*) &mid_hash, sizeof(mid_hash)) != sizeof(mid_hash)) return false;
+        if (mid_hash < hash) low = mid + 1;
+        else high = mid;
+    }
+    for (; low < flash_assets_count; low++) {
+        if (flash_assets_read(sizeof(FlashAssetsHeader) + low * sizeof(FlashAssetEntry), (uint8_t*) &entry, sizeof(entry)) != sizeof(entry)) return false;
+        if (entry.hash != hash) return false;
+        entry.name[sizeof(entry.name) - 1] = '\0';
+        entry.etag[sizeof(entry.etag) - 1] = '\0';
+        if (strcmp(entry.name, name) == 0) return entry.offset + entry.length <= flash_assets_size;
+    }
+    return false;
+}
+
+// Sector erase without waiting for it. SPIMemory waits out every erase (tens of ms per sector), so
+// uploads start one themselves and poll the busy bit from later loops. Only the three commands every
+// 3-byte-address SPI NOR chip shares are used: write enable (0x06), 4 KB sector erase (0x20) and read
+// status register 1 (0x05). SPIMemory polls the same busy bit before each of its own commands, so its
+// reads and writes wait for an erase started here. Chips over 16 MB may be run in 4-byte address mode
+// by the driver - those are erased through it, blocking. Called with the flash selected.
+bool _flash_raw_erase() { return (uint32_t) flashInfo.size <= 0x1000000; }
+
+void _flash_command(const uint8_t* command, int length) {
+    digitalWrite(FLASH_CS_pin, LOW);
+    for (int i = 0; i < length; i++) SPI.transfer(command[i]);
+    digitalWrite(FLASH_CS_pin, HIGH);
+}
+
+void _flash_erase_begin(uint32_t address) {
+    if (!_flash_raw_erase()) {
+        flash.eraseSector(address);
+        return;
+    }
+    uint8_t write_enable = 0x06;
+    uint8_t sector_erase[4] = { 0x20, (uint8_t) (address >> 16), (uint8_t) (address >> 8), (uint8_t) address };
+    _flash_command(&write_enable, 1);
+    _flash_command(sector_erase, sizeof(sector_erase));
+}
+
+bool _flash_busy() {
+    if (!_flash_raw_erase()) return false;
+    digitalWrite(FLASH_CS_pin, LOW);
+    SPI.transfer(0x05);
+    bool busy = SPI.transfer(0) & 0x01;
+    digitalWrite(FLASH_CS_pin, HIGH);
+    return busy;
+}
+
+// Bundle upload in progress: the header is held back until flash_assets_commit()
+FlashAssetsHeader _flash_upload_header;
+uint32_t _flash_upload_address = 0;  // Slot the upload goes to
+uint32_t _flash_upload_crc = 0;
+uint32_t _flash_upload_erased = 0;   // Bytes of the slot erased so far
+uint32_t _flash_erasing = 0;         // Sector with an erase in flight, 0 = none (the slots never start at 0)
+bool _flash_upload_failed = false;
+
+// False while a sector erase is still running - the chip takes no other command until it is done
+bool _flash_upload_idle() {
+    if (_flash_erasing == 0) return true;
+    if (_flash_busy()) return false;
+    if (_flash_erasing == _flash_upload_address + _flash_upload_erased) _flash_upload_erased += FLASH_SECTOR_SIZE;
+    _flash_erasing = 0;
+    return true;
+}
+
+// Store one piece of an uploaded bundle (a RestServer::BodyHandler) in the slot not being served.
+// Sectors are erased as the upload reaches them; bytes past the erased ones are left for a later loop.
+int flash_assets_upload(const uint8_t* data, int length, uint32_t offset, uint32_t total) {
+    int taken = 0;
+    if (offset == 0) {
+        _flash_upload_address = flash_assets_address == FLASH_ASSETS_ADDRESS ? FLASH_ASSETS_ADDRESS + FLASH_ASSETS_SIZE : FLASH_ASSETS_ADDRESS;
+        _flash_upload_crc = 0;
+        _flash_upload_erased = 0;
+        _flash_upload_failed = !flash_assets_available || total < sizeof(FlashAssetsHeader) || total > FLASH_ASSETS_SIZE;
+        memset(&_flash_upload_header, 0, sizeof(_flash_upload_header));
+    }
+    if (_flash_upload_failed) return length;
+    // Header bytes stay in RAM
+    while (taken < length && offset < sizeof(FlashAssetsHeader)) {
+        ((uint8_t*) &_flash_upload_header)[offset++] = data[taken++];
+    }
+    if (taken == length) return taken;
+    spi_select(SPI_Flash);
+    if (_flash_upload_idle()) {
+        int n = offset < _flash_upload_erased ? min((uint32_t) (length - taken), _flash_upload_erased - offset) : 0;
+        if (n > 0) {
+            _flash_upload_crc = flash_crc32(_flash_upload_crc, data + taken, n);
+            if (!flash.writeByteArray(_flash_upload_address + offset, (uint8_t*) data + taken, n)) _flash_upload_failed = true;
+            taken += n;
+        }
+        // Start on the sector the rest goes to, unless a response still reads the slot
+        if (taken < length && !(flash_assets_in_use && flash_assets_in_use(_flash_upload_address, _flash_upload_address + FLASH_ASSETS_SIZE))) {
+            _flash_erasing = _flash_upload_address + _flash_upload_erased;
+            _flash_erase_begin(_flash_erasing);
+        }
+    }
+    spi_select(SPI_Ethernet);
+    return taken;
+}
+
+// Validate a completed upload, program its header and retire the old bundle, making the new one active
+bool flash_assets_commit(uint32_t total) {
+    FlashAssetsHeader& header = _flash_upload_header;
+    if (_flash_upload_failed || total < sizeof(FlashAssetsHeader)) return false;
+    if (header.magic != FLASH_ASSETS_MAGIC || header.version != FLASH_ASSETS_VERSION || header.size != total) return false;
+    if (header.crc != _flash_upload_crc) return false;
+    if (sizeof(FlashAssetsHeader) + header.count * sizeof(FlashAssetEntry) > total) return false;
+    spi_select(SPI_Flash);
+    bool ok = flash.writeByteArray(_flash_upload_address, (uint8_t*) &header, sizeof(header));
+    // Programming can only clear bits - zeroing the old magic needs no erase
+    uint32_t retired = 0;
+    if (ok) flash.writeByteArray(flash_assets_address, (uint8_t*) &retired, sizeof(retired));
+    spi_select(SPI_Ethernet);
+    if (!ok) return false;
+    flash_assets_count = header.count;
+    flash_assets_size = header.size;
+    flash_assets_address = _flash_upload_address;
+    Serial.printf("FLASH web assets updated: %d files, %lu bytes\n", flash_assets_count, flash_assets_size);
+    return true;
+}
+#endif // XTP_FLASH_ASSETS
@@ -7,6 +7,10 @@ RestServer rest(server);
 MyFileSystem files; // Todo: add implementation
 
 #define REST_SERVE_FILE(name, data, length) files.addFile(name, data, length); rest.get(name, []() { files.handleGetFile(rest, name); });
+// Asset from web-compile.js: optionally gzip compressed, with a quoted content hash as its ETag
+#define REST_SERVE_ASSET(name, data, length, gzip, etag) files.addFile(name, data, length, gzip, etag); rest.get(name, []() { files.handleGetFile(rest, name); });
+// Asset index from web-compile.js: one catch-all route serves every file, other routes take precedence
+#define REST_SERVE_ASSETS(index, count) files.setIndex(index, count); rest.get("/*", http_serve_asset);
 
 char project_info[512] = { 0 };
 char rest_response_basic[512] = "";
@@ -35,14 +39,153 @@ void (*rest_setup)() = nullptr;
  *      serializeJson(json_buffer, rest_response_basic);
  *      rest.send(200, "application/json", rest_response_basic);
  *  });
+ *  // One handler for every output channel: GET /api/out/3?state=1
+ *  rest.get("/api/out/:ch", []() {
+ *      long ch = rest.pathParam("ch").toInt(-1);
+ *      bool state = rest.queryParam("state").equals("1");
+ *      ...
+ *  });
+ *  // A last segment of `*` matches the rest of the path (e.g. everything below /static/),
+ *  // which the handler reads as rest.pathParam("*")
+ *  // Proxy to a downstream device without blocking the loop: defer() parks the request and the
+ *  // poll function answers it once the reply is in (504 Gateway Timeout after 2 s)
+ *  rest.get("/api/remote", []() {
+ *      int8_t id = tcp.send(IPAddress(192, 168, 1, 50), 3000, "STATUS\n", 7);
+ *      rest.defer([](void* context) {
+ *          int8_t id = (int8_t) (intptr_t) context;
+ *          if (tcp.txState(id) != XtpTcpClient::TX_DONE_OK) return false;
+ *          rest.send(200, "text/plain", "ok");
+ *          return true;
+ *      }, (void*) (intptr_t) id, 2000);
+ *  });
+ *  // Push updates to dashboards instead of having them poll: `new EventSource("/api/events")` in the browser
+ *  rest.get("/api/events", []() { rest.beginEvents(); });
+ *  ...
+ *  rest.broadcastEvent(rest_response_basic, "status"); // From the loop, whenever the data changes
 **/
 
 bool xtp_rest_routing_initialized = false;
 
 // Buffers for JSON responses
-char socket_status_json[512] = "";
+#ifdef XTP_FLASH_ASSETS
+// Serve a file of the bundle in SPI flash, streamed page by page as the socket takes it
+bool http_serve_flash_asset(const char* path) {
+    FlashAssetEntry entry;
+    if (!flash_assets_find(path, RestServer::hashUri(path), entry)) return false;
+    char headers[128];
+    if (MyFileSystem::assetHeaders(rest, entry.etag, entry.flags & FLASH_ASSET_GZIP, headers, sizeof(headers))) return true;
+    rest.sendStream(200, file_content_type(entry.name), flash_assets_read_at, flash_assets_address + entry.offset, entry.length, headers);
+    return true;
+}
+#endif // XTP_FLASH_ASSETS
+
+// Catch-all route for web assets: an uploaded bundle in SPI flash takes precedence over compiled-in files
+void http_serve_asset() {
+#ifdef XTP_FLASH_ASSETS
+    if (flash_assets_count > 0) {
+        if (http_serve_flash_asset(rest.path())) return;
+        const char* alt_path = rest.getMap(rest.path());
+        if (alt_path != nullptr && http_serve_flash_asset(alt_path)) return;
+    }
+#endif // XTP_FLASH_ASSETS
+    files.handleGetPath(rest);
+}
+
 char eth_status_buffer[384] = "";
 char oled_status_buffer[256] = "";
+char i2c_status_buffer[512] = "";
+char socket_status_json[512] = ""; // Last /api/socket-status body, as before it was cached
+
+void socket_status_render(char* buffer, size_t bufferSize) {
+    uint32_t success, failed, restarts, limited, shed;
+    rest.getStats(success, failed, restarts);
+    rest.getAdmissionStats(limited, shed);
+    int length = snprintf(buffer, bufferSize,
+        "{\"requests\":{\"success\":%lu,\"failed\":%lu,\"limited\":%lu,\"shed\":%lu},\"server_restarts\":%lu,\"connections\":%d,\"sockets\":[",
+        (unsigned long) success, (unsigned long) failed, (unsigned long) limited, (unsigned long) shed, (unsigned long) restarts, rest.activeConnections());
+    for (uint8_t sock = 0; sock < 8 && length < (int) bufferSize; sock++) {
+        length += snprintf(buffer + length, bufferSize - length,
+            "%s{\"id\":%d,\"status\":\"%s\",\"port\":%d}",
+            sock > 0 ? "," : "",
+            sock, rest.getSocketStatusName(cyclic_sock_status(sock)), cyclic_sock_port(sock));
+    }
+    if (length < (int) bufferSize) snprintf(buffer + length, bufferSize - length, "]}");
+}
+
+// Status endpoints that pollers hit many times a second are served from pre-rendered JSON,
+// re-rendered at most once per TTL or after http_cache_invalidate() (hit/miss counts at /api/cache)
+#ifndef HTTP_STATUS_CACHE_TTL_MS
+#define HTTP_STATUS_CACHE_TTL_MS 250
+#endif
+#ifndef HTTP_NETWORK_STATUS_CACHE_TTL_MS
+#define HTTP_NETWORK_STATUS_CACHE_TTL_MS 2000 // Also invalidated on every ethernet state change
+#endif
+
+struct HttpCachedResponse {
+    const char* uri;
+    uint32_t ttl_ms;
+    void (*render)(char* buffer, size_t size);
+    char* buffer;
+    size_t size;
+    int length;           // -1 until rendered, or after invalidation
+    uint32_t rendered_ms;
+    uint32_t hits;
+    uint32_t misses;
+};
+
+enum HttpCacheId { HTTP_CACHE_NETWORK_STATUS, HTTP_CACHE_SOCKET_STATUS, HTTP_CACHE_I2C_STATUS, HTTP_CACHE_OLED_STATUS, HTTP_CACHE_COUNT };
+
+HttpCachedResponse http_cache[HTTP_CACHE_COUNT] = {
+    { "/api/network-status", HTTP_NETWORK_STATUS_CACHE_TTL_MS, ethernet_status_json, eth_status_buffer, sizeof(eth_status_buffer), -1, 0, 0, 0 },
+    { "/api/socket-status", HTTP_STATUS_CACHE_TTL_MS, socket_status_render, socket_status_json, sizeof(socket_status_json), -1, 0, 0, 0 },
+    { "/api/i2c-status", HTTP_STATUS_CACHE_TTL_MS, i2c_status_json, i2c_status_buffer, sizeof(i2c_status_buffer), -1, 0, 0, 0 },
+    { "/api/oled-status", HTTP_STATUS_CACHE_TTL_MS, oled_status_json, oled_status_buffer, sizeof(oled_status_buffer), -1, 0, 0, 0 },
+};
+
+void http_cache_invalidate(HttpCacheId id) { http_cache[id].length = -1; }
+
+void http_cache_send(HttpCacheId id) {
+    HttpCachedResponse& entry = http_cache[id];
+    uint32_t t = millis();
+    if (entry.length >= 0 && t - entry.rendered_ms < entry.ttl_ms) {
+        entry.hits++;
+    } else {
+        entry.misses++;
+        entry.render(entry.buffer, entry.size);
+        entry.length = strlen(entry.buffer);
+        entry.rendered_ms = t;
+    }
+    rest.send(200, "application/json", entry.buffer, entry.length);
+}
+
+// Requests per /api/batch call, the rest are left out of the answer
+#ifndef HTTP_BATCH_MAX_PATHS
+#define HTTP_BATCH_MAX_PATHS 16
+#endif
+
+// Several GET routes in one round trip: `?paths=/a,/b` or a POSTed JSON array (or one path per line).
+// Every handler runs in-process and its response lands in one chunked JSON array, in request order -
+// a route at a time as the client takes them, so each answer only has to fit the TX queue.
+void http_batch() {
+    rest.beginChunked(200, "application/json");
+    rest.writeChunk("[");
+    rest.continueChunked([](uint32_t& offset, uint32_t& count) {
+        HttpView paths = rest.queryParam("paths");
+        const char* list = rest.method() == HTTP_GET ? paths.data : rest.body;
+        int length = rest.method() == HTTP_GET ? paths.length : rest.body_length;
+        int i = offset;
+        while (list != nullptr && i < length && strchr("[]\", \t\r\n", list[i]) != nullptr) i++;
+        if (list == nullptr || i >= length || count >= HTTP_BATCH_MAX_PATHS) {
+            rest.writeChunk("]");
+            return false;
+        }
+        int start = i;
+        while (i < length && strchr("[]\", \t\r\n", list[i]) == nullptr) i++;
+        rest.captureRoute(&list[start], i - start, count++ == 0);
+        offset = i;
+        return true;
+    });
+}
 
 void xtp_rest_routing() {
     if (xtp_rest_routing_initialized) return;
@@ -51,68 +194,132 @@ void xtp_rest_routing() {
     // Remap root to index.html
     rest.remap("/", "/index.html");
 
+#ifdef HTTP_CORS_ORIGIN
+    // Dashboards served from another origin (e.g. "*" or "http://192.168.1.10:8080")
+    rest.enableCors(HTTP_CORS_ORIGIN);
+#endif
+
     // Simple ping/pong
     rest.get("/ping", []() { rest.send(200, "text/plain", "pong"); });
     
     // Ethernet state machine status endpoint
-    rest.get("/api/network-status", []() {
-        ethernet_status_json(eth_status_buffer, sizeof(eth_status_buffer));
-        rest.send(200, "application/json", eth_status_buffer);
-    });
+    rest.get("/api/network-status", []() { http_cache_send(HTTP_CACHE_NETWORK_STATUS); });
+    // Chained, so a hook the application set before this still runs
+    static void (*app_state_change)() = ethState.onStateChange;
+    ethState.onStateChange = []() {
+        http_cache_invalidate(HTTP_CACHE_NETWORK_STATUS);
+        if (app_state_change) app_state_change();
+    };
     
     // OLED status endpoint
-    rest.get("/api/oled-status", []() {
-        oled_status_json(oled_status_buffer, sizeof(oled_status_buffer));
-        rest.send(200, "application/json", oled_status_buffer);
-    });
+    rest.get("/api/oled-status", []() { http_cache_send(HTTP_CACHE_OLED_STATUS); });
     
     // Diagnostic endpoint for socket status monitoring
-    rest.get("/api/socket-status", []() {
-        uint32_t success, failed, restarts;
-        rest.getStats(success, failed, restarts);
-        
-        int offset = sprintf(socket_status_json, 
-            "{\"requests\":{\"success\":%lu,\"failed\":%lu},\"server_restarts\":%lu,\"sockets\":[",
-            success, failed, restarts);
-        
-        for (uint8_t sock = 0; sock < 8; sock++) {
-            uint8_t status = cyclic_sock_status(sock);
-            uint16_t port = cyclic_sock_port(sock);
-            offset += sprintf(socket_status_json + offset, 
-                "%s{\"id\":%d,\"status\":\"%s\",\"port\":%d}",
-                sock > 0 ? "," : "",
-                sock, rest.getSocketStatusName(status), port);
-        }
-        sprintf(socket_status_json + offset, "]}");
-        
-        rest.send(200, "application/json", socket_status_json);
-    });
+    rest.get("/api/socket-status", []() { http_cache_send(HTTP_CACHE_SOCKET_STATUS); });
     
     // I2C bus status endpoint
-    rest.get("/api/i2c-status", []() {
-        static char i2c_status_buffer[512];
-        i2c_status_json(i2c_status_buffer, sizeof(i2c_status_buffer));
-        rest.send(200, "application/json", i2c_status_buffer);
+    rest.get("/api/i2c-status", []() { http_cache_send(HTTP_CACHE_I2C_STATUS); });
+
+    // Several GET routes in one response, for dashboards that poll a handful of endpoints
+    rest.get("/api/batch", http_batch);
+    rest.post("/api/batch", http_batch);
+
+    // Status cache statistics, for tuning the TTLs
+    rest.get("/api/cache", []() {
+        rest.beginChunked(200, "application/json");
+        for (int i = 0; i < HTTP_CACHE_COUNT; i++) {
+            HttpCachedResponse& entry = http_cache[i];
+            rest.printfChunk("%s{\"uri\":\"%s\",\"ttl_ms\":%lu,\"hits\":%lu,\"misses\":%lu}",
+                i > 0 ? "," : "[", entry.uri, entry.ttl_ms, entry.hits, entry.misses);
+        }
+        rest.writeChunk("]");
+        rest.endChunked();
+    });
+
+    // Recent requests from the access log ring, oldest first - `?since=<next>` skips the ones already seen
+    rest.get("/api/access-log", []() {
+        rest.beginChunked(200, "application/json");
+        rest.writeChunk("{\"entries\":[");
+        rest.continueChunked([](uint32_t& n, uint32_t& entries) {
+            char entry[200];
+            n = max(n, rest._access_log.oldest()); // Records overwritten in the meantime are gone
+            for (int i = 0; i < 4 && n < rest._access_log.written; i++, n++) {
+                rest.accessLogJson(n, entry, sizeof(entry), entries++ == 0);
+                rest.writeChunk(entry);
+            }
+            if (n < rest._access_log.written) return true;
+            rest.printfChunk("],\"next\":%lu}", n);
+            return false;
+        }, rest.queryParam("since").toInt(0));
     });
     
 #ifdef XTP_TIMING_TELEMETRY
     // Timing telemetry endpoint (only when telemetry is enabled)
     rest.get("/api/timing", []() {
-        static char timing_buffer[2048];
-        xtp_timing_json(timing_buffer, sizeof(timing_buffer));
-        rest.send(200, "application/json", timing_buffer);
+        rest.beginChunked(200, "application/json");
+        rest.printfChunk("{\"uptime_s\":%lu,\"sections\":{", xtp_timing_uptime_s());
+        rest.continueChunked([](uint32_t& i, uint32_t& sections) {
+            char section[160];
+            for (int n = 0; n < 4 && i < XTP_TIME_COUNT; i++) {
+                if (xtp_timing_section_json(i, section, sizeof(section), sections == 0) == 0) continue;
+                rest.writeChunk(section);
+                sections++;
+                n++;
+            }
+            if (i < XTP_TIME_COUNT) return true;
+            rest.writeChunk("}}");
+            return false;
+        });
+    });
+    
+    // Per-route counters and log2 latency histograms (bucket i: 2^i..2^(i+1) us) - finds the handler behind loop spikes
+    rest.get("/api/timing/routes", []() {
+        rest.beginChunked(200, "application/json");
+        rest.writeChunk("{\"routes\":[");
+        rest.continueChunked([](uint32_t& i, uint32_t& routes) {
+            char route[512];
+            // One route per call - a route's entry alone can take half the TX queue
+            while (i <= HTTP_MAX_ENDPOINTS && rest.routeStatsJson(i, route, sizeof(route), routes == 0) == 0) i++;
+            if (i > HTTP_MAX_ENDPOINTS) {
+                rest.writeChunk("]}");
+                return false;
+            }
+            rest.writeChunk(route);
+            routes++;
+            i++;
+            return true;
+        });
     });
     
     // Reset timing stats
     rest.post("/api/timing/reset", []() {
         xtp_timing_reset();
+        rest.routeStatsReset();
         rest.send(200, "application/json", "{\"status\":\"reset\"}");
     });
 #endif
 
+#ifdef XTP_FLASH_ASSETS
+    // Replace the web asset bundle in SPI flash (`web-compile.js --bundle` output), no firmware update needed
+    rest.post("/api/assets", []() {
+        char response[80];
+        if (!flash_assets_commit(rest.contentLength())) {
+            rest.send(400, "application/json", "{\"error\":\"invalid asset bundle\"}");
+            return;
+        }
+        snprintf(response, sizeof(response), "{\"files\":%d,\"size\":%lu}", flash_assets_count, (unsigned long) flash_assets_size);
+        rest.send(200, "application/json", response);
+    }, flash_assets_upload);
+    flash_assets_in_use = [](uint32_t from, uint32_t to) { return rest.streaming(flash_assets_read_at, from, to); };
+#endif // XTP_FLASH_ASSETS
+
     // User provided setup function
     if (rest_setup != nullptr) rest_setup();
 
+#ifdef XTP_FLASH_ASSETS
+    rest.get("/*", http_serve_asset); // Same route as REST_SERVE_ASSETS, whichever comes first
+#endif // XTP_FLASH_ASSETS
+
     rest.onNotFound([]() { rest.send(404, "text/plain", "Ta stran ne obstaja!"); });
 }
 
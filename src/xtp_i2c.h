@@ -684,8 +684,8 @@ void i2c_status_json(char* buffer, size_t bufferSize) {
         "{\"initialized\":%s,\"busError\":%s,\"errorCount\":%lu,\"transactions\":%lu,\"devices\":[",
         i2cBus.initialized ? "true" : "false",
         i2cBus.busError ? "true" : "false",
-        i2cBus.busErrorCount,
-        i2cBus.totalTransactions);
+        (unsigned long) i2cBus.busErrorCount,
+        (unsigned long) i2cBus.totalTransactions);
     
     for (uint8_t i = 0; i < i2cBus.deviceCount && offset < (int)bufferSize - 50; i++) {
         I2CDevice* dev = &i2cBus.devices[i];
@@ -703,7 +703,7 @@ void i2c_status_json(char* buffer, size_t bufferSize) {
             dev->address,
             dev->name ? dev->name : "?",
             stateStr,
-            dev->errorCount);
+            (unsigned long) dev->errorCount);
     }
     
     snprintf(buffer + offset, bufferSize - offset, "]}");
@@ -575,8 +575,8 @@ void oled_status_json(char* buffer, size_t bufferSize) {
         oledState.getStateName(),
         oledState.present ? "true" : "false",
         oledState.isReady() ? "true" : "false",
-        oledState.errorCount,
-        oledState.reconnectCount,
-        oledState.slowWriteCount
+        (unsigned long) oledState.errorCount,
+        (unsigned long) oledState.reconnectCount,
+        (unsigned long) oledState.slowWriteCount
     );
 }
\ No newline at end of file
@@ -846,9 +846,9 @@ void xtp_ssd1306_status_json(char* buffer, size_t size) {
         "{\"initialized\":%s,\"present\":%s,\"writes\":%lu,\"errors\":%lu,\"lastWriteUs\":%lu}",
         xtp_oled.initialized ? "true" : "false",
         xtp_ssd1306_isPresent() ? "true" : "false",
-        xtp_oled.writeCount,
-        xtp_oled.errorCount,
-        xtp_oled.lastWriteTime
+        (unsigned long) xtp_oled.writeCount,
+        (unsigned long) xtp_oled.errorCount,
+        (unsigned long) xtp_oled.lastWriteTime
     );
 }
 
@@ -10,6 +10,7 @@
  * - Tracks min/max/avg/count for each timed section
  * - Low overhead when disabled (compiles to nothing)
  * - JSON endpoint at /api/timing
+ * - Per-route counters and latency histograms at /api/timing/routes
  * - Reset via /api/timing/reset
  * 
  * Usage:
@@ -100,6 +101,36 @@ struct XtpTimingStats {
     }
 };
 
+// Log2 latency histogram: bucket i counts samples of [2^i, 2^(i+1)) us (bucket 0 also 0 us),
+// the last one everything from 2^(XTP_HISTOGRAM_BUCKETS-1) us (~16 ms) up. Counters saturate.
+#ifndef XTP_HISTOGRAM_BUCKETS
+#define XTP_HISTOGRAM_BUCKETS 16
+#endif
+
+struct XtpHistogram {
+    uint16_t buckets[XTP_HISTOGRAM_BUCKETS] = {0};
+
+    void record(uint32_t us) {
+        int i = us > 0 ? 31 - __builtin_clz(us) : 0;
+        if (i >= XTP_HISTOGRAM_BUCKETS) i = XTP_HISTOGRAM_BUCKETS - 1;
+        if (buckets[i] < UINT16_MAX) buckets[i]++;
+    }
+
+    void reset() {
+        memset(buckets, 0, sizeof(buckets));
+    }
+
+    // `[n0,n1,...]`, returns its length
+    int json(char* buffer, size_t bufferSize) const {
+        int offset = 0;
+        for (int i = 0; i < XTP_HISTOGRAM_BUCKETS && offset < (int) bufferSize; i++) {
+            offset += snprintf(buffer + offset, bufferSize - offset, "%c%u", i == 0 ? '[' : ',', buckets[i]);
+        }
+        if (offset < (int) bufferSize) offset += snprintf(buffer + offset, bufferSize - offset, "]");
+        return offset;
+    }
+};
+
 // ============================================================================
 // Global Timing Data
 // ============================================================================
@@ -153,28 +184,35 @@ inline const XtpTimingStats& xtp_timing_get(XtpTimingSection section) {
 }
 
 // Generate JSON output
-inline void xtp_timing_json(char* buffer, size_t bufferSize) {
+inline uint32_t xtp_timing_uptime_s() {
     xtp_timing_init();
-    
-    uint32_t uptime_s = (millis() - _xtp_timing_uptime_start) / 1000;
-    
+    return (millis() - _xtp_timing_uptime_start) / 1000;
+}
+
+// One `"name":{...}` entry of the sections object, returns its length (0 for sections with no data)
+inline int xtp_timing_section_json(int i, char* buffer, size_t bufferSize, bool first) {
+    const XtpTimingStats& s = _xtp_timing[i];
+    if (s.count == 0) return 0;  // Skip sections with no data
+    return snprintf(buffer, bufferSize,
+        "%s\"%s\":{\"cnt\":%lu,\"min\":%lu,\"max\":%lu,\"avg\":%lu,\"last\":%lu}",
+        first ? "" : ",",
+        XTP_TIMING_NAMES[i],
+        (unsigned long) s.count,
+        (unsigned long) (s.min_us == UINT32_MAX ? 0 : s.min_us),
+        (unsigned long) s.max_us,
+        (unsigned long) s.avg_us(),
+        (unsigned long) s.last_us);
+}
+
+inline void xtp_timing_json(char* buffer, size_t bufferSize) {
     int offset = snprintf(buffer, bufferSize,
-        "{\"uptime_s\":%lu,\"sections\":{", uptime_s);
+        "{\"uptime_s\":%lu,\"sections\":{", (unsigned long) xtp_timing_uptime_s());
     
     bool first = true;
     for (int i = 0; i < XTP_TIME_COUNT && offset < (int)bufferSize - 100; i++) {
-        const XtpTimingStats& s = _xtp_timing[i];
-        if (s.count == 0) continue;  // Skip sections with no data
-        
-        offset += snprintf(buffer + offset, bufferSize - offset,
-            "%s\"%s\":{\"cnt\":%lu,\"min\":%lu,\"max\":%lu,\"avg\":%lu,\"last\":%lu}",
-            first ? "" : ",",
-            XTP_TIMING_NAMES[i],
-            s.count,
-            s.min_us == UINT32_MAX ? 0 : s.min_us,
-            s.max_us,
-            s.avg_us(),
-            s.last_us);
+        int n = xtp_timing_section_json(i, buffer + offset, bufferSize - offset, first);
+        if (n == 0) continue;
+        offset += n;
         first = false;
     }
     
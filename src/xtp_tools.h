@@ -297,7 +297,7 @@ struct FlashInfo_t {
 // MCU_UID[0x0A] = (uid32val_2 >> 0x10) & 0xFF;
 // MCU_UID[0x0B] = (uid32val_2 >> 0x18) & 0xFF;
 
-uint8_t getIdPart(uint32_t id_ptr, uint32_t segment, uint8_t part) {
+uint8_t getIdPart(uintptr_t id_ptr, uint32_t segment, uint8_t part) {
     uint32_t id = *((uint32_t*) (id_ptr + (segment * 4)));
     return (id >> (part * 8)) & 0xFF;
 }
@@ -344,7 +344,7 @@ void hashBytes(const uint8_t* input, const int input_len, uint8_t* output, const
 
 
 void memset32(uint32_t* ptr, uint32_t value, size_t size_in_bytes) {
-    int remaining_bytes = size_in_bytes % 4;
+    size_t remaining_bytes = size_in_bytes % 4;
     size_t size_in_words = size_in_bytes / 4;
     for (size_t i = 0; i < size_in_words; i++) {
         ptr[i] = value;
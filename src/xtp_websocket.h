@@ -43,11 +43,32 @@
 #define WS_VAL_LEN 32
 #endif
 
+// Topics are interned into small IDs - one bit each in every client's subscription set (max 127)
+#ifndef WS_MAX_TOPICS
+#define WS_MAX_TOPICS 32
+#endif
+
+#ifndef WS_TOPIC_LEN
+#define WS_TOPIC_LEN 32
+#endif
+
+// Property keys the application registers for subscription filters (addPropKey()), interned the same way
+#ifndef WS_MAX_PROP_KEYS
+#define WS_MAX_PROP_KEYS 16
+#endif
+
+// Properties of one emitWithProps() event compiled to key IDs - any further ones are matched by name
+#ifndef WS_MAX_EVENT_PROPS
+#define WS_MAX_EVENT_PROPS 8
+#endif
+
+#define WS_TOPIC_WORDS ((WS_MAX_TOPICS + 31) / 32)
+
 #ifndef WS_RX_BUFFER_SIZE
 #define WS_RX_BUFFER_SIZE 256
 #endif
 
-// TX buffer for queued outgoing data (per client)
+// TX buffer for queued outgoing data (per client) - a power of two
 #ifndef WS_TX_BUFFER_SIZE
 #define WS_TX_BUFFER_SIZE 4096
 #endif
@@ -57,6 +78,21 @@
 #define WS_TX_CHUNK_SIZE 1024
 #endif
 
+// Broadcast frames are encoded once into a shared slot that every recipient's queue references.
+// Frames larger than a slot (header included), or sent while all slots are taken, are copied per client.
+#ifndef WS_SHARED_FRAMES
+#define WS_SHARED_FRAMES 8
+#endif
+
+#ifndef WS_SHARED_FRAME_SIZE
+#define WS_SHARED_FRAME_SIZE 256
+#endif
+
+// Frames (or runs of private bytes) queued per client
+#ifndef WS_TX_QUEUE_ENTRIES
+#define WS_TX_QUEUE_ENTRIES 16
+#endif
+
 // Line buffer for streaming header parsing (only needs to hold one header line)
 #ifndef WS_LINE_BUFFER_SIZE
 #define WS_LINE_BUFFER_SIZE 128
@@ -80,17 +116,47 @@ struct WsProperty {
     char value[WS_VAL_LEN];
 };
 
+// Interned topic, -1 = none (topic table full)
+typedef int8_t WsTopic;
+
+// FNV-1a - topic names and property values are compared by hash first
+inline uint32_t ws_hash(const char* str) {
+    uint32_t hash = 2166136261UL;
+    while (*str) hash = (hash ^ (uint8_t) *str++) * 16777619UL;
+    return hash;
+}
+
+// Set of topic IDs
+struct WsTopicSet {
+    uint32_t bits[WS_TOPIC_WORDS] = {};
+
+    void clear() { memset(bits, 0, sizeof(bits)); }
+    void set(WsTopic id) { bits[id >> 5] |= 1UL << (id & 31); }
+    bool has(WsTopic id) const { return id >= 0 && (bits[id >> 5] >> (id & 31)) & 1; }
+    void add(const WsTopicSet& other) {
+        for (int i = 0; i < WS_TOPIC_WORDS; i++) bits[i] |= other.bits[i];
+    }
+};
+
 struct WsSubscription {
-    char topic[32];
+    char topic[WS_TOPIC_LEN];          // As subscribed - may hold MQTT wildcards (`+` one level, `#` the rest)
+    WsTopicSet topics;                 // Registered topics the subscription matches
     WsProperty properties[WS_MAX_PROPS];
+    // Filter compiled from `properties`: registered key ID (-1 = compared by name) and value hash per property
+    int8_t propKeys[WS_MAX_PROPS];
+    uint32_t propHashes[WS_MAX_PROPS];
     uint8_t propCount = 0;
     
+    // Changes the filter - call WebSocketClient::refreshTopics() afterwards if already subscribed.
+    // The key ID is resolved by WebSocketServer::subscribe() (and addPropKey()).
     void addProp(const char* k, const char* v) {
         if (propCount < WS_MAX_PROPS) {
             strncpy(properties[propCount].key, k, WS_KEY_LEN - 1);
             properties[propCount].key[WS_KEY_LEN - 1] = 0;
             strncpy(properties[propCount].value, v, WS_VAL_LEN - 1);
             properties[propCount].value[WS_VAL_LEN - 1] = 0;
+            propKeys[propCount] = -1;
+            propHashes[propCount] = ws_hash(properties[propCount].value);
             propCount++;
         }
     }
@@ -98,6 +164,25 @@ struct WsSubscription {
     void clear() {
         propCount = 0;
         topic[0] = 0;
+        topics.clear();
+    }
+
+    // Every filter property present in the event with the same value. `keys`/`hashes` are compiled from
+    // the first `compiled` of the `count` event properties; the rest are looked up by name.
+    bool matchesProps(const WsProperty* props, const int8_t* keys, const uint32_t* hashes, uint8_t compiled, uint8_t count) const {
+        for (int p = 0; p < propCount; p++) {
+            int ep = 0;
+            if (propKeys[p] >= 0) {
+                while (ep < compiled && keys[ep] != propKeys[p]) ep++;
+                if (ep < compiled) {
+                    if (hashes[ep] != propHashes[p] || strcmp(props[ep].value, properties[p].value) != 0) return false;
+                    continue;
+                }
+            }
+            while (ep < count && strcmp(props[ep].key, properties[p].key) != 0) ep++;
+            if (ep == count || strcmp(props[ep].value, properties[p].value) != 0) return false;
+        }
+        return true;
     }
 };
 
@@ -105,6 +190,10 @@ struct WsSubscription {
 // Ring Buffer for TX Queue
 // ============================================================================
 
+static_assert((WS_TX_BUFFER_SIZE & (WS_TX_BUFFER_SIZE - 1)) == 0 && WS_TX_BUFFER_SIZE <= 32768, "WS_TX_BUFFER_SIZE must be a power of two up to 32768");
+
+// Positions run freely and are masked into the buffer, so the whole buffer is usable and copies
+// in and out are at most two memcpy()s (before and after the wrap)
 class WsTxBuffer {
 public:
     uint8_t buffer[WS_TX_BUFFER_SIZE];
@@ -116,12 +205,11 @@ public:
     }
     
     uint16_t available() const {
-        if (head >= tail) return head - tail;
-        return WS_TX_BUFFER_SIZE - tail + head;
+        return (uint16_t)(head - tail);
     }
     
     uint16_t freeSpace() const {
-        return WS_TX_BUFFER_SIZE - available() - 1;
+        return WS_TX_BUFFER_SIZE - available();
     }
     
     bool isEmpty() const {
@@ -130,30 +218,74 @@ public:
     
     bool write(const uint8_t* data, uint16_t len) {
         if (len > freeSpace()) return false; // Not enough space
-        
-        for (uint16_t i = 0; i < len; i++) {
-            buffer[head] = data[i];
-            head = (head + 1) % WS_TX_BUFFER_SIZE;
-        }
+        uint16_t pos = head & (WS_TX_BUFFER_SIZE - 1);
+        uint16_t first = min(len, (uint16_t)(WS_TX_BUFFER_SIZE - pos));
+        memcpy(&buffer[pos], data, first);
+        memcpy(buffer, data + first, len - first);
+        head += len;
         return true;
     }
     
+    // Queued bytes stored contiguously from the read position - the socket writes straight from here
+    const uint8_t* span(uint16_t& len) const {
+        uint16_t pos = tail & (WS_TX_BUFFER_SIZE - 1);
+        len = min(available(), (uint16_t)(WS_TX_BUFFER_SIZE - pos));
+        return &buffer[pos];
+    }
+    
+    void consume(uint16_t len) {
+        tail += min(len, available());
+    }
+    
     // Read up to 'len' bytes into 'dest', return actual count read
     uint16_t read(uint8_t* dest, uint16_t maxLen) {
         uint16_t count = 0;
-        while (count < maxLen && tail != head) {
-            dest[count++] = buffer[tail];
-            tail = (tail + 1) % WS_TX_BUFFER_SIZE;
+        while (count < maxLen && !isEmpty()) {
+            uint16_t len;
+            const uint8_t* data = span(len);
+            len = min(len, (uint16_t)(maxLen - count));
+            memcpy(dest + count, data, len);
+            consume(len);
+            count += len;
         }
         return count;
     }
     
     // Peek at data without removing (for debugging)
     uint8_t peek(uint16_t offset) const {
-        return buffer[(tail + offset) % WS_TX_BUFFER_SIZE];
+        return buffer[(tail + offset) & (WS_TX_BUFFER_SIZE - 1)];
     }
 };
 
+// Broadcast frame shared by the queues of all its recipients, free again once the last one has sent it
+struct WsSharedFrame {
+    uint8_t data[WS_SHARED_FRAME_SIZE];
+    uint16_t length = 0;
+    uint8_t refs = 0;
+};
+
+// Queued output of a client, in order: a shared frame, or `length` bytes of its own WsTxBuffer
+struct WsTxEntry {
+    WsSharedFrame* frame;
+    uint16_t length;
+};
+
+// Frame header for a payload of `length` bytes, returns the header length (0 if too large)
+inline uint8_t ws_frame_header(uint8_t* header, uint8_t opcode, uint32_t length) {
+    header[0] = 0x80 | (opcode & 0x0F); // FIN + Opcode
+    if (length <= 125) {
+        header[1] = (uint8_t)length;
+        return 2;
+    }
+    if (length <= 65535) {
+        header[1] = 126;
+        header[2] = (length >> 8) & 0xFF;
+        header[3] = length & 0xFF;
+        return 4;
+    }
+    return 0;
+}
+
 // ============================================================================
 // Crypto Helpers (SHA1 + Base64)
 // ============================================================================
@@ -289,6 +421,8 @@ public:
     uint32_t lastPing = 0;
     
     WsSubscription subscriptions[WS_MAX_SUBS];
+    WsTopicSet subscribed;     // Topics of all subscriptions
+    WsTopicSet unfiltered;     // Topics of subscriptions without property filters
     
     // RX Buffer for frame reassembly (small - only for WS frames after handshake)
     uint8_t rxBuffer[WS_RX_BUFFER_SIZE];
@@ -299,8 +433,13 @@ public:
     uint8_t lineIndex = 0;
     bool sawCR = false;  // Track if we saw \r
     
-    // TX Ring Buffer for non-blocking sends
+    // TX Ring Buffer for non-blocking sends (frames of this client only), and the queue
+    // that interleaves them with references to shared broadcast frames
     WsTxBuffer txBuffer;
+    WsTxEntry txQueue[WS_TX_QUEUE_ENTRIES];
+    uint8_t txHead = 0;
+    uint8_t txCount = 0;
+    uint16_t txOffset = 0;  // Bytes of the front shared frame already sent
     
     // Handshake - only store the key (24 bytes base64)
     char wsKey[28];  // Base64 key is 24 chars + null
@@ -321,7 +460,7 @@ public:
         lineIndex = 0;
         sawCR = false;
         wsKey[0] = 0;
-        txBuffer.reset();
+        resetTx();
         txStallStart = 0;
     }
 
@@ -329,7 +468,7 @@ public:
         if (client.connected()) client.stop();
         state = WS_DISCONNECTED;
         clearSubscriptions();
-        txBuffer.reset();
+        resetTx();
         rxIndex = 0;
         txStallStart = 0;
     }
@@ -346,13 +485,37 @@ public:
         }
         state = WS_DISCONNECTED;
         clearSubscriptions();
-        txBuffer.reset();
+        resetTx();
         rxIndex = 0;
         txStallStart = 0;
     }
 
+    // Drop everything queued, releasing the shared frames
+    void resetTx() {
+        for (int i = 0; i < txCount; i++) {
+            WsTxEntry& entry = txQueue[(txHead + i) % WS_TX_QUEUE_ENTRIES];
+            if (entry.frame != nullptr) entry.frame->refs--;
+        }
+        txHead = txCount = 0;
+        txOffset = 0;
+        txBuffer.reset();
+    }
+
+    bool txEmpty() const { return txCount == 0; }
+
     void clearSubscriptions() {
         for (int i = 0; i < WS_MAX_SUBS; i++) subscriptions[i].clear();
+        refreshTopics();
+    }
+
+    // Rebuild the topic sets from the subscriptions
+    void refreshTopics() {
+        subscribed.clear();
+        unfiltered.clear();
+        for (int i = 0; i < WS_MAX_SUBS; i++) {
+            subscribed.add(subscriptions[i].topics);
+            if (subscriptions[i].propCount == 0) unfiltered.add(subscriptions[i].topics);
+        }
     }
     
     WsSubscription* getEmptySubscription() {
@@ -368,24 +531,14 @@ public:
         
         // Build frame header
         uint8_t header[4];
-        uint8_t headerLen = 0;
-        
-        header[0] = 0x80 | (opcode & 0x0F); // FIN + Opcode
-        
-        if (length <= 125) {
-            header[1] = (uint8_t)length;
-            headerLen = 2;
-        } else if (length <= 65535) {
-            header[1] = 126;
-            header[2] = (length >> 8) & 0xFF;
-            header[3] = length & 0xFF;
-            headerLen = 4;
-        } else {
-            return false; // Too large
-        }
+        uint8_t headerLen = ws_frame_header(header, opcode, length);
+        if (headerLen == 0) return false; // Too large
         
         // Check if we have space for header + payload
         uint16_t totalSize = headerLen + length;
+        WsTxEntry* last = txCount > 0 ? &txQueue[(txHead + txCount - 1) % WS_TX_QUEUE_ENTRIES] : nullptr;
+        bool extend = last != nullptr && last->frame == nullptr && last->length <= 65535 - totalSize;
+        if (!extend && txCount == WS_TX_QUEUE_ENTRIES) return false;
         if (txBuffer.freeSpace() < totalSize) {
             WS_LOG("WS TX Full: need "); WS_LOG(totalSize); 
             WS_LOG(" have "); WS_LOGLN(txBuffer.freeSpace());
@@ -400,6 +553,22 @@ public:
             txBuffer.write((const uint8_t*)payload, length);
         }
         
+        // Behind a run of private bytes the frame just extends it
+        if (extend) {
+            last->length += totalSize;
+        } else {
+            txQueue[(txHead + txCount) % WS_TX_QUEUE_ENTRIES] = { nullptr, totalSize };
+            txCount++;
+        }
+        return true;
+    }
+
+    // Queue a reference to a broadcast frame - nothing is copied
+    bool queueShared(WsSharedFrame* frame) {
+        if (state != WS_CONNECTED || txCount == WS_TX_QUEUE_ENTRIES) return false;
+        txQueue[(txHead + txCount) % WS_TX_QUEUE_ENTRIES] = { frame, frame->length };
+        txCount++;
+        frame->refs++;
         return true;
     }
     
@@ -415,13 +584,13 @@ public:
     // If stalled for too long: force-close the client.
     // This converts both blocking loops into a check-and-return pattern.
     void processTx() {
-        if (txBuffer.isEmpty()) { txStallStart = 0; return; }
+        if (txEmpty()) { txStallStart = 0; return; }
         
         // Check socket is still in a writable state
         uint8_t sockStat = client.status();
         if (sockStat != 0x17 /*ESTABLISHED*/ && sockStat != 0x1C /*CLOSE_WAIT*/) {
             WS_LOG("WS TX: socket state 0x"); WS_LOGLN(sockStat);
-            txBuffer.reset(); txStallStart = 0;
+            resetTx(); txStallStart = 0;
             return;
         }
         
@@ -447,27 +616,46 @@ public:
         // (wait for free space) passes through in one iteration.
         // Phase 2 (wait for SEND_OK) completes in microseconds since
         // the W5500 only needs to accept the data into its TCP pipeline.
-        uint8_t chunk[WS_TX_CHUNK_SIZE];
         int maxChunks = 4;
         
-        while (maxChunks-- > 0 && !txBuffer.isEmpty()) {
+        while (maxChunks-- > 0 && !txEmpty()) {
             hwAvail = client.availableForWrite();
             if (hwAvail <= 0) break;  // W5500 buffer filled up mid-drain
+            WsTxEntry& entry = txQueue[txHead];
             
-            // Clamp to min(chunk_size, hw_available, ring_buffer_available)
-            uint16_t toSend = txBuffer.available();
-            if (toSend > (uint16_t)WS_TX_CHUNK_SIZE) toSend = WS_TX_CHUNK_SIZE;
-            if (toSend > (uint16_t)hwAvail) toSend = (uint16_t)hwAvail;
-            if (toSend == 0) break;
+            // Straight from the shared frame or the ring - no copy in between.
+            // Clamp to min(chunk_size, hw_available, queued, contiguous)
+            const uint8_t* data;
+            uint16_t contiguous;
+            if (entry.frame != nullptr) {
+                data = entry.frame->data + txOffset;
+                contiguous = entry.length - txOffset;
+            } else {
+                data = txBuffer.span(contiguous);
+                contiguous = min(contiguous, entry.length);
+            }
+            uint16_t count = contiguous;
+            if (count > (uint16_t)WS_TX_CHUNK_SIZE) count = WS_TX_CHUNK_SIZE;
+            if (count > (uint16_t)hwAvail) count = (uint16_t)hwAvail;
+            if (count == 0) break;
             
-            uint16_t count = txBuffer.read(chunk, toSend);
-            if (count > 0) {
-                size_t written = client.write(chunk, count);
-                if (written < count) {
-                    WS_LOG("WS TX partial: "); WS_LOG(written);
-                    WS_LOG("/"); WS_LOGLN(count);
-                    break;  // Unexpected partial write, retry next loop
-                }
+            size_t written = client.write(data, count);
+            if (entry.frame != nullptr) {
+                txOffset += written;
+            } else {
+                txBuffer.consume(written);
+                entry.length -= written;
+            }
+            if (entry.frame != nullptr ? txOffset == entry.length : entry.length == 0) {
+                if (entry.frame != nullptr) entry.frame->refs--;
+                txOffset = 0;
+                txHead = (txHead + 1) % WS_TX_QUEUE_ENTRIES;
+                txCount--;
+            }
+            if (written < count) {
+                WS_LOG("WS TX partial: "); WS_LOG(written);
+                WS_LOG("/"); WS_LOGLN(count);
+                break;  // Unexpected partial write, retry next loop
             }
         }
     }
@@ -490,6 +678,12 @@ private:
     EthernetServer* server;
     WebSocketClient clients[WS_MAX_CLIENTS];
     WsMessageHandler onMessageCallback = nullptr;
+    WsSharedFrame sharedFrames[WS_SHARED_FRAMES];
+    char topicNames[WS_MAX_TOPICS][WS_TOPIC_LEN];
+    uint32_t topicHashes[WS_MAX_TOPICS];
+    uint8_t topicCount = 0;
+    char propKeyNames[WS_MAX_PROP_KEYS][WS_KEY_LEN];
+    uint8_t propKeyCount = 0;
 
 public:
     WebSocketServer(EthernetServer& srv) : server(&srv) {}
@@ -563,76 +757,222 @@ public:
         }
     }
 
-    // Broadcast to topic subscribers
+    // Broadcast to topic subscribers: the frame is encoded once, on the first recipient, and shared
     template <typename Filter>
-    void broadcast(const char* msg, Filter filterFunc) {
+    void broadcastFrame(uint8_t opcode, const void* data, uint16_t len, Filter filterFunc) {
+        WsSharedFrame* frame = nullptr;
+        bool shared = len + 4 <= WS_SHARED_FRAME_SIZE;
         for (int i = 0; i < WS_MAX_CLIENTS; i++) {
             if (clients[i].state == WS_CONNECTED) {
                 if (filterFunc(clients[i])) {
-                    clients[i].queueText(msg);
+                    if (shared && frame == nullptr) {
+                        frame = encodeShared(opcode, data, len);
+                        shared = frame != nullptr;
+                    }
+                    if (!shared || !clients[i].queueShared(frame)) clients[i].queueFrame(opcode, data, len);
                 }
             }
         }
     }
 
+    template <typename Filter>
+    void broadcast(const char* msg, Filter filterFunc) {
+        broadcastFrame(WS_OP_TEXT, msg, strlen(msg), filterFunc);
+    }
+
     template <typename Filter>
     void broadcastBinary(const void* data, uint16_t len, Filter filterFunc) {
-        for (int i = 0; i < WS_MAX_CLIENTS; i++) {
-            if (clients[i].state == WS_CONNECTED) {
-                if (filterFunc(clients[i])) {
-                    clients[i].queueFrame(WS_OP_BINARY, data, len);
-                }
-            }
+        broadcastFrame(WS_OP_BINARY, data, len, filterFunc);
+    }
+
+    // Shared frames still referenced by some client's queue
+    int sharedFramesInUse() const {
+        int count = 0;
+        for (int i = 0; i < WS_SHARED_FRAMES; i++) {
+            if (sharedFrames[i].refs > 0) count++;
         }
+        return count;
     }
     
-    void emit(const char* topic, const char* msg) {
-        broadcast(msg, [topic](WebSocketClient& c) {
+    // ID of a registered topic, -1 if it is not
+    WsTopic findTopic(const char* topic) const {
+        uint32_t hash = ws_hash(topic);
+        for (int i = 0; i < topicCount; i++) {
+            if (topicHashes[i] == hash && strcmp(topicNames[i], topic) == 0) return i;
+        }
+        return -1;
+    }
+
+    // Intern a topic (wildcards are not topics) and add it to the subscriptions that match it. Only the
+    // application registers topics: emit() by ID is then free of any string work, while topics left out
+    // (or past WS_MAX_TOPICS, where this returns -1) are still delivered when emitted by name.
+    WsTopic addTopic(const char* topic) {
+        WsTopic id = findTopic(topic);
+        if (id >= 0) return id;
+        if (topicCount >= WS_MAX_TOPICS || strlen(topic) >= WS_TOPIC_LEN || strpbrk(topic, "+#") != nullptr) {
+            WS_LOG("WS: Topic not registered: "); WS_LOGLN(topic);
+            return -1;
+        }
+        id = topicCount++;
+        strcpy(topicNames[id], topic);
+        topicHashes[id] = ws_hash(topic);
+        for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+            WebSocketClient& c = clients[i];
+            bool changed = false;
             for (int s = 0; s < WS_MAX_SUBS; s++) {
-                if (strcmp(c.subscriptions[s].topic, topic) == 0) return true;
+                if (c.subscriptions[s].topic[0] == 0 || !topicMatches(c.subscriptions[s].topic, topic)) continue;
+                c.subscriptions[s].topics.set(id);
+                changed = true;
             }
-            return false;
-        });
+            if (changed) c.refreshTopics();
+        }
+        return id;
     }
 
-    void emitBinary(const char* topic, const void* data, uint16_t len) {
-        broadcastBinary(data, len, [topic](WebSocketClient& c) {
+    const char* topicName(WsTopic id) const { return id >= 0 && id < topicCount ? topicNames[id] : ""; }
+
+    // ID of a registered property key, -1 if it is not
+    int8_t findPropKey(const char* key) const {
+        for (int i = 0; i < propKeyCount; i++) {
+            if (strcmp(propKeyNames[i], key) == 0) return i;
+        }
+        return -1;
+    }
+
+    // Intern a property key events are filtered on, and compile it into the filters that use it. Like topics,
+    // only the application registers keys: filters on any other key still work, comparing names per event.
+    int8_t addPropKey(const char* key) {
+        int8_t id = findPropKey(key);
+        if (id >= 0) return id;
+        if (propKeyCount >= WS_MAX_PROP_KEYS || strlen(key) >= WS_KEY_LEN) {
+            WS_LOG("WS: Property key not registered: "); WS_LOGLN(key);
+            return -1;
+        }
+        id = propKeyCount++;
+        strcpy(propKeyNames[id], key);
+        for (int i = 0; i < WS_MAX_CLIENTS; i++) {
             for (int s = 0; s < WS_MAX_SUBS; s++) {
-                if (strcmp(c.subscriptions[s].topic, topic) == 0) {
-                    return true;
+                WsSubscription& sub = clients[i].subscriptions[s];
+                for (int p = 0; p < sub.propCount; p++) {
+                    if (strcmp(sub.properties[p].key, key) == 0) sub.propKeys[p] = id;
                 }
             }
-            return false;
-        });
+        }
+        return id;
+    }
+
+    // Subscribe `c` to a topic or an MQTT-style pattern ("io/+/state", "io/#"), resolved against the
+    // registered topics here (and against topics registered later in addTopic()) rather than per message.
+    // Subscribing never registers a topic - clients must not be able to fill the table. A pattern of
+    // WS_TOPIC_LEN characters or more is refused (nullptr), as is one more than WS_MAX_SUBS per client.
+    WsSubscription* subscribe(WebSocketClient& c, const char* pattern, const WsProperty* props = nullptr, uint8_t propCount = 0) {
+        if (strlen(pattern) >= WS_TOPIC_LEN) return nullptr;
+        WsSubscription* sub = c.getEmptySubscription();
+        if (sub == nullptr) return nullptr;
+        strcpy(sub->topic, pattern);
+        for (int p = 0; p < propCount; p++) sub->addProp(props[p].key, props[p].value);
+        for (int p = 0; p < sub->propCount; p++) sub->propKeys[p] = findPropKey(sub->properties[p].key);
+        for (int id = 0; id < topicCount; id++) {
+            if (topicMatches(sub->topic, topicNames[id])) sub->topics.set(id);
+        }
+        c.refreshTopics();
+        return sub;
+    }
+
+    // MQTT topic filter: `+` matches exactly one level, a trailing `#` the parent level and everything below
+    static bool topicMatches(const char* pattern, const char* topic) {
+        while (true) {
+            if (strcmp(pattern, "#") == 0) return true;
+            const char* pattern_end = strchr(pattern, '/');
+            const char* topic_end = strchr(topic, '/');
+            int pattern_length = pattern_end ? pattern_end - pattern : strlen(pattern);
+            int topic_length = topic_end ? topic_end - topic : strlen(topic);
+            bool any = pattern_length == 1 && pattern[0] == '+';
+            if (!any && (pattern_length != topic_length || strncmp(pattern, topic, topic_length) != 0)) return false;
+            if (topic_end == nullptr) return pattern_end == nullptr || strcmp(pattern_end, "/#") == 0;
+            if (pattern_end == nullptr) return false;
+            pattern = pattern_end + 1;
+            topic = topic_end + 1;
+        }
+    }
+
+    // Fan-out is one bit test per client
+    void emit(WsTopic topic, const char* msg) {
+        broadcast(msg, [topic](WebSocketClient& c) { return c.subscribed.has(topic); });
+    }
+
+    void emitBinary(WsTopic topic, const void* data, uint16_t len) {
+        broadcastBinary(data, len, [topic](WebSocketClient& c) { return c.subscribed.has(topic); });
+    }
+
+    // Only to subscribers whose property filters the event satisfies (all filter keys present, same values)
+    void emitWithProps(WsTopic topic, const char* msg, const WsProperty* evtProps, uint8_t evtPropCount) {
+        emitFiltered(topic, nullptr, msg, evtProps, evtPropCount);
+    }
+
+    // By name: a registered topic goes the ID path, any other is matched against the subscriptions per message
+    void emit(const char* topic, const char* msg) {
+        WsTopic id = findTopic(topic);
+        if (id >= 0) return emit(id, msg);
+        broadcast(msg, [this, topic](WebSocketClient& c) { return subscribedByName(c, topic); });
+    }
+
+    void emitBinary(const char* topic, const void* data, uint16_t len) {
+        WsTopic id = findTopic(topic);
+        if (id >= 0) return emitBinary(id, data, len);
+        broadcastBinary(data, len, [this, topic](WebSocketClient& c) { return subscribedByName(c, topic); });
     }
 
     void emitWithProps(const char* topic, const char* msg, const WsProperty* evtProps, uint8_t evtPropCount) {
+        emitFiltered(findTopic(topic), topic, msg, evtProps, evtPropCount);
+    }
+
+private:
+    // Any subscription of `c` matching an unregistered topic
+    bool subscribedByName(const WebSocketClient& c, const char* topic) const {
+        for (int s = 0; s < WS_MAX_SUBS; s++) {
+            if (c.subscriptions[s].topic[0] != 0 && topicMatches(c.subscriptions[s].topic, topic)) return true;
+        }
+        return false;
+    }
+
+    // emitWithProps() to subscribers of a registered topic, or with `topic` -1, of topic name `name`
+    void emitFiltered(WsTopic topic, const char* name, const char* msg, const WsProperty* evtProps, uint8_t evtPropCount) {
+        if (topic < 0 && name == nullptr) return;
+        int8_t keys[WS_MAX_EVENT_PROPS];
+        uint32_t hashes[WS_MAX_EVENT_PROPS];
+        uint8_t compiled = min(evtPropCount, (uint8_t) WS_MAX_EVENT_PROPS);
+        for (int ep = 0; ep < compiled; ep++) {
+            keys[ep] = findPropKey(evtProps[ep].key);
+            hashes[ep] = ws_hash(evtProps[ep].value);
+        }
         broadcast(msg, [&](WebSocketClient& c) {
+            if (topic >= 0) {
+                if (c.unfiltered.has(topic)) return true;
+                if (!c.subscribed.has(topic)) return false;
+            }
             for (int s = 0; s < WS_MAX_SUBS; s++) {
-                if (strcmp(c.subscriptions[s].topic, topic) == 0) {
-                    bool match = true;
-                    for (int p = 0; p < c.subscriptions[s].propCount; p++) {
-                        const char* reqKey = c.subscriptions[s].properties[p].key;
-                        const char* reqVal = c.subscriptions[s].properties[p].value;
-                        bool keyFound = false;
-                        for (int ep = 0; ep < evtPropCount; ep++) {
-                            if (strcmp(evtProps[ep].key, reqKey) == 0) {
-                                if (strcmp(evtProps[ep].value, reqVal) != 0) match = false;
-                                keyFound = true;
-                                break;
-                            }
-                        }
-                        if (!keyFound) match = false;
-                        if (!match) break;
-                    }
-                    if (match) return true;
-                }
+                const WsSubscription& sub = c.subscriptions[s];
+                bool matches = topic >= 0 ? sub.topics.has(topic) : sub.topic[0] != 0 && topicMatches(sub.topic, name);
+                if (matches && sub.matchesProps(evtProps, keys, hashes, compiled, evtPropCount)) return true;
             }
             return false;
         });
     }
 
-private:
+    // Frame into a free shared slot, nullptr when all are taken. The slot stays free (refs 0) until queued.
+    WsSharedFrame* encodeShared(uint8_t opcode, const void* data, uint16_t len) {
+        for (int i = 0; i < WS_SHARED_FRAMES; i++) {
+            WsSharedFrame& frame = sharedFrames[i];
+            if (frame.refs > 0) continue;
+            uint8_t headerLen = ws_frame_header(frame.data, opcode, len);
+            memcpy(frame.data + headerLen, data, len);
+            frame.length = headerLen + len;
+            return &frame;
+        }
+        return nullptr;
+    }
+
     void handleNewClients() {
         EthernetClient newClient = server->available();
         if (!newClient) return;
@@ -895,9 +1235,7 @@ void xtp_ws_default_handler(WebSocketClient& c, const char* msg, uint16_t len) {
                 
                 WS_LOG("WS Sub topic: '"); WS_LOG(topic); WS_LOGLN("'");
 
-                WsSubscription* s = c.getEmptySubscription();
-                if (s) {
-                    strncpy(s->topic, topic, 31);
+                if (wsServer.subscribe(c, topic)) {
                     WS_LOG("  -> Subscribed OK, slot found"); WS_LOGLN("");
                 } else {
                     WS_LOGLN("  -> ERROR: No empty subscription slot!");
@@ -280,7 +280,7 @@ private:
         for (uint8_t i = 0; i < length; i++) {
             frame[6 + i] = payload[i] ^ MASK_KEY[i & 3];
         }
-        return _client.write(frame, 6 + length) == (6 + length);
+        return _client.write(frame, 6 + length) == (size_t) (6 + length);
     }
 
     // Returns false if connection should be closed
@@ -440,7 +440,7 @@ public:
 
         XTP_WS_SPI_SELECT(XTP_WS_SPI_ETH);
         
-        if (_client.write(header, headerLen) != headerLen) {
+        if (_client.write(header, headerLen) != (size_t) headerLen) {
             XTP_WS_SPI_SELECT(XTP_WS_SPI_NONE);
             return false;
         }
@@ -489,7 +489,7 @@ public:
 
         XTP_WS_SPI_SELECT(XTP_WS_SPI_ETH);
         
-        if (_client.write(header, headerLen) != headerLen) {
+        if (_client.write(header, headerLen) != (size_t) headerLen) {
             XTP_WS_SPI_SELECT(XTP_WS_SPI_NONE);
             return false;
         }
@@ -0,0 +1,1298 @@
+/**
+ * @file bench.cpp
+ * @brief Host microbenchmark for the xtp-lib HTTP stack
+ *
+ * Builds the whole library for one board against test/host/shim and drives
+ * the REST server through the simulated W5500 sockets. Per request it reports
+ * host CPU time, xtp_loop() passes, W5500 SPI frames/bytes (and the bus time
+ * they would take at ETH_SPI_SPEED) and bytes printed to Serial.
+ *
+ *   xtp_host_bench_<board>            full run
+ *   xtp_host_bench_<board> --smoke    short run that checks responses (ctest)
+ *   xtp_host_bench_<board> -n 5000    request count for the full run
+ */
+
+#include <xtp-lib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+volatile uint32_t ota_gpio_holdoff_ms = 0;
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+static uint64_t now_ns() {
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int failures = 0;
+
+#define BENCH_CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        failures++; \
+        fprintf(stderr, "CHECK FAILED %s:%d: %s - ", __FILE__, __LINE__, #cond); \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+    } \
+} while (0)
+
+struct Sample {
+    uint64_t cpu_ns = 0;
+    uint32_t loops = 0;
+    uint64_t spi_frames = 0;
+    uint64_t spi_bytes = 0;
+    uint64_t serial_bytes = 0;
+};
+
+struct Stats {
+    const char* name;
+    std::vector<Sample> samples;
+
+    void print() const {
+        if (samples.empty()) return;
+        std::vector<uint64_t> cpu;
+        Sample sum;
+        for (const Sample& s : samples) {
+            cpu.push_back(s.cpu_ns);
+            sum.cpu_ns += s.cpu_ns;
+            sum.loops += s.loops;
+            sum.spi_frames += s.spi_frames;
+            sum.spi_bytes += s.spi_bytes;
+            sum.serial_bytes += s.serial_bytes;
+        }
+        std::sort(cpu.begin(), cpu.end());
+        double n = (double) samples.size();
+        double bus_us = (double) sum.spi_bytes * 8.0 * 1e6 / (double) ETH_SPI_SPEED / n;
+        printf("  %-28s %8.2f %8.2f %7.1f %9.1f %8.0f %9.1f %8.0f\n",
+            name,
+            sum.cpu_ns / n / 1000.0,
+            cpu[cpu.size() * 99 / 100] / 1000.0,
+            sum.loops / n,
+            sum.spi_frames / n,
+            sum.spi_bytes / n,
+            bus_us,
+            sum.serial_bytes / n);
+    }
+};
+
+static void print_table_header() {
+    printf("  %-28s %8s %8s %7s %9s %8s %9s %8s\n", "scenario", "cpu_us", "p99_us", "loops", "spi_frm", "spi_B", "bus_us", "uart_B");
+}
+
+// Run the main loop until `done` returns true or `max_loops` passes
+template <typename F> static Sample pump(F done, uint32_t max_loops = 200) {
+    Sample s;
+    uint64_t spi_f = host_spi.frames, spi_b = host_spi.bytes, ser = Serial.host_bytes;
+    uint64_t t0 = now_ns();
+    while (s.loops < max_loops && !done()) {
+        xtp_loop();
+        s.loops++;
+    }
+    s.cpu_ns = now_ns() - t0;
+    s.spi_frames = host_spi.frames - spi_f;
+    s.spi_bytes = host_spi.bytes - spi_b;
+    s.serial_bytes = Serial.host_bytes - ser;
+    return s;
+}
+
+// Connect to the HTTP port, giving the server loop passes to re-arm its LISTEN socket
+static int peer_connect(uint32_t max_loops = 20, IPAddress remote = IPAddress(192, 168, 1, 10)) {
+    int sock = host_peer_connect(local_port, remote);
+    for (uint32_t i = 0; sock < 0 && i < max_loops; i++) {
+        xtp_loop();
+        sock = host_peer_connect(local_port, remote);
+    }
+    return sock;
+}
+
+// One HTTP/1.0-style exchange: connect, send, loop until the server closes
+static std::string http_exchange(const char* request, Sample* sample = nullptr, IPAddress remote = IPAddress(192, 168, 1, 10)) {
+    int sock = peer_connect(20, remote);
+    if (sock < 0) return std::string();
+    host_peer_send(sock, request);
+    Sample s = pump([sock]() { return host_peer_status(sock) != SnSR::ESTABLISHED; });
+    if (sample) *sample = s;
+    return host_peer_recv(sock);
+}
+
+// Split complete responses (Content-Length framed) off the front of `stream`
+static std::vector<std::string> take_responses(std::string& stream) {
+    std::vector<std::string> out;
+    while (true) {
+        size_t end = stream.find("\r\n\r\n");
+        if (end == std::string::npos) break;
+        size_t cl = stream.find("Content-Length: ");
+        if (cl == std::string::npos || cl > end) break;
+        size_t total = end + 4 + strtoul(stream.c_str() + cl + 16, nullptr, 10);
+        if (stream.size() < total) break;
+        out.push_back(stream.substr(0, total));
+        stream.erase(0, total);
+    }
+    return out;
+}
+
+// Send `request` on an open keep-alive connection and loop until its response is complete
+static std::string keep_alive_exchange(int sock, const char* request, Sample* sample = nullptr) {
+    std::string stream;
+    std::vector<std::string> responses;
+    host_peer_send(sock, request);
+    Sample s = pump([&]() {
+        stream += host_peer_recv(sock);
+        responses = take_responses(stream);
+        return !responses.empty() || host_peer_status(sock) != SnSR::ESTABLISHED;
+    });
+    if (sample) *sample = s;
+    return responses.empty() ? std::string() : responses[0];
+}
+
+// Body of a `Transfer-Encoding: chunked` response, empty if the framing is broken or unterminated
+static std::string dechunk(const std::string& res) {
+    size_t pos = res.find("\r\n\r\n");
+    if (pos == std::string::npos) return std::string();
+    pos += 4;
+    std::string body;
+    while (pos < res.size()) {
+        size_t line_end = res.find("\r\n", pos);
+        if (line_end == std::string::npos) break;
+        size_t size = strtoul(res.c_str() + pos, nullptr, 16);
+        pos = line_end + 2;
+        if (size == 0) return res.compare(pos, 2, "\r\n") == 0 ? body : std::string();
+        if (pos + size + 2 > res.size() || res.compare(pos + size, 2, "\r\n") != 0) break;
+        body.append(res, pos, size);
+        pos += size + 2;
+    }
+    return std::string();
+}
+
+// Open a WebSocket on port 81 and finish the upgrade handshake, -1 on failure
+static int ws_connect() {
+    int sock = host_peer_connect(81);
+    for (int i = 0; sock < 0 && i < 20; i++) {
+        xtp_loop();
+        sock = host_peer_connect(81);
+    }
+    if (sock < 0) return -1;
+    host_peer_send(sock, "GET / HTTP/1.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n");
+    std::string res;
+    for (int i = 0; i < 20 && res.find("\r\n\r\n") == std::string::npos; i++) {
+        xtp_loop();
+        res += host_peer_recv(sock);
+    }
+    return res.compare(0, 12, "HTTP/1.1 101") == 0 ? sock : -1;
+}
+
+// Masked client text frame, as a browser sends it
+static void ws_send_text(int sock, const std::string& text) {
+    const uint8_t mask[4] = { 0x12, 0x34, 0x56, 0x78 };
+    std::string frame = { (char) 0x81, (char) (0x80 | text.size()), (char) mask[0], (char) mask[1], (char) mask[2], (char) mask[3] };
+    for (size_t i = 0; i < text.size(); i++) frame += (char) (text[i] ^ mask[i % 4]);
+    host_peer_send(sock, frame.data(), frame.size());
+}
+
+// Payloads of the complete server frames at the front of `stream`
+static std::vector<std::string> ws_take_frames(std::string& stream) {
+    std::vector<std::string> frames;
+    size_t pos = 0;
+    while (stream.size() - pos >= 2) {
+        size_t length = (uint8_t) stream[pos + 1] & 0x7F, header = 2;
+        if (length == 126) {
+            if (stream.size() - pos < 4) break;
+            length = (uint8_t) stream[pos + 2] << 8 | (uint8_t) stream[pos + 3];
+            header = 4;
+        }
+        if (stream.size() - pos < header + length) break;
+        frames.push_back(stream.substr(pos + header, length));
+        pos += header + length;
+    }
+    stream.erase(0, pos);
+    return frames;
+}
+
+// Asset bundle in the layout of `web-compile.js --bundle`: header, index sorted by name hash, file data
+static std::string asset_bundle(std::vector<std::pair<std::string, std::string>> files) {
+    std::sort(files.begin(), files.end(), [](const std::pair<std::string, std::string>& a, const std::pair<std::string, std::string>& b) {
+        return RestServer::hashUri(a.first.c_str()) < RestServer::hashUri(b.first.c_str());
+    });
+    std::string index, data;
+    uint32_t offset = sizeof(FlashAssetsHeader) + files.size() * sizeof(FlashAssetEntry);
+    for (const auto& file : files) {
+        FlashAssetEntry entry = {};
+        entry.hash = RestServer::hashUri(file.first.c_str());
+        entry.offset = offset + data.size();
+        entry.length = file.second.size();
+        snprintf(entry.etag, sizeof(entry.etag), "\"%08x\"", flash_crc32(0, (const uint8_t*) file.second.data(), file.second.size()));
+        snprintf(entry.name, sizeof(entry.name), "%s", file.first.c_str());
+        index.append((const char*) &entry, sizeof(entry));
+        data += file.second;
+    }
+    FlashAssetsHeader header = { FLASH_ASSETS_MAGIC, FLASH_ASSETS_VERSION, (uint16_t) files.size(), (uint32_t)(offset + data.size()), 0 };
+    header.crc = flash_crc32(flash_crc32(0, (const uint8_t*) index.data(), index.size()), (const uint8_t*) data.data(), data.size());
+    return std::string((const char*) &header, sizeof(header)) + index + data;
+}
+
+// Send a whole bundle to POST /api/assets; the server takes it in as its flash sectors are erased
+static int start_upload(const std::string& bundle) {
+    int sock = peer_connect();
+    host_peer_send(sock, ("POST /api/assets HTTP/1.1\r\nHost: 192.168.1.100\r\nContent-Length: " + std::to_string(bundle.size()) + "\r\nConnection: close\r\n\r\n").c_str());
+    host_peer_send(sock, bundle.data(), bundle.size());
+    return sock;
+}
+
+// Loop (with time passing for the erases) until the upload is answered
+static std::string finish_upload(int sock, uint32_t& worst_loop_us) {
+    worst_loop_us = 0;
+    for (int i = 0; i < 1000 && host_peer_status(sock) == SnSR::ESTABLISHED; i++) {
+        uint32_t start = micros();
+        xtp_loop();
+        worst_loop_us = max(worst_loop_us, micros() - start);
+        host_advance_ms(5);
+    }
+    return host_peer_recv(sock);
+}
+
+static bool starts_with(const std::string& s, const char* prefix) { return s.compare(0, strlen(prefix), prefix) == 0; }
+static bool ends_with(const std::string& s, const char* suffix) {
+    size_t n = strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+static bool ends_with(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// ============================================================================
+// Scenarios
+// ============================================================================
+
+static const char* REQ_PING =
+    "GET /ping HTTP/1.1\r\n"
+    "Host: 192.168.1.100\r\n"
+    "User-Agent: xtp-host-bench\r\n"
+    "Accept: */*\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+static const char* REQ_SOCKETS =
+    "GET /api/socket-status HTTP/1.1\r\n"
+    "Host: 192.168.1.100\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+static const char* REQ_PING_KEEP_ALIVE =
+    "GET /ping HTTP/1.1\r\n"
+    "Host: 192.168.1.100\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+static const char* REQ_MISSING =
+    "GET /does/not/exist HTTP/1.1\r\n"
+    "Host: 192.168.1.100\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+static std::string get_request(const char* uri) {
+    return std::string("GET ") + uri + " HTTP/1.1\r\nHost: 192.168.1.100\r\nConnection: close\r\n\r\n";
+}
+
+// GET from a client that takes at most `tx_limit` unacknowledged bytes, looping until the response is whole
+static std::string slow_exchange(const char* uri, uint32_t& worst_loop_us, uint32_t tx_limit = 2048) {
+    int sock = peer_connect();
+    host_sockets[sock].tx_limit = tx_limit;
+    host_peer_send(sock, get_request(uri).c_str());
+    std::string stream;
+    worst_loop_us = 0;
+    for (int i = 0; i < 200 && host_peer_status(sock) == SnSR::ESTABLISHED; i++) {
+        uint32_t start = micros();
+        xtp_loop();
+        worst_loop_us = max(worst_loop_us, micros() - start);
+        stream += host_peer_recv(sock);
+    }
+    return stream + host_peer_recv(sock);
+}
+
+// Statistics of a route by the URI it was registered with (pattern routes included)
+static RestServer::RouteStats& route_stats(const char* uri, HTTPMethod method) {
+    int i = 0;
+    while (i < rest._endpoints_count && (rest._endpoints[i].method != method || strcmp(rest._endpoints[i].uri, uri) != 0)) i++;
+    return rest._route_stats[i];
+}
+
+// Application hook set before xtp_setup(), which the HTTP server must keep
+static int app_state_changes = 0;
+
+// Routes several checks use, registered once after xtp_setup() like an application's own
+static void bench_routes() {
+    rest.get("/api/io/:pin", []() {
+        char text[64];
+        snprintf(text, sizeof(text), "io %ld mode=%.*s", rest.pathParam("pin").toInt(-1), rest.queryParam("mode").length, rest.queryParam("mode").data);
+        rest.send(200, "text/plain", text);
+    });
+    rest.post("/echo", []() { rest.send(200, "text/plain", rest.body); });
+}
+
+// Each check covers one feature: it registers the routes it needs and restores any setting it changes,
+// so none depends on another having run first
+
+static void check_basic() {
+    std::string res = http_exchange(REQ_PING);
+    BENCH_CHECK(starts_with(res, "HTTP/1.1 200 OK\r\n"), "ping status: %.40s", res.c_str());
+    BENCH_CHECK(ends_with(res, "\r\n\r\npong"), "ping body: %s", res.c_str());
+
+    res = http_exchange(REQ_SOCKETS);
+    BENCH_CHECK(starts_with(res, "HTTP/1.1 200"), "socket-status: %.40s", res.c_str());
+    BENCH_CHECK(res.find("\r\n\r\n{\"requests\"") != std::string::npos && ends_with(res, "\"port\":0}]}"), "socket-status body: %s", res.c_str());
+    BENCH_CHECK(ends_with(res, socket_status_json), "socket_status_json buffer: %s", socket_status_json);
+
+    res = http_exchange(get_request("/api/timing").c_str());
+    BENCH_CHECK(res.find("Transfer-Encoding: chunked") != std::string::npos, "timing not chunked: %s", res.c_str());
+    std::string body = dechunk(res);
+    BENCH_CHECK(starts_with(body, "{\"uptime_s\"") && body.find("\"http_handle\":{") != std::string::npos && ends_with(body, "}}"), "timing body: %s", body.c_str());
+
+    // HTTP/1.0 has no chunked encoding - the body is sent as is and ends with the connection
+    res = http_exchange("GET /api/cache HTTP/1.0\r\n\r\n");
+    BENCH_CHECK(res.find("Transfer-Encoding") == std::string::npos && ends_with(res, "}]"), "cache stats over HTTP/1.0: %s", res.c_str());
+
+    res = http_exchange(REQ_MISSING);
+    BENCH_CHECK(starts_with(res, "HTTP/1.1 404 Not Found\r\n"), "not found: %.40s", res.c_str());
+}
+
+static void check_chunked() {
+    // A chunked body from a producer can be any length: it writes the next lines each time the client has
+    // taken the last ones
+    rest.get("/lines", []() {
+        rest.beginChunked(200, "text/plain");
+        rest.continueChunked([](uint32_t& line, uint32_t& items) {
+            for (int i = 0; i < 8; i++) rest.printfChunk("line %05lu\n", line++);
+            return line < 2000;
+        });
+    });
+    std::string lines;
+    for (int line = 0; line < 2000; line++) lines += "line " + std::string(5 - std::to_string(line).size(), '0') + std::to_string(line) + "\n";
+    uint32_t worst_loop_us;
+    std::string stream = slow_exchange("/lines", worst_loop_us);
+    BENCH_CHECK(dechunk(stream) == lines && worst_loop_us < 1000, "chunk producer to a slow client: %u bytes, worst loop %u us", (unsigned) stream.size(), worst_loop_us);
+}
+
+static void check_status_cache() {
+    // Status endpoints are served from pre-rendered JSON until the TTL runs out or the cache is invalidated
+    HttpCachedResponse& i2c_cache = http_cache[HTTP_CACHE_I2C_STATUS];
+    host_advance_ms(HTTP_STATUS_CACHE_TTL_MS);
+    uint32_t misses = i2c_cache.misses;
+    uint32_t hits = i2c_cache.hits;
+    http_exchange(get_request("/api/i2c-status").c_str());
+    std::string res = http_exchange(get_request("/api/i2c-status").c_str());
+    BENCH_CHECK(i2c_cache.misses == misses + 1 && i2c_cache.hits == hits + 1 && ends_with(res, i2c_cache.buffer), "i2c-status cache: %u misses, %u hits", i2c_cache.misses - misses, i2c_cache.hits - hits);
+    host_advance_ms(HTTP_STATUS_CACHE_TTL_MS);
+    http_exchange(get_request("/api/i2c-status").c_str());
+    BENCH_CHECK(i2c_cache.misses == misses + 2, "i2c-status cache outlived its TTL");
+    HttpCachedResponse& network_cache = http_cache[HTTP_CACHE_NETWORK_STATUS];
+    http_exchange(get_request("/api/network-status").c_str());
+    misses = network_cache.misses;
+    EthernetState eth_state = ethState.state;
+    ethState.enterState(ETH_STATE_ERROR);
+    ethState.enterState(eth_state);
+    res = http_exchange(get_request("/api/network-status").c_str());
+    BENCH_CHECK(network_cache.misses == misses + 1 && ends_with(res, network_cache.buffer), "network-status not invalidated by a state change");
+    BENCH_CHECK(app_state_changes > 0, "application state change hook dropped by the HTTP server");
+}
+
+static void check_route_stats() {
+    // Per-route statistics: each histogram holds every request, a 404 counts as an error of the asset route
+    RestServer::RouteStats& ping_stats = route_stats("/ping", HTTP_GET);
+    RestServer::RouteStats& asset_stats = route_stats("/*", HTTP_GET);
+    uint32_t ping_hits = ping_stats.hits, asset_hits = asset_stats.hits, asset_errors = asset_stats.errors;
+    uint32_t ping_handled = 0;
+    for (int i = 0; i < XTP_HISTOGRAM_BUCKETS; i++) ping_handled -= ping_stats.handler.buckets[i];
+    http_exchange(REQ_PING);
+    http_exchange(REQ_MISSING);
+    for (int i = 0; i < XTP_HISTOGRAM_BUCKETS; i++) ping_handled += ping_stats.handler.buckets[i];
+    BENCH_CHECK(ping_stats.hits == ping_hits + 1 && ping_stats.errors == 0 && ping_handled == 1, "ping route stats: %u hits, %u handled", ping_stats.hits - ping_hits, ping_handled);
+    BENCH_CHECK(asset_stats.hits == asset_hits + 1 && asset_stats.errors == asset_errors + 1, "404 route stats: %u hits, %u errors", asset_stats.hits - asset_hits, asset_stats.errors - asset_errors);
+    std::string body = dechunk(http_exchange(get_request("/api/timing/routes").c_str()));
+    std::string ping_entry = "{\"uri\":\"/ping\",\"method\":\"GET\",\"hits\":" + std::to_string(ping_stats.hits) + ",\"errors\":0,\"bytes\":";
+    BENCH_CHECK(body.find(ping_entry) != std::string::npos && ends_with(body, "]}]}"), "route stats: %s", body.c_str());
+}
+
+static void check_routing() {
+    // Pattern routes capture path segments; the query string is split off before matching
+    rest.get("/api/io/:pin/name", []() { rest.send(200, "text/plain", "name"); });
+    rest.get("/static/*", []() {
+        char text[64];
+        rest.pathParam("*").copyTo(text, sizeof(text));
+        rest.send(200, "text/plain", text);
+    });
+    std::string res = http_exchange(get_request("/api/io/7?mode=out&x").c_str());
+    BENCH_CHECK(ends_with(res, "\r\n\r\nio 7 mode=out"), "path param: %s", res.c_str());
+    res = http_exchange(get_request("/api/io/7/name").c_str());
+    BENCH_CHECK(ends_with(res, "\r\n\r\nname"), "nested path param: %s", res.c_str());
+    res = http_exchange(get_request("/static/css/site.css").c_str());
+    BENCH_CHECK(ends_with(res, "\r\n\r\ncss/site.css"), "wildcard: %s", res.c_str());
+    res = http_exchange(get_request("/ping?cache=1").c_str());
+    BENCH_CHECK(ends_with(res, "\r\n\r\npong"), "exact route with query: %s", res.c_str());
+    res = http_exchange(get_request("/api/io/").c_str());
+    BENCH_CHECK(starts_with(res, "HTTP/1.1 404"), "empty path param: %.40s", res.c_str());
+}
+
+static void check_request_parsing() {
+    // Requests trickling in over several segments, with a cookie larger than the receive buffer
+    std::string cookie = "Cookie: session=" + std::string(HTTP_RX_BUFFER_SIZE * 2, 'x') + "\r\n";
+    std::string split = "POST /echo HTTP/1.1\r\nHost: 192.168.1.100\r\n" + cookie + "Content-Length: 11\r\nConnection: close\r\n\r\nhello world";
+    int sock = peer_connect();
+    for (size_t i = 0; i < split.size(); i += 100) {
+        host_peer_send(sock, split.data() + i, min((size_t) 100, split.size() - i));
+        pump([]() { return false; }, 1);
+    }
+    pump([sock]() { return host_peer_status(sock) != SnSR::ESTABLISHED; });
+    std::string res = host_peer_recv(sock);
+    BENCH_CHECK(ends_with(res, "\r\n\r\nhello world"), "segmented request: %s", res.c_str());
+
+    // A URI that doesn't fit is answered, not cut to a shorter route; a Content-Length that isn't a plain number is refused
+    res = http_exchange(get_request(("/ping?" + std::string(HTTP_MAX_URI_LENGTH, 'q')).c_str()).c_str());
+    BENCH_CHECK(starts_with(res, "HTTP/1.1 414"), "long URI: %.40s", res.c_str());
+    res = http_exchange(get_request(("/ping?" + std::string(HTTP_MAX_URI_LENGTH - 7, 'q')).c_str()).c_str());
+    BENCH_CHECK(ends_with(res, "\r\n\r\npong"), "longest URI: %.40s", res.c_str());
+    for (const char* length : { "11abc", "-11", "+11", " 0x0B", "", "99999999999999999999", "11\r\nContent-Length: 12" }) {
+        res = http_exchange((std::string("POST /echo HTTP/1.1\r\nHost: 192.168.1.100\r\nContent-Length: ") + length + "\r\nConnection: close\r\n\r\nhello world").c_str());
+        BENCH_CHECK(starts_with(res, "HTTP/1.1 400"), "Content-Length \"%s\": %.40s", length, res.c_str());
+    }
+    res = http_exchange("POST /echo HTTP/1.1\r\nHost: 192.168.1.100\r\nContent-Length: 11 \r\nContent-Length: 11\r\nConnection: close\r\n\r\nhello world");
+    BENCH_CHECK(ends_with(res, "\r\n\r\nhello world"), "repeated Content-Length: %s", res.c_str());
+}
+
+static void check_uploads() {
+    std::string body;
+    // Large uploads stream through a body handler after `100 Continue`; bytes it does not take come again
+    static uint32_t upload_bytes, upload_sum;
+    upload_bytes = upload_sum = 0;
+    rest.post("/upload", []() {
+        char text[64];
+        snprintf(text, sizeof(text), "%u %u", (unsigned) upload_bytes, (unsigned) upload_sum);
+        rest.send(200, "text/plain", text);
+    }, [](const uint8_t* data, int length, uint32_t offset, uint32_t total) {
+        if (offset != upload_bytes) upload_sum = 0xFFFFFFFF; // Pieces must arrive in order
+        length = min(length, 1000);
+        for (int i = 0; i < length; i++) upload_sum += data[i];
+        upload_bytes += length;
+        return length;
+    });
+    std::string upload(40000, '\0');
+    uint32_t upload_expected = 0;
+    for (size_t i = 0; i < upload.size(); i++) { upload[i] = (char)(i * 7); upload_expected += (uint8_t) upload[i]; }
+    int sock = peer_connect();
+    host_peer_send(sock, "POST /upload HTTP/1.1\r\nHost: 192.168.1.100\r\nContent-Length: 40000\r\nExpect: 100-continue\r\nConnection: close\r\n\r\n");
+    std::string interim;
+    pump([&]() { interim += host_peer_recv(sock); return !interim.empty(); }, 5);
+    BENCH_CHECK(interim == "HTTP/1.1 100 Continue\r\n\r\n", "expect 100-continue: %s", interim.c_str());
+    for (size_t i = 0; i < upload.size(); i += 1460) {
+        host_peer_send(sock, upload.data() + i, min((size_t) 1460, upload.size() - i));
+        pump([]() { return false; }, 1);
+    }
+    pump([sock]() { return host_peer_status(sock) != SnSR::ESTABLISHED; }, 1000);
+    std::string res = host_peer_recv(sock);
+    char upload_result[32];
+    snprintf(upload_result, sizeof(upload_result), "\r\n\r\n40000 %u", (unsigned) upload_expected);
+    BENCH_CHECK(ends_with(res, upload_result), "streamed upload: %s", res.c_str());
+
+    // `Expect` to a missing endpoint is refused before the body is sent
+    sock = peer_connect();
+    host_peer_send(sock, "POST /nowhere HTTP/1.1\r\nHost: 192.168.1.100\r\nContent-Length: 40000\r\nExpect: 100-continue\r\n\r\n");
+    pump([sock]() { return host_peer_status(sock) != SnSR::ESTABLISHED; });
+    res = host_peer_recv(sock);
+    BENCH_CHECK(starts_with(res, "HTTP/1.1 404"), "expect to missing endpoint: %.40s", res.c_str());
+}
+
+static void check_slow_clients() {
+    // A 48 KB asset to a client that takes 2 KB per loop goes out over several loops without stalling any of them
+    static std::string asset(48 * 1024, '\0');
+    for (size_t i = 0; i < asset.size(); i++) asset[i] = (char)(i * 13);
+    rest.get("/asset.bin", []() { rest.sendStatic(200, "application/octet-stream", asset.data(), asset.size()); });
+    uint32_t worst_loop_us;
+    std::string stream = slow_exchange("/asset.bin", worst_loop_us);
+    BENCH_CHECK(starts_with(stream, "HTTP/1.1 200") && ends_with(stream, asset), "slow client asset: %u bytes", (unsigned) stream.size());
+    BENCH_CHECK(worst_loop_us < 1000, "slow client asset blocked a loop for %u us", worst_loop_us);
+
+    // A client that stops reading is dropped after HTTP_SEND_STALL_TIMEOUT_MS
+    int sock = peer_connect();
+    host_sockets[sock].tx_limit = 2048;
+    host_peer_send(sock, get_request("/asset.bin").c_str());
+    pump([]() { return false; }, 3);
+    BENCH_CHECK(host_peer_status(sock) == SnSR::ESTABLISHED, "stalled client closed early");
+    host_advance_ms(HTTP_SEND_STALL_TIMEOUT_MS + 10);
+    pump([sock]() { return host_peer_status(sock) != SnSR::ESTABLISHED; }, 5);
+    BENCH_CHECK(host_peer_status(sock) != SnSR::ESTABLISHED, "stalled client never dropped");
+    host_peer_recv(sock);
+}
+
+static void check_tx_overflow() {
+    // send() takes no more than the W5500 and the queue hold - a larger body is refused with a 500 before
+    // any of it goes out, and the same body generated by a sendStream() source reaches a slow client whole
+    rest.get("/report", []() {
+        std::string report(16 * 1024, 'r');
+        rest.send(200, "text/plain", report.c_str(), report.size());
+    });
+    rest.get("/report/stream", []() {
+        rest.sendStream(200, "text/plain", [](uint32_t position, uint8_t* buffer, int length) {
+            memset(buffer, 'r', length);
+            return length;
+        }, 0, 16 * 1024);
+    });
+    std::string res = http_exchange(get_request("/report").c_str());
+    BENCH_CHECK(starts_with(res, "HTTP/1.1 500 Internal Server Error\r\n") && ends_with(res, "\r\n\r\nResponse too large"), "oversized send(): %.60s", res.c_str());
+    uint32_t worst_loop_us;
+    std::string stream = slow_exchange("/report/stream", worst_loop_us);
+    BENCH_CHECK(starts_with(stream, "HTTP/1.1 200") && ends_with(stream, std::string(16 * 1024, 'r')) && worst_loop_us < 1000,
+        "generated body to a slow client: %u bytes, worst loop %u us", (unsigned) stream.size(), worst_loop_us);
+
+    // Chunks written by the handler in one go have to fit the TX queue - past it the response is cut short,
+    // without its last chunk, and the connection closed
+    rest.get("/lines/pushed", []() {
+        rest.beginChunked(200, "text/plain");
+        for (int line = 0; line < 2000; line++) rest.printfChunk("line %05d\n", line);
+        rest.endChunked();
+    });
+    res = http_exchange(get_request("/lines/pushed").c_str());
+    BENCH_CHECK(starts_with(res, "HTTP/1.1 200") && dechunk(res).empty() && !ends_with(res, "0\r\n\r\n"), "chunked body over the TX queue not cut short: %u bytes", (unsigned) res.size());
+}
+
+static void check_write_after_body() {
+    // Bytes written while a sendStatic() body is still going out wait behind it (here past its Content-Length,
+    // to see the order on the wire) - nothing is flushed blocking
+    static std::string body(24 * 1024, '\0');
+    for (size_t i = 0; i < body.size(); i++) body[i] = (char)(i * 11);
+    rest.get("/body/trailer", []() {
+        rest.sendStatic(200, "application/octet-stream", body.data(), body.size());
+        rest.write((uint8_t*) "<trailer>", 9);
+    });
+    uint32_t worst_loop_us;
+    std::string stream = slow_exchange("/body/trailer", worst_loop_us);
+    BENCH_CHECK(ends_with(stream, body + "<trailer>") && worst_loop_us < 1000, "write after sendStatic(): %u bytes, worst loop %u us", (unsigned) stream.size(), worst_loop_us);
+
+    // A second body while the first is pending can't be ordered behind it - the response is cut short
+    rest.get("/body/twice", []() {
+        rest.sendStatic(200, "application/octet-stream", body.data(), body.size());
+        rest.sendStatic(200, "application/octet-stream", body.data(), body.size());
+    });
+    stream = slow_exchange("/body/twice", worst_loop_us);
+    BENCH_CHECK(starts_with(stream, "HTTP/1.1 200") && stream.size() < 2 * body.size(), "second body after sendStatic(): %u bytes", (unsigned) stream.size());
+}
+
+static void check_assets() {
+    // A pre-compressed asset carries its validators; a revalidation with the same ETag gets a bodyless 304
+    static const char app_js[] = "\x1f\x8b\x08\x08gzip";
+    REST_SERVE_ASSET("/app.js", app_js, sizeof(app_js) - 1, true, "\"5d41402abc4b2a76\"");
+    std::string res = http_exchange("GET /app.js HTTP/1.1\r\nHost: 192.168.1.100\r\nAccept-Encoding: gzip, deflate, br\r\nConnection: close\r\n\r\n");
+    BENCH_CHECK(starts_with(res, "HTTP/1.1 200") && ends_with(res, app_js), "asset: %.40s", res.c_str());
+    BENCH_CHECK(res.find("Content-Encoding: gzip\r\n") != std::string::npos && res.find("ETag: \"5d41402abc4b2a76\"\r\n") != std::string::npos, "asset headers: %s", res.c_str());
+
+    // It only goes to clients that accept gzip - there is no identity copy to fall back to
+    const char* encodings[] = { "deflate, gzip;q=0.8", "*", "br;q=1.0, gzip; q=0", "identity", nullptr };
+    for (int i = 0; i < 5; i++) {
+        std::string request = "GET /app.js HTTP/1.1\r\nHost: 192.168.1.100\r\nConnection: close\r\n";
+        if (encodings[i] != nullptr) request += std::string("Accept-Encoding: ") + encodings[i] + "\r\n";
+        res = http_exchange((request + "\r\n").c_str());
+        bool accepted = i < 2;
+        BENCH_CHECK(starts_with(res, accepted ? "HTTP/1.1 200 OK\r\n" : "HTTP/1.1 406 Not Acceptable\r\n") && res.find("Vary: Accept-Encoding\r\n") != std::string::npos,
+            "Accept-Encoding: %s: %.40s", encodings[i] ? encodings[i] : "(none)", res.c_str());
+    }
+    res = http_exchange("GET /app.js HTTP/1.1\r\nHost: 192.168.1.100\r\nIf-None-Match: \"5d41402abc4b2a76\"\r\nConnection: close\r\n\r\n");
+    BENCH_CHECK(starts_with(res, "HTTP/1.1 304 Not Modified\r\n") && ends_with(res, "\r\n\r\n"), "asset revalidation: %s", res.c_str());
+    BENCH_CHECK(res.find("Content-Length") == std::string::npos && res.find("ETag: ") != std::string::npos, "asset 304 headers: %s", res.c_str());
+
+    // A generated asset index is served through one catch-all route with exact name matching
+    static MyFile asset_index[] = {
+        MyFile("/index.html", RestServer::hashUri("/index.html"), "<html>", 6, "text/html"),
+        MyFile("/css/site.css", RestServer::hashUri("/css/site.css"), "body{}", 6, "text/css"),
+        MyFile("/js/app.js", RestServer::hashUri("/js/app.js"), "main()", 6, "application/javascript"),
+    };
+    std::sort(std::begin(asset_index), std::end(asset_index), [](const MyFile& a, const MyFile& b) { return a.hash() < b.hash(); });
+    REST_SERVE_ASSETS(asset_index, 3);
+    res = http_exchange(get_request("/css/site.css").c_str());
+    BENCH_CHECK(starts_with(res, "HTTP/1.1 200") && res.find("Content-Type: text/css\r\n") != std::string::npos && ends_with(res, "body{}"), "indexed asset: %s", res.c_str());
+    res = http_exchange(get_request("/").c_str());
+    BENCH_CHECK(starts_with(res, "HTTP/1.1 200") && ends_with(res, "<html>"), "indexed asset remap: %s", res.c_str());
+    res = http_exchange(get_request("/js/app").c_str());
+    BENCH_CHECK(starts_with(res, "HTTP/1.1 404"), "indexed asset prefix: %.40s", res.c_str());
+    res = http_exchange(REQ_PING);
+    BENCH_CHECK(ends_with(res, "pong"), "exact route behind the asset index: %s", res.c_str());
+}
+
+static void check_flash_assets() {
+    // An asset bundle uploaded to the SPI flash is streamed from there and takes precedence over compiled-in files.
+    // Sectors are erased while the loop carries on, and the bundle in service stays until a new one is complete.
+    std::string compiled = http_exchange(get_request("/css/site.css").c_str());
+    std::string big(20000, '\0');
+    for (size_t i = 0; i < big.size(); i++) big[i] = (char)('a' + i % 26);
+    std::string bundle = asset_bundle({ { "/css/site.css", "body{color:red}" }, { "/index.html", "<html>flash" }, { "/big.txt", big } });
+    uint32_t upload_loop_us;
+    std::string res = finish_upload(start_upload(bundle), upload_loop_us);
+    BENCH_CHECK(starts_with(res, "HTTP/1.1 200") && ends_with(res, ("{\"files\":3,\"size\":" + std::to_string(bundle.size()) + "}").c_str()), "bundle upload: %s", res.c_str());
+    BENCH_CHECK(upload_loop_us < 1000, "bundle upload blocked a loop for %u us", upload_loop_us);
+    res = http_exchange(get_request("/css/site.css").c_str());
+    BENCH_CHECK(ends_with(res, "body{color:red}") && res.find("Content-Type: text/css\r\n") != std::string::npos, "flash asset: %s", res.c_str());
+    res = http_exchange(get_request("/").c_str());
+    BENCH_CHECK(ends_with(res, "<html>flash"), "flash asset remap: %s", res.c_str());
+    size_t etag = res.find("ETag: ");
+    std::string if_none_match = etag == std::string::npos ? "" : res.substr(etag + 6, res.find("\r\n", etag) - etag - 6);
+    res = http_exchange(("GET / HTTP/1.1\r\nHost: 192.168.1.100\r\nIf-None-Match: " + if_none_match + "\r\nConnection: close\r\n\r\n").c_str());
+    BENCH_CHECK(starts_with(res, "HTTP/1.1 304"), "flash asset revalidation: %.40s", res.c_str());
+    uint32_t worst_loop_us;
+    std::string stream = slow_exchange("/big.txt", worst_loop_us);
+    BENCH_CHECK(ends_with(stream, big) && worst_loop_us < 1000, "streamed flash asset: %u bytes, worst loop %u us", (unsigned) stream.size(), worst_loop_us);
+
+    std::string update = asset_bundle({ { "/css/site.css", "body{color:blue}" }, { "/index.html", "<html>update" }, { "/big.txt", big } });
+    std::string corrupt = update;
+    corrupt[corrupt.size() - 1] ^= 1;
+    int sock = start_upload(corrupt);
+    pump([]() { return false; }, 3);
+    res = http_exchange(get_request("/css/site.css").c_str());
+    BENCH_CHECK(ends_with(res, "body{color:red}"), "bundle in service during an upload: %s", res.c_str());
+    res = finish_upload(sock, upload_loop_us);
+    BENCH_CHECK(starts_with(res, "HTTP/1.1 400") && flash_assets_count == 3, "corrupt bundle accepted: %s", res.c_str());
+    res = http_exchange(get_request("/css/site.css").c_str());
+    BENCH_CHECK(ends_with(res, "body{color:red}"), "bundle in service after a corrupt upload: %s", res.c_str());
+    res = finish_upload(start_upload(update), upload_loop_us);
+    BENCH_CHECK(starts_with(res, "HTTP/1.1 200"), "bundle update: %s", res.c_str());
+    res = http_exchange(get_request("/css/site.css").c_str());
+    BENCH_CHECK(ends_with(res, "body{color:blue}"), "updated flash asset: %s", res.c_str());
+    flash_assets_load(); // As after a restart
+    res = http_exchange(get_request("/").c_str());
+    BENCH_CHECK(ends_with(res, "<html>update") && flash_assets_count == 3, "flash asset after a restart: %s", res.c_str());
+
+    // An upload leaves the slot it goes to alone while a response still streams the bundle that was there
+    sock = peer_connect();
+    host_sockets[sock].tx_limit = 2048;
+    host_peer_send(sock, get_request("/big.txt").c_str());
+    pump([]() { return false; }, 2);
+    stream = host_peer_recv(sock);
+    std::string third = asset_bundle({ { "/css/site.css", "body{color:green}" } });
+    res = finish_upload(start_upload(third), upload_loop_us);
+    BENCH_CHECK(starts_with(res, "HTTP/1.1 200"), "bundle upload during a flash stream: %s", res.c_str());
+    int upload_sock = start_upload(update);
+    for (int i = 0; i < 20; i++) {
+        xtp_loop();
+        host_advance_ms(5);
+    }
+    res = host_peer_recv(upload_sock);
+    BENCH_CHECK(res.empty() && flash_assets_count == 1, "slot erased under a flash stream: %s", res.c_str());
+    for (int i = 0; i < 200 && host_peer_status(sock) == SnSR::ESTABLISHED; i++) {
+        xtp_loop();
+        stream += host_peer_recv(sock);
+    }
+    stream += host_peer_recv(sock);
+    BENCH_CHECK(ends_with(stream, big), "flash stream across two uploads: %u bytes", (unsigned) stream.size());
+    res = finish_upload(upload_sock, upload_loop_us);
+    BENCH_CHECK(starts_with(res, "HTTP/1.1 200") && flash_assets_count == 3, "bundle upload after a flash stream: %s", res.c_str());
+
+    // A bundle that no longer matches its CRC is not served after a restart - the compiled-in files answer again
+    flash.writeByte(flash_assets_address + flash_assets_size - 1, 0);
+    flash_assets_load();
+    BENCH_CHECK(flash_assets_count == 0, "flash bundle with a bad CRC loaded: %d files", flash_assets_count);
+    res = http_exchange(get_request("/css/site.css").c_str());
+    BENCH_CHECK(res == compiled, "compiled asset after the bundle was dropped: %s", res.c_str());
+
+    // Slots that don't fit the chip are not used
+    int flash_size = flashInfo.size;
+    flashInfo.size = FLASH_ASSETS_ADDRESS + 2 * FLASH_ASSETS_SIZE - FLASH_SECTOR_SIZE;
+    flash_assets_load();
+    res = finish_upload(start_upload(update), upload_loop_us);
+    BENCH_CHECK(starts_with(res, "HTTP/1.1 400") && flash_assets_count == 0, "bundle upload past the flash capacity: %s", res.c_str());
+    flashInfo.size = flash_size;
+    flash_assets_load();
+}
+
+static void check_keep_alive() {
+    // Persistent connection: several requests on one socket, then three pipelined ones
+    int sock = peer_connect();
+    for (int i = 0; i < 3; i++) {
+        std::string res = keep_alive_exchange(sock, REQ_PING_KEEP_ALIVE);
+        BENCH_CHECK(starts_with(res, "HTTP/1.1 200"), "keep-alive #%d: %.40s", i, res.c_str());
+        BENCH_CHECK(res.find("Connection: keep-alive") != std::string::npos, "keep-alive #%d header: %s", i, res.c_str());
+        BENCH_CHECK(host_peer_status(sock) == SnSR::ESTABLISHED, "keep-alive #%d closed the socket", i);
+    }
+    std::string pipelined = std::string(REQ_PING_KEEP_ALIVE) + REQ_MISSING + REQ_PING_KEEP_ALIVE;
+    host_peer_send(sock, pipelined.c_str());
+    std::string stream;
+    pump([sock, &stream]() { stream += host_peer_recv(sock); return host_peer_status(sock) != SnSR::ESTABLISHED; });
+    std::vector<std::string> responses = take_responses(stream);
+    BENCH_CHECK(responses.size() == 2, "pipelined: %d responses before close (%s)", (int) responses.size(), stream.c_str());
+    if (responses.size() == 2) {
+        BENCH_CHECK(starts_with(responses[0], "HTTP/1.1 200") && ends_with(responses[0], "pong"), "pipelined #0: %s", responses[0].c_str());
+        BENCH_CHECK(starts_with(responses[1], "HTTP/1.1 404"), "pipelined #1: %s", responses[1].c_str());
+        BENCH_CHECK(responses[1].find("Connection: close") != std::string::npos, "pipelined #1 should close: %s", responses[1].c_str());
+    }
+
+    // Idle keep-alive connections time out
+    sock = peer_connect();
+    keep_alive_exchange(sock, REQ_PING_KEEP_ALIVE);
+    BENCH_CHECK(host_peer_status(sock) == SnSR::ESTABLISHED, "keep-alive closed after one request");
+    host_advance_ms(HTTP_KEEP_ALIVE_TIMEOUT_MS + 10);
+    pump([sock]() { return host_peer_status(sock) != SnSR::ESTABLISHED; });
+    BENCH_CHECK(host_peer_status(sock) != SnSR::ESTABLISHED, "idle keep-alive connection never closed");
+
+    // A client that connects and stays silent must not hold up the next one
+    int idle = peer_connect();
+    pump([]() { return false; }, 2);
+    Sample s;
+    std::string res = http_exchange(REQ_PING, &s);
+    BENCH_CHECK(starts_with(res, "HTTP/1.1 200"), "ping behind idle client: %.40s", res.c_str());
+    BENCH_CHECK(s.loops <= 4, "ping behind idle client took %u loops", s.loops);
+    BENCH_CHECK(host_peer_status(idle) == SnSR::ESTABLISHED, "idle client closed early");
+    host_advance_ms(HTTP_CLIENT_TIMEOUT_MS + 10);
+    pump([idle]() { return host_peer_status(idle) != SnSR::ESTABLISHED; });
+    BENCH_CHECK(host_peer_status(idle) != SnSR::ESTABLISHED, "idle client never timed out");
+}
+
+static void check_deferred() {
+    // A deferred handler answers on a later loop, from its poll function or through resume()/complete()
+    static bool deferred_ready = false;
+    static RestServer::Deferred deferred;
+    rest.get("/deferred/poll", []() {
+        rest.defer([](void* context) {
+            if (!*(bool*) context) return false;
+            rest.send(200, "text/plain", "polled");
+            return true;
+        }, &deferred_ready);
+    });
+    rest.get("/deferred/resume", []() { deferred = rest.defer(); });
+    int sock = peer_connect();
+    host_peer_send(sock, get_request("/deferred/poll").c_str());
+    pump([]() { return false; }, 3);
+    BENCH_CHECK(host_peer_status(sock) == SnSR::ESTABLISHED && host_peer_recv(sock).empty(), "deferred request answered early");
+    deferred_ready = true;
+    pump([sock]() { return host_peer_status(sock) != SnSR::ESTABLISHED; });
+    std::string res = host_peer_recv(sock);
+    BENCH_CHECK(starts_with(res, "HTTP/1.1 200") && ends_with(res, "\r\n\r\npolled"), "deferred poll: %s", res.c_str());
+
+    sock = peer_connect();
+    host_peer_send(sock, get_request("/deferred/resume").c_str());
+    pump([]() { return deferred.valid(); });
+    res = http_exchange(REQ_PING);
+    BENCH_CHECK(ends_with(res, "pong"), "ping while a request is deferred: %s", res.c_str());
+    if (rest.resume(deferred)) {
+        rest.send(200, "text/plain", "resumed");
+        rest.complete();
+    }
+    pump([sock]() { return host_peer_status(sock) != SnSR::ESTABLISHED; });
+    res = host_peer_recv(sock);
+    BENCH_CHECK(ends_with(res, "\r\n\r\nresumed"), "deferred resume: %s", res.c_str());
+    BENCH_CHECK(!rest.resume(deferred), "completed deferred request resumed again");
+
+    deferred_ready = false;
+    sock = peer_connect();
+    host_peer_send(sock, get_request("/deferred/poll").c_str());
+    pump([]() { return false; }, 3);
+    host_advance_ms(HTTP_DEFERRED_TIMEOUT_MS + 10);
+    pump([sock]() { return host_peer_status(sock) != SnSR::ESTABLISHED; });
+    res = host_peer_recv(sock);
+    BENCH_CHECK(starts_with(res, "HTTP/1.1 504 Gateway Timeout\r\n"), "deferred timeout: %.40s", res.c_str());
+}
+
+static void check_admission() {
+    // A dashboard polling 8 endpoints at 10 Hz from one client is never limited under the default config
+    uint32_t limited, shed;
+    rest.getAdmissionStats(limited, shed);
+    uint32_t limited_before = limited;
+    IPAddress dashboard(192, 168, 1, 21);
+    int polls_ok = 0;
+    for (int i = 0; i < 50 * 8; i++) {
+        char uri[32];
+        snprintf(uri, sizeof(uri), "/api/io/%d", i % 8);
+        std::string res = http_exchange(get_request(uri).c_str(), nullptr, dashboard);
+        if (starts_with(res, "HTTP/1.1 200 OK\r\n")) polls_ok++;
+        host_advance_ms(100 / 8);
+    }
+    rest.getAdmissionStats(limited, shed);
+    BENCH_CHECK(polls_ok == 50 * 8 && limited == limited_before, "dashboard poller: %d/%d answered, %u limited", polls_ok, 50 * 8, limited - limited_before);
+
+    // A client over its request rate is turned away with a pre-rendered 429 without affecting other clients
+    IPAddress poller(192, 168, 1, 20);
+    rest.setRateLimit(1, 2);
+    rest.getAdmissionStats(limited, shed);
+    for (int i = 0; i < 2; i++) {
+        std::string res = http_exchange(REQ_PING, nullptr, poller);
+        BENCH_CHECK(ends_with(res, "pong"), "rate limited ping #%d: %.40s", i, res.c_str());
+    }
+    std::string res = http_exchange(REQ_PING, nullptr, poller);
+    BENCH_CHECK(res == HTTP_RESPONSE_TOO_MANY_REQUESTS, "client over its rate: %s", res.c_str());
+    res = http_exchange(REQ_PING);
+    BENCH_CHECK(ends_with(res, "pong"), "other client while one is limited: %.40s", res.c_str());
+    host_advance_ms(1000);
+    res = http_exchange(REQ_PING, nullptr, poller);
+    BENCH_CHECK(ends_with(res, "pong"), "rate limit bucket never refilled: %.40s", res.c_str());
+    limited_before = limited;
+    rest.getAdmissionStats(limited, shed);
+    BENCH_CHECK(limited == limited_before + 1, "%u requests counted as limited", limited - limited_before);
+    rest.setRateLimit(HTTP_RATE_LIMIT_RPS, HTTP_RATE_LIMIT_BURST);
+
+    // Under the default config a loop full of HTTP work sheds nothing; with a load limit set, it sheds
+    // new requests with 503 until a window stays under it
+    rest.get("/slow", []() {
+        host_advance_ms(HTTP_LOAD_WINDOW_MS + 20);
+        rest.send(200, "text/plain", "slow");
+    });
+    rest.getAdmissionStats(limited, shed);
+    uint32_t shed_before = shed;
+    http_exchange(get_request("/slow").c_str());
+    res = http_exchange(REQ_PING);
+    rest.getAdmissionStats(limited, shed);
+    BENCH_CHECK(ends_with(res, "pong") && shed == shed_before, "request after a busy window under the default config: %.40s", res.c_str());
+    rest.setLoadLimit(50);
+    res = http_exchange(get_request("/slow").c_str());
+    BENCH_CHECK(ends_with(res, "slow"), "slow handler: %.40s", res.c_str());
+    res = http_exchange(REQ_PING);
+    BENCH_CHECK(res == HTTP_RESPONSE_SERVICE_UNAVAILABLE, "request while overloaded: %s", res.c_str());
+    host_advance_ms(HTTP_LOAD_WINDOW_MS + 10);
+    pump([]() { return false; }, 2);
+    res = http_exchange(REQ_PING);
+    BENCH_CHECK(ends_with(res, "pong"), "load shedding never stopped: %.40s", res.c_str());
+    rest.setLoadLimit(HTTP_LOAD_LIMIT_PERCENT);
+}
+
+static void check_access_log() {
+    // Finished requests go to the access log ring and reach Serial a line at a time in the background
+    uint32_t next = rest._access_log.written;
+    http_exchange(REQ_PING);
+    std::string res = http_exchange(get_request(("/api/access-log?since=" + std::to_string(next)).c_str()).c_str());
+    std::string body = dechunk(res);
+    BENCH_CHECK(starts_with(body, ("{\"entries\":[{\"id\":" + std::to_string(next)).c_str()) && ends_with(body, ("],\"next\":" + std::to_string(next + 1) + "}").c_str()), "access log: %s", body.c_str());
+    BENCH_CHECK(body.find("\"ip\":\"192.168.1.10\",\"method\":\"GET\",\"uri\":\"/ping\",\"status\":200,") != std::string::npos && body.find("\"aborted\":false}]") != std::string::npos, "access log entry: %s", body.c_str());
+    BENCH_CHECK(rest._access_log.printed == rest._access_log.written, "access log %u records behind on Serial", rest._access_log.written - rest._access_log.printed);
+}
+
+static void check_methods() {
+    // PUT and DELETE routes; methods the server does not know are still refused
+    rest.put("/api/item", []() { rest.send(200, "text/plain", rest.body); });
+    rest.del("/api/item", []() { rest.send(204, "text/plain", ""); });
+    std::string res = http_exchange("PUT /api/item HTTP/1.1\r\nContent-Length: 5\r\nConnection: close\r\n\r\nvalue");
+    BENCH_CHECK(ends_with(res, "\r\n\r\nvalue"), "PUT: %s", res.c_str());
+    res = http_exchange("DELETE /api/item HTTP/1.1\r\nConnection: close\r\n\r\n");
+    BENCH_CHECK(starts_with(res, "HTTP/1.1 204 No Content\r\n"), "DELETE: %.40s", res.c_str());
+    res = http_exchange("PATCH /api/item HTTP/1.1\r\nConnection: close\r\n\r\n");
+    BENCH_CHECK(starts_with(res, "HTTP/1.1 405"), "unknown method: %.40s", res.c_str());
+
+    // HEAD runs the GET route without sending the body, and the connection stays usable
+    int sock = peer_connect();
+    host_peer_send(sock, "HEAD /ping HTTP/1.1\r\nHost: 192.168.1.100\r\n\r\n");
+    std::string stream;
+    pump([&]() { stream += host_peer_recv(sock); return ends_with(stream, "\r\n\r\n"); });
+    pump([]() { return false; }, 2);
+    stream += host_peer_recv(sock);
+    BENCH_CHECK(starts_with(stream, "HTTP/1.1 200") && stream.find("Content-Length: 4\r\n") != std::string::npos && ends_with(stream, "\r\n\r\n"), "HEAD: %s", stream.c_str());
+    res = keep_alive_exchange(sock, REQ_PING_KEEP_ALIVE);
+    BENCH_CHECK(ends_with(res, "\r\n\r\npong"), "GET after HEAD: %s", res.c_str());
+
+    // With CORS on, a preflight is answered without routing and keeps the connection; responses carry the origin
+    rest.enableCors("*");
+    host_peer_send(sock, "OPTIONS /api/item HTTP/1.1\r\nOrigin: http://dashboard\r\nAccess-Control-Request-Method: PUT\r\n\r\n");
+    stream.clear();
+    pump([&]() { stream += host_peer_recv(sock); return ends_with(stream, "\r\n\r\n"); });
+    BENCH_CHECK(starts_with(stream, "HTTP/1.1 204 No Content\r\n") && stream.find("Access-Control-Allow-Methods: GET, POST, PUT, DELETE, HEAD, OPTIONS\r\n") != std::string::npos
+        && stream.find("Access-Control-Allow-Origin: *\r\n") != std::string::npos && stream.find("Connection: keep-alive") != std::string::npos, "preflight: %s", stream.c_str());
+    res = keep_alive_exchange(sock, REQ_PING_KEEP_ALIVE);
+    BENCH_CHECK(res.find("Access-Control-Allow-Origin: *\r\n") != std::string::npos && ends_with(res, "pong"), "CORS response: %s", res.c_str());
+    rest.disableCors();
+    res = keep_alive_exchange(sock, REQ_PING_KEEP_ALIVE);
+    BENCH_CHECK(res.find("Access-Control") == std::string::npos, "CORS header after disableCors(): %s", res.c_str());
+    host_peer_close(sock);
+
+    // Header lookup ignores case and keeps values whole (they used to be cut at 63 characters)
+    rest.get("/api/header", []() {
+        const char* value = rest.readHeader("x-trace-id");
+        rest.send(200, "text/plain", value != nullptr ? value : "missing");
+    });
+    std::string trace(100, 't');
+    res = http_exchange(("GET /api/header HTTP/1.1\r\nUser-Agent: bench\r\nX-Trace-ID: " + trace + "\r\nConnection: close\r\n\r\n").c_str());
+    BENCH_CHECK(ends_with(res, ("\r\n\r\n" + trace).c_str()), "header lookup: %s", res.c_str());
+}
+
+static void check_batch() {
+    // Batched GETs run in-process: text bodies become JSON strings, JSON bodies are embedded as they are
+    rest.get("/api/quote", []() { rest.send(200, "text/plain", "say \"hi\"\n"); });
+    std::string batch = "[\"/ping\",\"/api/i2c-status\",\"/api/quote\",\"/api/io/7?mode=out\"]";
+    std::string res = http_exchange(("POST /api/batch HTTP/1.1\r\nContent-Length: " + std::to_string(batch.size()) + "\r\nConnection: close\r\n\r\n" + batch).c_str());
+    std::string body = dechunk(res);
+    BENCH_CHECK(starts_with(body, "[{\"path\":\"/ping\",\"status\":200,\"type\":\"text/plain\",\"body\":\"pong\"},{\"path\":\"/api/i2c-status\",\"status\":200,\"type\":\"application/json\",\"body\":{")
+        && body.find("},{\"path\":\"/api/quote\",\"status\":200,\"type\":\"text/plain\",\"body\":\"say \\\"hi\\\"\\n\"}") != std::string::npos
+        && ends_with(body, ",{\"path\":\"/api/io/7\",\"status\":200,\"type\":\"text/plain\",\"body\":\"io 7 mode=out\"}]"), "batch: %s", res.c_str());
+    res = http_exchange(get_request("/api/batch?paths=/ping,/missing").c_str());
+    body = dechunk(res);
+    BENCH_CHECK(starts_with(body, "[{\"path\":\"/ping\",\"status\":200,") && body.find("{\"path\":\"/missing\",\"status\":404,") != std::string::npos && ends_with(body, "}]"), "batch GET: %s", res.c_str());
+}
+
+static void check_events() {
+    // Event streams: published events go out as the socket takes them, a client that falls behind loses
+    // the oldest queued ones (never the latest), and an idle stream gets a comment line now and then
+    static int events = -1;
+    rest.get("/events", []() { events = rest.beginEvents(); });
+    int sock = peer_connect();
+    host_peer_send(sock, get_request("/events").c_str());
+    pump([]() { return rest.eventStreams() > 0; }, 20);
+    pump([]() { return false; }, 2);
+    std::string res = host_peer_recv(sock);
+    BENCH_CHECK(starts_with(res, "HTTP/1.1 200") && res.find("Content-Type: text/event-stream\r\n") != std::string::npos && events >= 0, "event stream: %s", res.c_str());
+    BENCH_CHECK(rest.broadcastEvent("hello\nworld", "status") == 1, "broadcast to one stream");
+    pump([]() { return false; }, 2);
+    res = host_peer_recv(sock);
+    BENCH_CHECK(res == "event: status\ndata: hello\ndata: world\n\n", "event: %s", res.c_str());
+    host_sockets[sock].tx_limit = 1;
+    for (int i = 0; i < 200; i++) {
+        char data[16];
+        snprintf(data, sizeof(data), "event %03d", i);
+        rest.sendEvent(events, data);
+        pump([]() { return false; }, 1);
+    }
+    host_sockets[sock].tx_limit = 0;
+    pump([]() { return false; }, 5);
+    res = host_peer_recv(sock);
+    BENCH_CHECK(res.find("data: event 000\n\n") != std::string::npos && res.find("data: event 100\n\n") == std::string::npos
+        && ends_with(res, "data: event 199\n\n") && rest._streams[events].queue.dropped > 0, "event backpressure: %s", res.c_str());
+    host_advance_ms(HTTP_SSE_HEARTBEAT_MS);
+    pump([]() { return false; }, 2);
+    res = host_peer_recv(sock);
+    BENCH_CHECK(res == ":\n\n", "event heartbeat: %s", res.c_str());
+    rest.endEvents(events);
+    BENCH_CHECK(!rest.sendEvent(events, "late") && rest.broadcastEvent("late") == 0, "event queued to a closing stream");
+    pump([sock]() { return host_peer_status(sock) != SnSR::ESTABLISHED; }, 5);
+    BENCH_CHECK(host_peer_status(sock) != SnSR::ESTABLISHED && rest.eventStreams() == 0 && !rest.sendEvent(events, "late"), "event stream not closed");
+    host_peer_recv(sock);
+}
+
+static void check_websockets() {
+    // Wildcard subscriptions are resolved to topic IDs, including topics registered after the subscription
+    WsTopic temperature = wsServer.addTopic("io/1/temp");
+    int sock = ws_connect();
+    BENCH_CHECK(sock >= 0, "websocket handshake failed");
+    ws_send_text(sock, "{\"action\":\"sub\",\"topic\":\"io/+/state\"}");
+    pump([]() { return false; }, 5);
+    ws_send_text(sock, "{\"action\":\"sub\",\"topic\":\"sys/#\"}");
+    pump([]() { return false; }, 5);
+    WsTopic state = wsServer.addTopic("io/2/state");
+    BENCH_CHECK(WebSocketServer::topicMatches("sys/#", "sys") && !WebSocketServer::topicMatches("io/+/state", "io/2/state/x"), "topic wildcards");
+    wsServer.emit(state, "state");
+    wsServer.emit(temperature, "temp");
+    wsServer.emit("sys/boot/count", "boot");
+    wsServer.emit("io/3/temp", "other");
+    pump([]() { return false; }, 5);
+    std::string stream = host_peer_recv(sock);
+    std::vector<std::string> frames = ws_take_frames(stream);
+    BENCH_CHECK(frames.size() == 2 && frames[0] == "state" && frames[1] == "boot", "topic fan-out: %d frames, first %s", (int) frames.size(), frames.empty() ? "-" : frames[0].c_str());
+    BENCH_CHECK(wsServer.findTopic("sys/boot/count") < 0 && wsServer.findTopic("io/3/temp") < 0 && wsServer.findTopic("io/+/state") < 0, "topic interned on emit");
+
+    // Only the application registers topics: a client subscription is matched by name until it does
+    ws_send_text(sock, "{\"action\":\"sub\",\"topic\":\"dev/9/alarm\"}");
+    pump([]() { return false; }, 5);
+    BENCH_CHECK(wsServer.findTopic("dev/9/alarm") < 0, "client subscription interned a topic");
+    wsServer.emit("dev/9/alarm", "alarm");
+    wsServer.emit(wsServer.addTopic("dev/9/alarm"), "alarm by id");
+    pump([]() { return false; }, 5);
+    stream = host_peer_recv(sock);
+    frames = ws_take_frames(stream);
+    BENCH_CHECK(frames.size() == 2 && frames[0] == "alarm" && frames[1] == "alarm by id", "unregistered topic: %d frames", (int) frames.size());
+
+    // Event properties past WS_MAX_EVENT_PROPS still take part in filtering, for registered topics and not
+    wsServer.setMessageHandler([](WebSocketClient& c, const char* msg, uint16_t len) {
+        WsProperty filter = { "last", "yes" };
+        wsServer.subscribe(c, "dev/+/props", &filter, 1);
+    });
+    ws_send_text(sock, "props");
+    pump([]() { return false; }, 5);
+    wsServer.setMessageHandler(xtp_ws_default_handler);
+    WsProperty props[WS_MAX_EVENT_PROPS + 2];
+    for (int i = 0; i < WS_MAX_EVENT_PROPS + 2; i++) snprintf(props[i].key, WS_KEY_LEN, "p%d", i);
+    for (int i = 0; i < WS_MAX_EVENT_PROPS + 2; i++) strcpy(props[i].value, "no");
+    strcpy(props[WS_MAX_EVENT_PROPS + 1].key, "last");
+    wsServer.emitWithProps(wsServer.addTopic("dev/1/props"), "registered filtered out", props, WS_MAX_EVENT_PROPS + 2);
+    wsServer.emitWithProps("dev/2/props", "by name filtered out", props, WS_MAX_EVENT_PROPS + 2);
+    strcpy(props[WS_MAX_EVENT_PROPS + 1].value, "yes");
+    wsServer.emitWithProps("dev/1/props", "registered", props, WS_MAX_EVENT_PROPS + 2);
+    wsServer.emitWithProps("dev/2/props", "by name", props, WS_MAX_EVENT_PROPS + 2);
+    pump([]() { return false; }, 5);
+    stream = host_peer_recv(sock);
+    frames = ws_take_frames(stream);
+    BENCH_CHECK(frames.size() == 2 && frames[0] == "registered" && frames[1] == "by name", "filter on event property %d: %d frames, first %s",
+        WS_MAX_EVENT_PROPS + 2, (int) frames.size(), frames.empty() ? "-" : frames[0].c_str());
+
+    // Filter keys are compared by name until the application registers them, never interned by a subscription
+    BENCH_CHECK(wsServer.findPropKey("last") < 0, "subscription filter interned a property key");
+    WsProperty last = { "last", "yes" };
+    int8_t last_key = wsServer.addPropKey("last");
+    wsServer.emitWithProps("dev/1/props", "registered key", &last, 1);
+    strcpy(last.value, "no");
+    wsServer.emitWithProps("dev/1/props", "registered key filtered out", &last, 1);
+    pump([]() { return false; }, 5);
+    stream = host_peer_recv(sock);
+    frames = ws_take_frames(stream);
+    BENCH_CHECK(last_key >= 0 && frames.size() == 1 && frames[0] == "registered key", "registered property key: %d frames", (int) frames.size());
+    static bool long_pattern_refused = false;
+    wsServer.setMessageHandler([](WebSocketClient& c, const char* msg, uint16_t len) {
+        long_pattern_refused = wsServer.subscribe(c, std::string(WS_TOPIC_LEN, 't').c_str()) == nullptr;
+    });
+    ws_send_text(sock, "long");
+    pump([]() { return false; }, 5);
+    wsServer.setMessageHandler(xtp_ws_default_handler);
+    BENCH_CHECK(long_pattern_refused, "subscription pattern of WS_TOPIC_LEN characters accepted");
+
+    // A broadcast is framed once and shared: the slot stays taken until the slowest recipient has sent it
+    int slow = ws_connect();
+    ws_send_text(slow, "{\"action\":\"sub\",\"topic\":\"io/+/state\"}");
+    pump([]() { return false; }, 5);
+    host_peer_recv(slow);
+    host_sockets[slow].tx_limit = 1;
+    std::string big(200, 'x');
+    wsServer.emit(state, big.c_str());
+    wsServer.emitBinary(state, "\x01\x02", 2);
+    pump([]() { return false; }, 5);
+    BENCH_CHECK(wsServer.sharedFramesInUse() == 2, "shared frames while a client lags: %d", wsServer.sharedFramesInUse());
+    host_sockets[slow].tx_limit = 0;
+    pump([]() { return false; }, 5);
+    stream = host_peer_recv(sock);
+    std::string slow_stream = host_peer_recv(slow);
+    BENCH_CHECK(stream == slow_stream && ws_take_frames(stream).size() == 2 && stream.empty() && wsServer.sharedFramesInUse() == 0,
+        "shared broadcast: %d vs %d bytes, %d frames in use", (int) stream.size(), (int) slow_stream.size(), wsServer.sharedFramesInUse());
+    host_peer_close(sock);
+    host_peer_close(slow);
+    pump([]() { return false; }, 5);
+}
+
+static void bench_requests(Stats& stats, const char* request, int count) {
+    for (int i = 0; i < count; i++) {
+        Sample s;
+        std::string res = http_exchange(request, &s);
+        BENCH_CHECK(!res.empty(), "%s: empty response on iteration %d", stats.name, i);
+        stats.samples.push_back(s);
+    }
+}
+
+// `clients` connections send their request together; one sample per batch
+static void bench_parallel(Stats& stats, const char* request, int clients, int count) {
+    for (int i = 0; i < count; i++) {
+        std::vector<int> socks;
+        Sample s;
+        uint64_t spi_f = host_spi.frames, spi_b = host_spi.bytes, ser = Serial.host_bytes;
+        uint64_t t0 = now_ns();
+        for (int c = 0; c < clients; c++) {
+            int sock = peer_connect();
+            if (sock < 0) break;
+            socks.push_back(sock);
+        }
+        for (int sock : socks) host_peer_send(sock, request);
+        Sample rest = pump([&socks]() {
+            for (int sock : socks) if (host_peer_status(sock) == SnSR::ESTABLISHED) return false;
+            return true;
+        }, 500);
+        s.cpu_ns = now_ns() - t0;
+        s.loops = rest.loops;
+        s.spi_frames = host_spi.frames - spi_f;
+        s.spi_bytes = host_spi.bytes - spi_b;
+        s.serial_bytes = Serial.host_bytes - ser;
+        stats.samples.push_back(s);
+        BENCH_CHECK((int) socks.size() == clients, "%s: only %d of %d clients connected", stats.name, (int) socks.size(), clients);
+        for (int sock : socks) {
+            std::string res = host_peer_recv(sock);
+            BENCH_CHECK(starts_with(res, "HTTP/1.1 200"), "%s: %.40s", stats.name, res.c_str());
+        }
+    }
+}
+
+// Requests over one persistent connection (reconnecting when the server hits its cap)
+static void bench_keep_alive(Stats& stats, const char* request, int count) {
+    int sock = -1;
+    for (int i = 0; i < count; i++) {
+        if (sock < 0 || host_peer_status(sock) != SnSR::ESTABLISHED) sock = peer_connect();
+        Sample s;
+        std::string res = keep_alive_exchange(sock, request, &s);
+        BENCH_CHECK(starts_with(res, "HTTP/1.1 200"), "%s: %.40s on iteration %d", stats.name, res.c_str(), i);
+        stats.samples.push_back(s);
+    }
+    if (sock >= 0) host_peer_close(sock);
+    pump([sock]() { return host_peer_status(sock) != SnSR::CLOSE_WAIT; });
+}
+
+static void bench_idle(Stats& stats, int count) {
+    for (int i = 0; i < count; i++) {
+        stats.samples.push_back(pump([]() { return false; }, 1));
+    }
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+// Route lookup cost with `routes` registered endpoints: the hashed table used by
+// RestServer against the linear strcmp/remap scan it replaced
+static void bench_dispatch(int routes, int lookups) {
+    std::unique_ptr<RestServer> router(new RestServer(server));
+    std::vector<std::string> uris;
+    for (int i = 0; i < routes; i++) uris.push_back("/api/route/" + std::to_string(i));
+    for (int i = 0; i < routes; i++) router->on(uris[i].c_str(), i % 4 ? HTTP_GET : HTTP_POST, []() {});
+    router->remap("/", uris[routes - 1].c_str());
+    BENCH_CHECK(router->endpointCount() == routes, "only %d of %d routes registered", router->endpointCount(), routes);
+
+    auto linear = [&](const char* uri, HTTPMethod method) -> RestServer::Endpoint* {
+        for (int i = 0; i < router->_endpoints_count; i++) {
+            RestServer::Endpoint& endpoint = router->_endpoints[i];
+            bool uri_match = strcmp(endpoint.uri, uri) == 0;
+            if (!uri_match) {
+                for (int r = 0; r < router->_remaps_count; r++) {
+                    if (strcmp(router->_remaps[r].from, uri) == 0) { uri_match = strcmp(endpoint.uri, router->_remaps[r].to) == 0; break; }
+                }
+            }
+            if (uri_match && endpoint.method == method) return &endpoint;
+        }
+        return nullptr;
+    };
+
+    // Every route, the remapped root and a miss
+    std::vector<std::pair<const char*, HTTPMethod>> requests;
+    for (int i = 0; i < routes; i++) requests.push_back({ uris[i].c_str(), i % 4 ? HTTP_GET : HTTP_POST });
+    requests.push_back({ "/", (routes - 1) % 4 ? HTTP_GET : HTTP_POST });
+    requests.push_back({ "/api/route/missing", HTTP_GET });
+    for (auto& req : requests) {
+        BENCH_CHECK(router->resolveEndpoint(req.first, req.second) == linear(req.first, req.second), "dispatch mismatch for %s", req.first);
+    }
+
+    volatile uintptr_t sink = 0;  // keeps the lookups from being optimized out
+    uint64_t start = now_ns();
+    for (int i = 0; i < lookups; i++) { auto& req = requests[i % requests.size()]; sink += (uintptr_t) linear(req.first, req.second); }
+    double linear_ns = (double)(now_ns() - start) / lookups;
+    start = now_ns();
+    for (int i = 0; i < lookups; i++) { auto& req = requests[i % requests.size()]; sink += (uintptr_t) router->resolveEndpoint(req.first, req.second); }
+    double hashed_ns = (double)(now_ns() - start) / lookups;
+    printf("  %-28s %8d %10.1f %10.1f\n", "route dispatch (ns/lookup)", routes, linear_ns, hashed_ns);
+}
+
+// WebSocket TX path: the ring alone (against the former byte-at-a-time ring with a chunk copy), then
+// frames streamed to one subscriber through the shim, with the SPI time the W5500 would need for them
+static void bench_ws_tx(int messages) {
+    static uint8_t legacy[WS_TX_BUFFER_SIZE], chunk[WS_TX_CHUNK_SIZE];
+    static WsTxBuffer ring;
+    std::string payload(1000, 'w');
+    const uint8_t* data = (const uint8_t*) payload.data();
+    uint32_t head = 0, tail = 0;
+    volatile uint32_t sink = 0;
+    uint64_t start = now_ns();
+    for (int m = 0; m < messages; m++) {
+        for (size_t i = 0; i < payload.size(); i++) {
+            legacy[head] = data[i];
+            head = (head + 1) % WS_TX_BUFFER_SIZE;
+        }
+        uint32_t count = 0;
+        while (tail != head) {
+            chunk[count++] = legacy[tail];
+            tail = (tail + 1) % WS_TX_BUFFER_SIZE;
+        }
+        sink += chunk[count - 1];
+    }
+    printf("\n  %-28s %8s %10s %10s\n", "", "message", "bytewise", "memcpy");
+    double legacy_mbs = (double) messages * payload.size() * 1000.0 / (now_ns() - start);
+    start = now_ns();
+    for (int m = 0; m < messages; m++) {
+        ring.write(data, payload.size());
+        while (!ring.isEmpty()) {
+            uint16_t len;
+            const uint8_t* span = ring.span(len);
+            sink += span[len - 1];
+            ring.consume(len);
+        }
+    }
+    double ring_mbs = (double) messages * payload.size() * 1000.0 / (now_ns() - start);
+    printf("  %-28s %8s %10.1f %10.1f\n", "ws tx ring (MB/s)", "1000 B", legacy_mbs, ring_mbs);
+
+    int sock = ws_connect();
+    BENCH_CHECK(sock >= 0, "websocket handshake failed");
+    ws_send_text(sock, "{\"action\":\"sub\",\"topic\":\"bench/stream\"}");
+    pump([]() { return false; }, 5);
+    WsTopic topic = wsServer.addTopic("bench/stream");
+    uint64_t received = 0, spi_bytes = host_spi.bytes, cpu_ns = 0;
+    // Three frames a loop stay within the four chunks processTx() writes per pass
+    for (int m = 0; m < messages; m += 3) {
+        for (int i = 0; i < 3; i++) wsServer.emit(topic, payload.c_str());
+        uint64_t t0 = now_ns();
+        xtp_loop();
+        cpu_ns += now_ns() - t0;
+        received += host_peer_recv(sock).size();
+    }
+    pump([]() { return false; }, 5);
+    received += host_peer_recv(sock).size();
+    BENCH_CHECK(received == (uint64_t) ((messages + 2) / 3 * 3) * (payload.size() + 4), "ws stream: %llu bytes", (unsigned long long) received);
+    double spi_s = (double) (host_spi.bytes - spi_bytes) * 8 / ETH_SPI_SPEED;
+    printf("  %-28s %8s %10s %10s\n", "", "", "cpu", "spi");
+    printf("  %-28s %8s %10.1f %10.1f\n", "ws stream (MB/s)", "1000 B", received / 1e6 / (cpu_ns / 1e9), received / 1e6 / spi_s);
+    host_peer_close(sock);
+    pump([]() { return false; }, 5);
+}
+
+int main(int argc, char** argv) {
+    bool smoke = false;
+    int requests = 2000;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--smoke") == 0) smoke = true;
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) requests = atoi(argv[++i]);
+    }
+    if (smoke) requests = 50;
+
+    ethState.onStateChange = []() { app_state_changes++; };
+    xtp_setup();
+    pump([]() { return ethState.isReady(); }, 10000);
+    BENCH_CHECK(ethState.isReady(), "ethernet never became ready (state %s)", ethState.getStateName());
+
+    bench_routes();
+    check_basic();
+    check_chunked();
+    check_status_cache();
+    check_route_stats();
+    check_routing();
+    check_request_parsing();
+    check_uploads();
+    check_slow_clients();
+    check_tx_overflow();
+    check_write_after_body();
+    check_assets();
+    check_flash_assets();
+    check_keep_alive();
+    check_deferred();
+    check_admission();
+    check_access_log();
+    check_methods();
+    check_batch();
+    check_events();
+    check_websockets();
+
+    Stats idle = { "idle loop" };
+    Stats ping = { "GET /ping" };
+    Stats sockets = { "GET /api/socket-status" };
+    Stats missing = { "GET 404" };
+    Stats parallel = { "4x GET /ping (per batch)" };
+    Stats keep_alive = { "GET /ping keep-alive" };
+    bench_idle(idle, requests);
+    bench_requests(ping, REQ_PING, requests);
+    bench_requests(sockets, REQ_SOCKETS, requests);
+    bench_requests(missing, REQ_MISSING, requests);
+    bench_parallel(parallel, REQ_PING, 4, requests / 4);
+    bench_keep_alive(keep_alive, REQ_PING_KEEP_ALIVE, requests);
+
+    printf("\n%s host benchmark (%d iterations, ETH SPI %u Hz)\n", XTP_DEVICE_NAME, requests, (unsigned) ETH_SPI_SPEED);
+    print_table_header();
+    idle.print();
+    ping.print();
+    sockets.print();
+    missing.print();
+    parallel.print();
+    keep_alive.print();
+
+    printf("\n  %-28s %8s %10s %10s\n", "", "routes", "linear", "hashed");
+    bench_dispatch(32, smoke ? 10000 : 1000000);
+    bench_dispatch(HTTP_MAX_ENDPOINTS, smoke ? 10000 : 1000000);
+
+    bench_ws_tx(smoke ? 200 : 20000);
+
+    if (failures) {
+        printf("\n%d check(s) failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
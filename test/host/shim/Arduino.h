@@ -0,0 +1,517 @@
+#pragma once
+
+/**
+ * @file Arduino.h
+ * @brief Host (Linux) stand-in for the STM32duino core
+ *
+ * Only what xtp-lib actually touches is provided: timing, GPIO, Print/Stream,
+ * String, IPAddress, HardwareSerial, HardwareTimer and the handful of STM32F4
+ * peripheral register blocks that xtp_gpio.h / xtp_dma.h poke directly.
+ *
+ * Time is real (steady clock) plus a virtual offset, so delay() returns
+ * immediately and blocking setup loops finish without sleeping:
+ *   host_advance_us(us)   - move the clock forward without waiting
+ *
+ * Like the library itself this shim is header-only and expects to be
+ * compiled into exactly one translation unit.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
+#include <ctype.h>
+#include <chrono>
+#include <type_traits>
+#include <string>
+
+#ifndef ARDUINO
+#define ARDUINO 10819
+#endif
+
+#define PROGMEM
+#define PGM_P const char*
+#define F(s) (s)
+#define strlen_P strlen
+#define memcpy_P memcpy
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+// ============================================================================
+// Time
+// ============================================================================
+
+static uint64_t _host_time_offset_us = 0;
+
+inline uint64_t host_time_us() {
+    static const auto start = std::chrono::steady_clock::now();
+    uint64_t real = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    return real + _host_time_offset_us;
+}
+
+inline void host_advance_us(uint64_t us) { _host_time_offset_us += us; }
+inline void host_advance_ms(uint32_t ms) { host_advance_us((uint64_t)ms * 1000); }
+
+inline uint32_t millis() { return (uint32_t)(host_time_us() / 1000); }
+inline uint32_t micros() { return (uint32_t)host_time_us(); }
+inline void delay(uint32_t ms) { host_advance_ms(ms); }
+inline void delayMicroseconds(uint32_t us) { host_advance_us(us); }
+inline void yield() {}
+
+// ============================================================================
+// Math helpers
+// ============================================================================
+
+template <typename A, typename B> inline typename std::common_type<A, B>::type min(A a, B b) { return a < b ? a : b; }
+template <typename A, typename B> inline typename std::common_type<A, B>::type max(A a, B b) { return a > b ? a : b; }
+template <typename T, typename L, typename H> inline T constrain(T x, L lo, H hi) { return x < lo ? lo : (x > hi ? hi : x); }
+
+inline int toUpperCase(int c) { return toupper(c); }
+inline int toLowerCase(int c) { return tolower(c); }
+
+// ============================================================================
+// GPIO
+// ============================================================================
+
+#define LOW  0
+#define HIGH 1
+
+enum { INPUT = 0, OUTPUT, INPUT_PULLUP, INPUT_PULLDOWN, INPUT_ANALOG, OUTPUT_OPEN_DRAIN };
+
+// Pin numbers follow the STM32duino PinName layout: port * 16 + pin
+#define PA0  0x00
+#define PA1  0x01
+#define PA2  0x02
+#define PA3  0x03
+#define PA4  0x04
+#define PA5  0x05
+#define PA6  0x06
+#define PA7  0x07
+#define PA8  0x08
+#define PA9  0x09
+#define PA10 0x0A
+#define PA11 0x0B
+#define PA12 0x0C
+#define PA13 0x0D
+#define PA14 0x0E
+#define PA15 0x0F
+#define PB0  0x10
+#define PB1  0x11
+#define PB2  0x12
+#define PB3  0x13
+#define PB4  0x14
+#define PB5  0x15
+#define PB6  0x16
+#define PB7  0x17
+#define PB8  0x18
+#define PB9  0x19
+#define PB10 0x1A
+#define PB11 0x1B
+#define PB12 0x1C
+#define PB13 0x1D
+#define PB14 0x1E
+#define PB15 0x1F
+#define PC0  0x20
+#define PC1  0x21
+#define PC2  0x22
+#define PC3  0x23
+#define PC4  0x24
+#define PC5  0x25
+#define PC6  0x26
+#define PC7  0x27
+#define PC8  0x28
+#define PC9  0x29
+#define PC10 0x2A
+#define PC11 0x2B
+#define PC12 0x2C
+#define PC13 0x2D
+#define PC14 0x2E
+#define PC15 0x2F
+#define PD0  0x30
+#define PD1  0x31
+#define PD2  0x32
+
+#define HOST_PIN_COUNT 0x40
+#define LED_BUILTIN PC13
+
+static uint8_t host_pin_mode[HOST_PIN_COUNT] = { 0 };
+static uint8_t host_pin_level[HOST_PIN_COUNT] = { 0 };
+static uint16_t host_pin_analog[HOST_PIN_COUNT] = { 0 };
+static uint32_t host_pin_rises[HOST_PIN_COUNT] = { 0 }; // LOW to HIGH edges, e.g. the end of an SPI command
+
+inline void pinMode(uint32_t pin, uint32_t mode) { if (pin < HOST_PIN_COUNT) host_pin_mode[pin] = mode; }
+inline void digitalWrite(uint32_t pin, uint32_t value) {
+    if (pin >= HOST_PIN_COUNT) return;
+    if (value && host_pin_level[pin] == LOW) host_pin_rises[pin]++;
+    host_pin_level[pin] = value ? HIGH : LOW;
+}
+inline int digitalRead(uint32_t pin) { return pin < HOST_PIN_COUNT ? host_pin_level[pin] : LOW; }
+inline void digitalToggle(uint32_t pin) { if (pin < HOST_PIN_COUNT) host_pin_level[pin] ^= 1; }
+inline void analogReadResolution(int bits) { (void) bits; }
+inline int analogRead(uint32_t pin) { return pin < HOST_PIN_COUNT ? host_pin_analog[pin] : 0; }
+inline void analogWrite(uint32_t pin, int value) { (void) pin; (void) value; }
+
+// ============================================================================
+// STM32F4 register blocks (plain RAM on the host)
+// ============================================================================
+
+typedef struct {
+    volatile uint32_t MODER, OTYPER, OSPEEDR, PUPDR, IDR, ODR, BSRR, LCKR, AFR[2];
+} GPIO_TypeDef;
+
+typedef struct {
+    volatile uint32_t SR, CR1, CR2, SMPR1, SMPR2, JOFR1, JOFR2, JOFR3, JOFR4, HTR, LTR, SQR1, SQR2, SQR3, JSQR, JDR1, JDR2, JDR3, JDR4, DR;
+} ADC_TypeDef;
+
+typedef struct {
+    volatile uint32_t CR, NDTR, PAR, M0AR, M1AR, FCR;
+} DMA_Stream_TypeDef;
+
+typedef struct {
+    volatile uint32_t CR1, CR2, SMCR, DIER, SR, EGR, CCMR1, CCMR2, CCER, CNT, PSC, ARR, RCR, CCR1, CCR2, CCR3, CCR4, BDTR, DCR, DMAR, OR;
+} TIM_TypeDef;
+
+typedef struct {
+    volatile uint32_t CR, PLLCFGR, CFGR, CIR, AHB1RSTR, AHB2RSTR, APB1RSTR, APB2RSTR, AHB1ENR, AHB2ENR, APB1ENR, APB2ENR;
+} RCC_TypeDef;
+
+typedef struct {
+    volatile uint32_t CR, CSR;
+} PWR_TypeDef;
+
+typedef struct {
+    volatile uint32_t TR, DR, CR, ISR, BKP0R, BKP1R;
+} RTC_TypeDef;
+
+typedef struct {
+    volatile uint32_t SR, DR, BRR, CR1, CR2, CR3, GTPR;
+} USART_TypeDef;
+
+static GPIO_TypeDef host_GPIOA, host_GPIOB, host_GPIOC, host_GPIOD;
+static ADC_TypeDef host_ADC1;
+static DMA_Stream_TypeDef host_DMA2_Stream0;
+static TIM_TypeDef host_TIM2, host_TIM3;
+static RCC_TypeDef host_RCC;
+static PWR_TypeDef host_PWR;
+static RTC_TypeDef host_RTC;
+static USART_TypeDef host_USART1, host_USART2;
+
+#define GPIOA (&host_GPIOA)
+#define GPIOB (&host_GPIOB)
+#define GPIOC (&host_GPIOC)
+#define GPIOD (&host_GPIOD)
+#define ADC1 (&host_ADC1)
+#define DMA2_Stream0 (&host_DMA2_Stream0)
+#define TIM2 (&host_TIM2)
+#define TIM3 (&host_TIM3)
+#define RCC (&host_RCC)
+#define PWR (&host_PWR)
+#define RTC (&host_RTC)
+#define USART1 (&host_USART1)
+#define USART2 (&host_USART2)
+
+#define RCC_APB1ENR_PWREN   (1U << 28)
+#define RCC_AHB1ENR_GPIOCEN (1U << 2)
+#define PWR_CR_DBP          (1U << 8)
+#define GPIO_MODER_MODE0    (3U << 0)
+#define GPIO_MODER_MODE1    (3U << 2)
+#define GPIO_MODER_MODE2    (3U << 4)
+#define GPIO_MODER_MODE3    (3U << 6)
+#define GPIO_MODER_MODE4    (3U << 8)
+#define GPIO_MODER_MODE5    (3U << 10)
+#define DMA_SxCR_EN         (1U << 0)
+#define DMA_SxCR_CIRC       (1U << 8)
+#define DMA_SxCR_MINC       (1U << 10)
+#define DMA_SxCR_PL_1       (1U << 17)
+#define ADC_CR1_SCAN        (1U << 8)
+#define ADC_CR2_ADON        (1U << 0)
+#define ADC_CR2_DMA         (1U << 8)
+#define ADC_CR2_DDS         (1U << 9)
+#define ADC_CR2_EXTSEL_3    (1U << 27)
+#define ADC_CR2_EXTEN_0     (1U << 28)
+#define TIM_CR1_CEN         (1U << 0)
+
+enum IRQn_Type { ADC_IRQn = 18, DMA2_Stream0_IRQn = 56 };
+
+#define __DSB() ((void)0)
+#define __DMB() ((void)0)
+#define __HAL_RCC_DMA2_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_ADC1_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_TIM3_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_GPIOA_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_GPIOB_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_GPIOC_CLK_ENABLE() ((void)0)
+inline void HAL_NVIC_SetPriority(IRQn_Type irq, uint32_t pre, uint32_t sub) { (void) irq; (void) pre; (void) sub; }
+inline void NVIC_SystemReset() { exit(0); }
+
+// 96-bit factory UID, read by xtp_tools.h through STM32_UID_ADDRESS
+static const uint32_t host_mcu_uid[3] = { 0x00430031, 0x3133510B, 0x34383730 };
+#define STM32_UID_ADDRESS ((uintptr_t) host_mcu_uid)
+
+// ============================================================================
+// Print / Stream
+// ============================================================================
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+class String;
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+        size_t n = 0;
+        while (size--) n += write(*buffer++);
+        return n;
+    }
+    size_t write(const char* str) { return str ? write((const uint8_t*) str, strlen(str)) : 0; }
+    size_t write(const char* buffer, size_t size) { return write((const uint8_t*) buffer, size); }
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+
+    size_t print(const char* s) { return write(s); }
+    size_t print(char c) { return write((uint8_t) c); }
+    size_t print(const String& s);
+    size_t print(long n, int base = DEC) { return printNumber(n, base, true); }
+    size_t print(unsigned long n, int base = DEC) { return printNumber((long) n, base, false); }
+    size_t print(int n, int base = DEC) { return printNumber(n, base, true); }
+    size_t print(unsigned int n, int base = DEC) { return printNumber((long) n, base, false); }
+    size_t print(unsigned char n, int base = DEC) { return printNumber(n, base, false); }
+    size_t print(double d, int digits = 2) {
+        char buf[48];
+        int len = snprintf(buf, sizeof(buf), "%.*f", digits, d);
+        return write((const uint8_t*) buf, len);
+    }
+    size_t println() { return write("\r\n"); }
+    template <typename T> size_t println(const T& v) { size_t n = print(v); return n + println(); }
+    template <typename T> size_t println(const T& v, int fmt) { size_t n = print(v, fmt); return n + println(); }
+
+    size_t printf(const char* format, ...) {
+        char buf[256];
+        va_list args;
+        va_start(args, format);
+        int len = vsnprintf(buf, sizeof(buf), format, args);
+        va_end(args);
+        if (len < 0) return 0;
+        if (len < (int) sizeof(buf)) return write((const uint8_t*) buf, len);
+        std::string big(len + 1, '\0');
+        va_start(args, format);
+        vsnprintf(&big[0], big.size(), format, args);
+        va_end(args);
+        return write((const uint8_t*) big.data(), len);
+    }
+
+private:
+    size_t printNumber(long n, int base, bool is_signed) {
+        char buf[72];
+        int len = 0;
+        if (base == DEC) len = snprintf(buf, sizeof(buf), is_signed ? "%ld" : "%lu", n);
+        else if (base == HEX) len = snprintf(buf, sizeof(buf), "%lX", (unsigned long) n);
+        else if (base == OCT) len = snprintf(buf, sizeof(buf), "%lo", (unsigned long) n);
+        else {
+            unsigned long v = (unsigned long) n;
+            char tmp[65];
+            int i = 0;
+            do { tmp[i++] = '0' + (v & 1); v >>= 1; } while (v && i < 64);
+            while (i) buf[len++] = tmp[--i];
+        }
+        return write((const uint8_t*) buf, len);
+    }
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    void setTimeout(unsigned long timeout) { _timeout = timeout; }
+protected:
+    unsigned long _timeout = 1000;
+};
+
+// ============================================================================
+// String
+// ============================================================================
+
+class String {
+public:
+    String(const char* s = "") : _s(s ? s : "") {}
+    String(const std::string& s) : _s(s) {}
+    String(char c) : _s(1, c) {}
+    String(int v, int base = DEC) { char b[34]; snprintf(b, sizeof(b), base == HEX ? "%x" : "%d", v); _s = b; }
+    String(unsigned int v, int base = DEC) { char b[34]; snprintf(b, sizeof(b), base == HEX ? "%x" : "%u", v); _s = b; }
+    String(long v, int base = DEC) { char b[34]; snprintf(b, sizeof(b), base == HEX ? "%lx" : "%ld", v); _s = b; }
+    String(unsigned long v, int base = DEC) { char b[34]; snprintf(b, sizeof(b), base == HEX ? "%lx" : "%lu", v); _s = b; }
+    String(double v, int digits = 2) { char b[48]; snprintf(b, sizeof(b), "%.*f", digits, v); _s = b; }
+
+    const char* c_str() const { return _s.c_str(); }
+    unsigned int length() const { return (unsigned int) _s.length(); }
+    bool reserve(unsigned int size) { _s.reserve(size); return true; }
+    char charAt(unsigned int i) const { return i < _s.size() ? _s[i] : 0; }
+    char operator[](unsigned int i) const { return charAt(i); }
+    int indexOf(char c, unsigned int from = 0) const { size_t p = _s.find(c, from); return p == std::string::npos ? -1 : (int) p; }
+    int indexOf(const String& s, unsigned int from = 0) const { size_t p = _s.find(s._s, from); return p == std::string::npos ? -1 : (int) p; }
+    String substring(unsigned int from, unsigned int to = 0xFFFFFFFF) const {
+        if (from > _s.size()) return String();
+        if (to > _s.size()) to = (unsigned int) _s.size();
+        return String(_s.substr(from, to > from ? to - from : 0));
+    }
+    bool startsWith(const String& s) const { return _s.compare(0, s._s.size(), s._s) == 0; }
+    bool endsWith(const String& s) const { return _s.size() >= s._s.size() && _s.compare(_s.size() - s._s.size(), s._s.size(), s._s) == 0; }
+    bool equals(const String& s) const { return _s == s._s; }
+    bool equalsIgnoreCase(const String& s) const { return strcasecmp(_s.c_str(), s._s.c_str()) == 0; }
+    void trim() {
+        size_t a = _s.find_first_not_of(" \t\r\n");
+        size_t b = _s.find_last_not_of(" \t\r\n");
+        _s = a == std::string::npos ? "" : _s.substr(a, b - a + 1);
+    }
+    void toLowerCase() { for (auto& c : _s) c = tolower(c); }
+    void toUpperCase() { for (auto& c : _s) c = toupper(c); }
+    long toInt() const { return atol(_s.c_str()); }
+    float toFloat() const { return (float) atof(_s.c_str()); }
+
+    String& operator+=(const String& s) { _s += s._s; return *this; }
+    String& operator+=(const char* s) { _s += s; return *this; }
+    String& operator+=(char c) { _s += c; return *this; }
+    String& operator+=(int v) { return *this += String(v); }
+    bool operator==(const String& s) const { return _s == s._s; }
+    bool operator==(const char* s) const { return _s == s; }
+    bool operator!=(const String& s) const { return _s != s._s; }
+    bool operator!=(const char* s) const { return _s != s; }
+    friend String operator+(const String& a, const String& b) { return String(a._s + b._s); }
+    friend String operator+(const String& a, const char* b) { return String(a._s + b); }
+    friend String operator+(const char* a, const String& b) { return String(a + b._s); }
+
+private:
+    std::string _s;
+};
+
+inline size_t Print::print(const String& s) { return write((const uint8_t*) s.c_str(), s.length()); }
+
+// ============================================================================
+// IPAddress
+// ============================================================================
+
+class IPAddress {
+public:
+    IPAddress() { _addr.dword = 0; }
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) { _addr.bytes[0] = a; _addr.bytes[1] = b; _addr.bytes[2] = c; _addr.bytes[3] = d; }
+    IPAddress(uint32_t address) { _addr.dword = address; }
+    IPAddress(const uint8_t* address) { memcpy(_addr.bytes, address, 4); }
+
+    bool fromString(const char* address) {
+        int parts[4];
+        char tail;
+        if (!address || sscanf(address, "%d.%d.%d.%d%c", &parts[0], &parts[1], &parts[2], &parts[3], &tail) != 4) return false;
+        for (int i = 0; i < 4; i++) {
+            if (parts[i] < 0 || parts[i] > 255) return false;
+            _addr.bytes[i] = (uint8_t) parts[i];
+        }
+        return true;
+    }
+    bool fromString(const String& address) { return fromString(address.c_str()); }
+
+    operator uint32_t() const { return _addr.dword; }
+    bool operator==(const IPAddress& o) const { return _addr.dword == o._addr.dword; }
+    bool operator==(const uint8_t* o) const { return memcmp(_addr.bytes, o, 4) == 0; }
+    uint8_t operator[](int index) const { return _addr.bytes[index]; }
+    uint8_t& operator[](int index) { return _addr.bytes[index]; }
+    IPAddress& operator=(const uint8_t* address) { memcpy(_addr.bytes, address, 4); return *this; }
+    IPAddress& operator=(uint32_t address) { _addr.dword = address; return *this; }
+    const uint8_t* raw_address() const { return _addr.bytes; }
+
+private:
+    union {
+        uint8_t bytes[4];
+        uint32_t dword;
+    } _addr;
+};
+
+// ============================================================================
+// HardwareSerial
+// ============================================================================
+
+/**
+ * Serial output is counted, not printed, unless XTP_HOST_SERIAL is set in the
+ * environment. host_uart_us() estimates the time the same bytes would have
+ * blocked a real UART at the configured baud rate (10 bits per byte).
+ */
+class HardwareSerial : public Stream {
+public:
+    uint64_t host_bytes = 0;
+    uint32_t host_baud = 115200;
+
+    HardwareSerial(USART_TypeDef* usart = nullptr) { (void) usart; }
+    void setRx(uint32_t pin) { (void) pin; }
+    void setTx(uint32_t pin) { (void) pin; }
+    void begin(unsigned long baud) { host_baud = baud; }
+    void end() {}
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    int availableForWrite() override { return 64; }
+    using Print::write;
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        host_bytes += size;
+        if (host_echo()) fwrite(buffer, 1, size, stdout);
+        return size;
+    }
+    uint64_t host_uart_us() const { return host_baud ? host_bytes * 10ULL * 1000000ULL / host_baud : 0; }
+    operator bool() const { return true; }
+
+private:
+    static bool host_echo() {
+        static int echo = -1;
+        if (echo < 0) echo = getenv("XTP_HOST_SERIAL") != nullptr;
+        return echo == 1;
+    }
+};
+
+HardwareSerial Serial(USART2);
+
+// ============================================================================
+// HardwareTimer
+// ============================================================================
+
+enum TimerFormat_t { TICK_FORMAT, MICROSEC_FORMAT, HERTZ_FORMAT };
+typedef void (*callback_function_t)(void);
+
+/**
+ * Timer interrupts do not preempt on the host; call host_fire() from the
+ * benchmark loop to run the attached callback when its period has elapsed.
+ */
+class HardwareTimer {
+public:
+    HardwareTimer(TIM_TypeDef* instance) { (void) instance; }
+    void pause() { _running = false; }
+    void resume() { _running = true; _last = micros(); }
+    void refresh() { _last = micros(); }
+    void setOverflow(uint32_t value, TimerFormat_t format = TICK_FORMAT) { _period_us = format == HERTZ_FORMAT ? 1000000 / value : value; }
+    void attachInterrupt(callback_function_t callback) { _callback = callback; }
+    void detachInterrupt() { _callback = nullptr; }
+    void setInterruptPriority(uint32_t preempt, uint32_t sub) { (void) preempt; (void) sub; }
+    void host_fire() {
+        if (!_running || !_callback || _period_us == 0) return;
+        uint32_t now = micros();
+        if (now - _last >= _period_us) {
+            _last = now;
+            _callback();
+        }
+    }
+private:
+    bool _running = false;
+    uint32_t _period_us = 0;
+    uint32_t _last = 0;
+    callback_function_t _callback = nullptr;
+};
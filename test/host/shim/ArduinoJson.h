@@ -0,0 +1,18 @@
+#pragma once
+
+/**
+ * @file ArduinoJson.h
+ * @brief Placeholder for ArduinoJson: the library only allocates a document on
+ *        its own, so the host build needs the type and nothing else
+ */
+
+#include <Arduino.h>
+
+class DynamicJsonDocument {
+public:
+    DynamicJsonDocument(size_t capacity) : _capacity(capacity) {}
+    void clear() {}
+    size_t capacity() const { return _capacity; }
+private:
+    size_t _capacity;
+};
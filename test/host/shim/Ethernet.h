@@ -0,0 +1,295 @@
+#pragma once
+
+/**
+ * @file Ethernet.h
+ * @brief Host stand-in for Arduino Ethernet 2.0.x on top of the W5500 socket model
+ *
+ * EthernetClient/EthernetServer follow the real library's socket bookkeeping
+ * (server_port ownership, LISTEN re-arm in available(), CLOSE_WAIT handling)
+ * and charge the same number of register accesses per call to host_spi:
+ *   available()         2 frames (RX_RSR read twice until stable)
+ *   read()/read(buf,n)  7 frames (RSR x2, RD ptr, data, RD write, RECV cmd)
+ *   peek()              4 frames
+ *   write(buf,n)        9 frames (FSR x2, WR ptr, data, WR write, SEND cmd, SEND_OK poll)
+ *   connected()/status  1 frame
+ */
+
+#include <Arduino.h>
+#include <SPI.h>
+#include "utility/w5100.h"
+
+enum EthernetLinkStatus { Unknown, LinkON, LinkOFF };
+enum EthernetHardwareStatus { EthernetNoHardware, EthernetW5100, EthernetW5200, EthernetW5500 };
+
+#define SPI_ETHERNET_SETTINGS SPISettings(14000000, MSBFIRST, SPI_MODE0)
+
+class Client : public Stream {
+public:
+    virtual int connect(IPAddress ip, uint16_t port) = 0;
+    virtual int connect(const char* host, uint16_t port) = 0;
+    virtual uint8_t connected() = 0;
+    virtual void stop() = 0;
+    virtual operator bool() = 0;
+    using Stream::read;
+    virtual int read(uint8_t* buf, size_t size) = 0;
+};
+
+// Outgoing connections are refused unless the benchmark opts in
+static bool host_net_accept_outgoing = false;
+
+class EthernetClient : public Client {
+public:
+    EthernetClient() : _sock(MAX_SOCK_NUM) {}
+    EthernetClient(uint8_t sock) : _sock(sock) {}
+
+    uint8_t status() {
+        if (_sock >= MAX_SOCK_NUM) return SnSR::CLOSED;
+        return W5100.readSnSR(_sock);
+    }
+
+    int connect(IPAddress ip, uint16_t port) override {
+        if (_sock < MAX_SOCK_NUM) stop();
+        for (uint8_t s = 0; s < MAX_SOCK_NUM; s++) {
+            if (host_sockets[s].status != SnSR::CLOSED) continue;
+            host_spi.frame(1);
+            if (!host_net_accept_outgoing) return 0;
+            host_sockets[s].status = SnSR::ESTABLISHED;
+            host_sockets[s].port = 49152 + s;
+            host_sockets[s].remote_ip = ip;
+            host_sockets[s].remote_port = port;
+            host_sockets[s].server_port = 0;
+            host_sockets[s].tx.clear();
+            _sock = s;
+            return 1;
+        }
+        return 0;
+    }
+
+    int connect(const char* host, uint16_t port) override {
+        IPAddress ip;
+        if (!ip.fromString(host)) ip = IPAddress(10, 0, 0, 1); // pretend DNS
+        return connect(ip, port);
+    }
+
+    int availableForWrite() override {
+        if (_sock >= MAX_SOCK_NUM) return 0;
+        host_spi.frame(2);
+        host_spi.frame(2);
+        return W5100.host_tx_free(_sock);
+    }
+
+    using Print::write;
+    size_t write(uint8_t b) override { return write(&b, 1); }
+    size_t write(const uint8_t* buf, size_t size) override {
+        if (_sock >= MAX_SOCK_NUM || size == 0) return 0;
+        HostSocket& sock = host_sockets[_sock];
+        size_t written = 0;
+        while (written < size) {
+            host_spi.frame(2);
+            host_spi.frame(2);
+            uint8_t st = sock.status;
+            if (st != SnSR::ESTABLISHED && st != SnSR::CLOSE_WAIT) break;
+            uint16_t free_space = W5100.host_tx_free(_sock);
+            if (free_space == 0) {
+                // The real socketSend() spins here until the peer ACKs; model the
+                // stall as elapsed time so it shows up in loop timing.
+                host_advance_us(1000);
+                if (++_host_stall_ms > 2000) break;
+                if (_host_tx_drain) _host_tx_drain(_sock);
+                continue;
+            }
+            size_t chunk = min(size - written, (size_t) free_space);
+            host_spi.frame(2);                     // WR pointer
+            host_spi.frame((uint32_t) chunk);      // payload
+            host_spi.frame(2);                     // WR pointer update
+            W5100.execCmdSn(_sock, Sock_SEND);
+            host_spi.frame(1);                     // SEND_OK poll
+            host_spi.frame(1);                     // IR clear
+            sock.tx.append((const char*) buf + written, chunk);
+            sock.tx_total += chunk;
+            written += chunk;
+        }
+        _host_stall_ms = 0;
+        return written;
+    }
+
+    int available() override {
+        if (_sock >= MAX_SOCK_NUM) return 0;
+        host_spi.frame(2);
+        host_spi.frame(2);
+        return (int) host_sockets[_sock].rx_available();
+    }
+
+    int read() override {
+        uint8_t b;
+        if (read(&b, 1) > 0) return b;
+        return -1;
+    }
+
+    int read(uint8_t* buf, size_t size) override {
+        if (_sock >= MAX_SOCK_NUM) return -1;
+        HostSocket& sock = host_sockets[_sock];
+        host_spi.frame(2);
+        host_spi.frame(2);
+        uint32_t avail = sock.rx_available();
+        if (avail == 0) return -1;
+        size_t n = min((size_t) avail, size);
+        host_spi.frame(2);                         // RD pointer
+        host_spi.frame((uint32_t) n);              // payload
+        host_spi.frame(2);                         // RD pointer update
+        W5100.execCmdSn(_sock, Sock_RECV);
+        memcpy(buf, sock.rx.data() + sock.rx_pos, n);
+        sock.rx_pos += n;
+        return (int) n;
+    }
+
+    int peek() override {
+        if (_sock >= MAX_SOCK_NUM) return -1;
+        HostSocket& sock = host_sockets[_sock];
+        host_spi.frame(2);
+        host_spi.frame(2);
+        if (sock.rx_available() == 0) return -1;
+        host_spi.frame(2);
+        host_spi.frame(1);
+        return (uint8_t) sock.rx[sock.rx_pos];
+    }
+
+    void flush() override {}
+
+    void stop() override {
+        if (_sock >= MAX_SOCK_NUM) return;
+        W5100.execCmdSn(_sock, Sock_DISCON);
+        W5100.execCmdSn(_sock, Sock_CLOSE);
+        _sock = MAX_SOCK_NUM;
+    }
+
+    uint8_t connected() override {
+        if (_sock >= MAX_SOCK_NUM) return 0;
+        uint8_t s = status();
+        return !(s == SnSR::LISTEN || s == SnSR::CLOSED || s == SnSR::FIN_WAIT || (s == SnSR::CLOSE_WAIT && !available()));
+    }
+
+    operator bool() override { return _sock < MAX_SOCK_NUM; }
+    bool operator==(const bool value) { return bool() == value; }
+    bool operator!=(const bool value) { return bool() != value; }
+    bool operator==(const EthernetClient& rhs) { return _sock == rhs._sock && _sock < MAX_SOCK_NUM; }
+    bool operator!=(const EthernetClient& rhs) { return !this->operator==(rhs); }
+
+    uint8_t getSocketNumber() const { return _sock; }
+    uint16_t localPort() { return _sock < MAX_SOCK_NUM ? host_sockets[_sock].port : 0; }
+    IPAddress remoteIP() { return _sock < MAX_SOCK_NUM ? host_sockets[_sock].remote_ip : IPAddress(); }
+    uint16_t remotePort() { return _sock < MAX_SOCK_NUM ? host_sockets[_sock].remote_port : 0; }
+    void setConnectionTimeout(uint16_t timeout) { (void) timeout; }
+
+    // Called while a write is stalled on a full TX buffer (slow-peer benchmarks)
+    static void (*_host_tx_drain)(uint8_t sock);
+
+private:
+    uint8_t _sock;
+    uint32_t _host_stall_ms = 0;
+};
+
+void (*EthernetClient::_host_tx_drain)(uint8_t sock) = nullptr;
+
+class EthernetServer {
+public:
+    EthernetServer(uint16_t port) : _port(port) {}
+
+    void begin() {
+        for (uint8_t s = 0; s < MAX_SOCK_NUM; s++) {
+            host_spi.frame(1);
+            if (host_sockets[s].status != SnSR::CLOSED) continue;
+            host_sockets[s].clear();
+            host_sockets[s].status = SnSR::LISTEN;
+            host_sockets[s].port = _port;
+            host_sockets[s].server_port = _port;
+            W5100.execCmdSn(s, Sock_OPEN);
+            W5100.execCmdSn(s, Sock_LISTEN);
+            return;
+        }
+    }
+
+    EthernetClient available() {
+        bool listening = false;
+        uint8_t sockindex = MAX_SOCK_NUM;
+        for (uint8_t s = 0; s < MAX_SOCK_NUM; s++) {
+            if (host_sockets[s].server_port != _port) continue;
+            uint8_t stat = W5100.readSnSR(s);
+            if (stat == SnSR::ESTABLISHED || stat == SnSR::CLOSE_WAIT) {
+                if (W5100.readSnRX_RSR(s) > 0) {
+                    sockindex = s;
+                } else if (stat == SnSR::CLOSE_WAIT) {
+                    W5100.execCmdSn(s, Sock_DISCON);
+                }
+            } else if (stat == SnSR::LISTEN) {
+                listening = true;
+            } else if (stat == SnSR::CLOSED) {
+                host_sockets[s].server_port = 0;
+            }
+        }
+        if (!listening) begin();
+        return EthernetClient(sockindex);
+    }
+
+    EthernetClient accept() {
+        bool listening = false;
+        uint8_t sockindex = MAX_SOCK_NUM;
+        for (uint8_t s = 0; s < MAX_SOCK_NUM; s++) {
+            if (host_sockets[s].server_port != _port) continue;
+            uint8_t stat = W5100.readSnSR(s);
+            if (sockindex == MAX_SOCK_NUM && (stat == SnSR::ESTABLISHED || stat == SnSR::CLOSE_WAIT)) {
+                sockindex = s;
+                host_sockets[s].server_port = 0;
+            } else if (stat == SnSR::LISTEN) {
+                listening = true;
+            } else if (stat == SnSR::CLOSED) {
+                host_sockets[s].server_port = 0;
+            }
+        }
+        if (!listening) begin();
+        return EthernetClient(sockindex);
+    }
+
+    operator bool() {
+        for (uint8_t s = 0; s < MAX_SOCK_NUM; s++) {
+            if (host_sockets[s].server_port == _port && host_sockets[s].status == SnSR::LISTEN) return true;
+        }
+        return false;
+    }
+
+private:
+    uint16_t _port;
+};
+
+class EthernetClass {
+public:
+    EthernetLinkStatus host_link = LinkON;
+
+    void init(uint8_t cs_pin) { (void) cs_pin; }
+    int begin(uint8_t* mac, unsigned long timeout = 60000, unsigned long responseTimeout = 4000) {
+        (void) mac; (void) timeout; (void) responseTimeout;
+        _ip = IPAddress(192, 168, 1, 100);
+        _subnet = IPAddress(255, 255, 255, 0);
+        _gateway = IPAddress(192, 168, 1, 1);
+        _dns = IPAddress(192, 168, 1, 1);
+        return 1;
+    }
+    void begin(uint8_t* mac, IPAddress ip, IPAddress dns, IPAddress gateway, IPAddress subnet) {
+        (void) mac;
+        _ip = ip; _dns = dns; _gateway = gateway; _subnet = subnet;
+    }
+    int maintain() { return 0; }
+    EthernetLinkStatus linkStatus() { host_spi.frame(1); return host_link; }
+    EthernetHardwareStatus hardwareStatus() { return EthernetW5500; }
+    IPAddress localIP() { return _ip; }
+    IPAddress subnetMask() { return _subnet; }
+    IPAddress gatewayIP() { return _gateway; }
+    IPAddress dnsServerIP() { return _dns; }
+    void setRetransmissionTimeout(uint16_t ms) { (void) ms; }
+    void setRetransmissionCount(uint8_t num) { (void) num; }
+
+private:
+    IPAddress _ip, _subnet, _gateway, _dns;
+};
+
+EthernetClass Ethernet;
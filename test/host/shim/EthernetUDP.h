@@ -0,0 +1,27 @@
+#pragma once
+
+/**
+ * @file EthernetUDP.h
+ * @brief Host stand-in for EthernetUDP; packets go nowhere and nothing is ever received
+ */
+
+#include <Ethernet.h>
+
+class EthernetUDP : public Stream {
+public:
+    uint8_t begin(uint16_t port) { (void) port; return 1; }
+    void stop() {}
+    int beginPacket(IPAddress ip, uint16_t port) { (void) ip; (void) port; return 1; }
+    int beginPacket(const char* host, uint16_t port) { (void) host; (void) port; return 1; }
+    int endPacket() { return 1; }
+    using Print::write;
+    size_t write(uint8_t b) override { (void) b; return 1; }
+    size_t write(const uint8_t* buf, size_t size) override { (void) buf; return size; }
+    int parsePacket() { return 0; }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int read(uint8_t* buf, size_t len) { (void) buf; (void) len; return 0; }
+    int peek() override { return -1; }
+    IPAddress remoteIP() { return IPAddress(); }
+    uint16_t remotePort() { return 0; }
+};
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <Arduino.h>
+
+class IWatchdogClass {
+public:
+    uint32_t host_reloads = 0;
+    void begin(uint32_t timeout_us, uint32_t window_us = 0xFFFFFFFF) { (void) timeout_us; (void) window_us; }
+    void reload() { host_reloads++; }
+    bool isEnabled() { return true; }
+    static bool isReset(bool clear = false) { (void) clear; return false; }
+    static void clearReset() {}
+};
+
+IWatchdogClass IWatchdog;
@@ -0,0 +1,60 @@
+#pragma once
+
+/**
+ * @file NOTA.h
+ * @brief Host stand-in for the NOTA network OTA library; it never receives an update
+ */
+
+#include <Arduino.h>
+#include <functional>
+
+#define _NOTA_STR(x) #x
+#define ENV(x) _NOTA_STR(x)
+
+#define U_FLASH 0
+#define U_SPIFFS 100
+
+typedef enum {
+    OTA_AUTH_ERROR,
+    OTA_BEGIN_ERROR,
+    OTA_CONNECT_ERROR,
+    OTA_RECEIVE_ERROR,
+    OTA_END_ERROR
+} ota_error_t;
+
+class NOTAClass {
+public:
+    typedef std::function<void(void)> THandlerFunction;
+    typedef std::function<void(ota_error_t)> THandlerFunction_Error;
+    typedef std::function<void(unsigned int, unsigned int)> THandlerFunction_Progress;
+
+    void setHostname(const char* hostname) { (void) hostname; }
+    void setPlatform(const char* platform) { (void) platform; }
+    void setPassword(const char* password) { (void) password; }
+    void setPort(uint16_t port) { _port = port; }
+    void onRequest(THandlerFunction fn) { _on_request = fn; }
+    void onStart(THandlerFunction fn) { _on_start = fn; }
+    void onEnd(THandlerFunction fn) { _on_end = fn; }
+    void onProgress(THandlerFunction_Progress fn) { _on_progress = fn; }
+    void onError(THandlerFunction_Error fn) { _on_error = fn; }
+    void begin() { _begun = true; }
+    void handle() {}
+    void reconnect() {}
+    int getCommand() { return U_FLASH; }
+
+private:
+    uint16_t _port = 0;
+    bool _begun = false;
+    THandlerFunction _on_request, _on_start, _on_end;
+    THandlerFunction_Progress _on_progress;
+    THandlerFunction_Error _on_error;
+};
+
+NOTAClass OTA;
+
+class InternalStorageClass {
+public:
+    long maxSize() { return 128 * 1024; }
+};
+
+InternalStorageClass InternalStorage;
@@ -0,0 +1,48 @@
+#pragma once
+
+/**
+ * @file SPI.h
+ * @brief Host stand-in for the STM32duino SPIClass (pin routing and transactions only)
+ */
+
+#include <Arduino.h>
+
+#define MSBFIRST 1
+#define LSBFIRST 0
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x01
+#define SPI_MODE2 0x02
+#define SPI_MODE3 0x03
+
+class SPISettings {
+public:
+    SPISettings(uint32_t clock = 4000000, uint8_t bitOrder = MSBFIRST, uint8_t dataMode = SPI_MODE0)
+        : clock(clock), bitOrder(bitOrder), dataMode(dataMode) {}
+    uint32_t clock;
+    uint8_t bitOrder;
+    uint8_t dataMode;
+};
+
+// Device model answering raw transfers (the SPI flash); without one the bus reads 0xFF
+static uint8_t (*host_spi_device)(uint8_t data) = nullptr;
+
+class SPIClass {
+public:
+    uint32_t host_clock = 0;
+    uint32_t host_transactions = 0;
+
+    SPIClass() {}
+    SPIClass(uint32_t mosi, uint32_t miso, uint32_t sclk, uint32_t ssel = 0xFF) { (void) mosi; (void) miso; (void) sclk; (void) ssel; }
+    void setMOSI(uint32_t pin) { (void) pin; }
+    void setMISO(uint32_t pin) { (void) pin; }
+    void setSCLK(uint32_t pin) { (void) pin; }
+    void setSSEL(uint32_t pin) { (void) pin; }
+    void begin() {}
+    void end() {}
+    void beginTransaction(SPISettings settings) { host_clock = settings.clock; host_transactions++; }
+    void endTransaction() {}
+    uint8_t transfer(uint8_t data) { return host_spi_device ? host_spi_device(data) : 0xFF; }
+    void transfer(void* buf, size_t count) { memset(buf, 0xFF, count); }
+};
+
+SPIClass SPI;
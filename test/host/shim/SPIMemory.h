@@ -0,0 +1,116 @@
+#pragma once
+
+/**
+ * @file SPIMemory.h
+ * @brief Host stand-in for SPIMemory's SPIFlash backed by an erased RAM image
+ *
+ * Erases take HOST_FLASH_ERASE_US of virtual time per sector. The library calls wait them out like
+ * the real ones; the raw commands on the bus (write enable, sector erase, read status) let the caller
+ * poll the busy bit instead.
+ */
+
+#include <Arduino.h>
+#include <SPI.h>
+
+#ifndef HOST_FLASH_SIZE
+#define HOST_FLASH_SIZE (1024UL * 1024UL)
+#endif
+
+#ifndef HOST_FLASH_ERASE_US
+#define HOST_FLASH_ERASE_US 45000 // W25Q80 typical sector erase
+#endif
+
+#define VERBOSE true
+
+class SPIFlash {
+public:
+    SPIFlash(uint8_t cs = 0) : _cs(cs) {
+        memset(_mem, 0xFF, sizeof(_mem));
+        _host_instance = this;
+        host_spi_device = [](uint8_t data) { return _host_instance->host_transfer(data); };
+    }
+    bool begin(uint32_t flashChipSize = 0) { (void) flashChipSize; return true; }
+    uint8_t error(bool verbosity = false) { (void) verbosity; return 0; }
+    uint32_t getJEDECID() { return 0xEF4014; }
+    uint64_t getUniqueID() { return 0x0123456789ABCDEFULL; }
+    uint32_t getCapacity() { return HOST_FLASH_SIZE; }
+    uint32_t getMaxPage() { return HOST_FLASH_SIZE / 256; }
+    bool eraseSection(uint32_t address, uint32_t size) {
+        host_wait();
+        if (address + size > HOST_FLASH_SIZE) return false;
+        uint32_t start = address & ~0xFFFUL;
+        uint32_t end = min((address + size + 0xFFF) & ~0xFFFUL, (uint32_t) HOST_FLASH_SIZE);
+        memset(_mem + start, 0xFF, end - start);
+        host_advance_us((uint64_t) (end - start) / 4096 * HOST_FLASH_ERASE_US);
+        return true;
+    }
+    bool eraseSector(uint32_t address) { return eraseSection(address, 1); }
+    bool eraseChip() { return eraseSection(0, HOST_FLASH_SIZE); }
+    bool writeByteArray(uint32_t address, uint8_t* data, size_t size, bool errorCheck = true) {
+        (void) errorCheck;
+        host_wait();
+        if (address + size > HOST_FLASH_SIZE) return false;
+        for (size_t i = 0; i < size; i++) _mem[address + i] &= data[i]; // NOR: program clears bits only
+        return true;
+    }
+    bool readByteArray(uint32_t address, uint8_t* data, size_t size, bool fastRead = false) {
+        (void) fastRead;
+        host_wait();
+        if (address + size > HOST_FLASH_SIZE) return false;
+        memcpy(data, _mem + address, size);
+        return true;
+    }
+    uint8_t readByte(uint32_t address, bool fastRead = false) {
+        uint8_t data = 0xFF;
+        readByteArray(address, &data, 1, fastRead);
+        return data;
+    }
+    bool writeByte(uint32_t address, uint8_t data, bool errorCheck = true) { return writeByteArray(address, &data, 1, errorCheck); }
+
+    // Raw command bytes while the chip is selected; a rise of CS ends a command
+    uint8_t host_transfer(uint8_t data) {
+        if (_cs >= HOST_PIN_COUNT || host_pin_level[_cs] != LOW) return 0xFF;
+        if (host_pin_rises[_cs] != _command_frame) {
+            _command_frame = host_pin_rises[_cs];
+            _command_length = 0;
+        }
+        if (_command_length < sizeof(_command)) _command[_command_length] = data;
+        _command_length++;
+        bool busy = micros() - _erase_start < HOST_FLASH_ERASE_US;
+        switch (_command[0]) {
+            case 0x06: // Write enable
+                _write_enabled = !busy;
+                break;
+            case 0x05: // Read status register 1: WIP, WEL
+                if (_command_length > 1) return (busy ? 0x01 : 0) | (_write_enabled ? 0x02 : 0);
+                break;
+            case 0x20: // Sector erase
+                if (_command_length == 4 && _write_enabled && !busy) {
+                    uint32_t address = (uint32_t) _command[1] << 16 | _command[2] << 8 | _command[3];
+                    if (address < HOST_FLASH_SIZE) memset(_mem + (address & ~0xFFFUL), 0xFF, 4096);
+                    _erase_start = micros();
+                    _write_enabled = false;
+                }
+                break;
+        }
+        return 0xFF;
+    }
+
+private:
+    uint8_t _mem[HOST_FLASH_SIZE];
+    uint8_t _cs;
+    uint32_t _command_frame = 0;
+    uint8_t _command[4];
+    size_t _command_length = 0;
+    bool _write_enabled = false;
+    uint32_t _erase_start = 0 - HOST_FLASH_ERASE_US;
+    static SPIFlash* _host_instance;
+
+    // The library waits for a raw erase still in progress
+    void host_wait() {
+        uint32_t elapsed = micros() - _erase_start;
+        if (elapsed < HOST_FLASH_ERASE_US) host_advance_us(HOST_FLASH_ERASE_US - elapsed);
+    }
+};
+
+SPIFlash* SPIFlash::_host_instance = nullptr;
@@ -0,0 +1,35 @@
+#pragma once
+
+/**
+ * @file STM32RTC.h
+ * @brief Host stand-in for STM32RTC, epoch kept relative to millis()
+ */
+
+#include <Arduino.h>
+
+class STM32RTC {
+public:
+    enum Hour_Format { HOUR_12, HOUR_24 };
+
+    static STM32RTC& getInstance() {
+        static STM32RTC instance;
+        return instance;
+    }
+    void begin(Hour_Format format = HOUR_24) { (void) format; }
+    void setEpoch(time_t ts, uint32_t subSeconds = 0) {
+        _epoch_ms = (uint64_t) ts * 1000 + subSeconds;
+        _set_at = millis();
+    }
+    time_t getEpoch(uint32_t* subSeconds = nullptr) {
+        uint64_t now = _epoch_ms + (millis() - _set_at);
+        if (subSeconds) *subSeconds = (uint32_t)(now % 1000);
+        return (time_t)(now / 1000);
+    }
+    uint32_t getSubSeconds() { return (uint32_t)((_epoch_ms + (millis() - _set_at)) % 1000); }
+    bool isTimeSet() { return _epoch_ms != 0; }
+
+private:
+    STM32RTC() {}
+    uint64_t _epoch_ms = 0;
+    uint32_t _set_at = 0;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+/**
+ * @file Wire.h
+ * @brief Host stand-in for TwoWire
+ *
+ * Addresses NACK (endTransmission() == 2) unless marked present in
+ * host_i2c_present[]; present devices ACK writes and read back zeros.
+ */
+
+#include <Arduino.h>
+
+static bool host_i2c_present[128] = { false };
+
+class TwoWire : public Stream {
+public:
+    void setSDA(uint32_t pin) { (void) pin; }
+    void setSCL(uint32_t pin) { (void) pin; }
+    void setClock(uint32_t hz) { (void) hz; }
+    void begin() {}
+    void end() {}
+    void beginTransmission(uint8_t address) { _address = address & 0x7F; }
+    uint8_t endTransmission(bool sendStop = true) { (void) sendStop; return host_i2c_present[_address] ? 0 : 2; }
+    size_t requestFrom(uint8_t address, size_t quantity, bool sendStop = true) {
+        (void) sendStop;
+        _rx_left = host_i2c_present[address & 0x7F] ? quantity : 0;
+        return _rx_left;
+    }
+    using Print::write;
+    size_t write(uint8_t data) override { (void) data; return 1; }
+    size_t write(const uint8_t* data, size_t quantity) override { (void) data; return quantity; }
+    int available() override { return (int) _rx_left; }
+    int read() override { if (!_rx_left) return -1; _rx_left--; return 0; }
+    int peek() override { return _rx_left ? 0 : -1; }
+
+private:
+    uint8_t _address = 0;
+    size_t _rx_left = 0;
+};
+
+TwoWire Wire;
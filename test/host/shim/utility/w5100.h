@@ -0,0 +1,185 @@
+#pragma once
+
+/**
+ * @file utility/w5100.h
+ * @brief Host model of the W5500 socket engine used by the Arduino Ethernet library
+ *
+ * Eight sockets with SnSR status, port, RX data queue and a bounded TX buffer.
+ * The far end of each connection is driven by the benchmark through the
+ * host_peer_* functions. Every register access made by the Ethernet library
+ * is counted as one SPI frame (3 header bytes + data) in host_spi, which is
+ * how on-target SPI cost is estimated from a host run.
+ */
+
+#include <Arduino.h>
+#include <string>
+
+#define MAX_SOCK_NUM 8
+
+#ifndef HOST_W5500_TX_SIZE
+#define HOST_W5500_TX_SIZE 2048
+#endif
+
+typedef uint8_t SOCKET;
+
+class SnSR {
+public:
+    static const uint8_t CLOSED      = 0x00;
+    static const uint8_t INIT        = 0x13;
+    static const uint8_t LISTEN      = 0x14;
+    static const uint8_t SYNSENT     = 0x15;
+    static const uint8_t SYNRECV     = 0x16;
+    static const uint8_t ESTABLISHED = 0x17;
+    static const uint8_t FIN_WAIT    = 0x18;
+    static const uint8_t CLOSING     = 0x1A;
+    static const uint8_t TIME_WAIT   = 0x1B;
+    static const uint8_t CLOSE_WAIT  = 0x1C;
+    static const uint8_t LAST_ACK    = 0x1D;
+    static const uint8_t UDP         = 0x22;
+};
+
+enum SockCMD {
+    Sock_OPEN      = 0x01,
+    Sock_LISTEN    = 0x02,
+    Sock_CONNECT   = 0x04,
+    Sock_DISCON    = 0x08,
+    Sock_CLOSE     = 0x10,
+    Sock_SEND      = 0x20,
+    Sock_SEND_MAC  = 0x21,
+    Sock_SEND_KEEP = 0x22,
+    Sock_RECV      = 0x40
+};
+
+// SPI traffic accounting
+struct HostSpiStats {
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    void frame(uint32_t data_bytes) { frames++; bytes += 3 + data_bytes; }
+    void reset() { frames = 0; bytes = 0; }
+    // Bus time at the given SCK frequency, ignoring CS/inter-frame gaps
+    uint64_t bus_ns(uint32_t spi_hz) const { return spi_hz ? bytes * 8ULL * 1000000000ULL / spi_hz : 0; }
+};
+
+static HostSpiStats host_spi;
+
+struct HostSocket {
+    uint8_t status = SnSR::CLOSED;
+    uint16_t port = 0;
+    uint16_t server_port = 0;      // Ethernet library's server_port[] bookkeeping
+    uint8_t ir = 0;
+    IPAddress remote_ip;
+    uint16_t remote_port = 0;
+    std::string rx;                // bytes sent by the peer, not yet read
+    size_t rx_pos = 0;
+    std::string tx;                // bytes written by the device, not yet taken by the peer
+    uint32_t tx_limit = 0;         // 0 = peer drains TX instantly; else max unacked bytes
+    uint64_t tx_total = 0;
+
+    uint32_t rx_available() const { return (uint32_t)(rx.size() - rx_pos); }
+    void clear() {
+        status = SnSR::CLOSED;
+        port = 0;
+        ir = 0;
+        rx.clear();
+        rx_pos = 0;
+        tx_limit = 0;
+    }
+};
+
+static HostSocket host_sockets[MAX_SOCK_NUM];
+
+class W5100Class {
+public:
+    uint8_t mr = 0;
+
+    uint8_t readSnSR(SOCKET s) { host_spi.frame(1); return s < MAX_SOCK_NUM ? host_sockets[s].status : 0; }
+    uint16_t readSnPORT(SOCKET s) { host_spi.frame(2); return s < MAX_SOCK_NUM ? host_sockets[s].port : 0; }
+    uint16_t readSnRX_RSR(SOCKET s) { host_spi.frame(2); return s < MAX_SOCK_NUM ? (uint16_t) min(host_sockets[s].rx_available(), 0xFFFFu) : 0; }
+    uint16_t readSnTX_FSR(SOCKET s) { host_spi.frame(2); return s < MAX_SOCK_NUM ? host_tx_free(s) : 0; }
+    uint8_t readSnIR(SOCKET s) { host_spi.frame(1); return s < MAX_SOCK_NUM ? host_sockets[s].ir : 0; }
+    void writeSnIR(SOCKET s, uint8_t v) { host_spi.frame(1); if (s < MAX_SOCK_NUM) host_sockets[s].ir &= ~v; }
+    uint8_t readMR() { host_spi.frame(1); mr &= ~0x80; return mr; } // reset completes instantly
+    void writeMR(uint8_t v) { host_spi.frame(1); mr = v; }
+
+    void execCmdSn(SOCKET s, SockCMD cmd) {
+        host_spi.frame(1); // write SnCR
+        host_spi.frame(1); // poll SnCR until cleared
+        if (s >= MAX_SOCK_NUM) return;
+        HostSocket& sock = host_sockets[s];
+        switch (cmd) {
+            case Sock_CLOSE:
+                sock.clear();
+                break;
+            case Sock_DISCON:
+                // The simulated peer ACKs the FIN immediately
+                sock.clear();
+                break;
+            default:
+                break;
+        }
+    }
+
+    uint16_t host_tx_free(SOCKET s) const {
+        const HostSocket& sock = host_sockets[s];
+        uint32_t cap = sock.tx_limit ? min((uint32_t) HOST_W5500_TX_SIZE, sock.tx_limit) : HOST_W5500_TX_SIZE;
+        uint32_t used = sock.tx_limit ? (uint32_t) sock.tx.size() : 0;
+        return used >= cap ? 0 : (uint16_t)(cap - used);
+    }
+};
+
+W5100Class W5100;
+
+// ============================================================================
+// Peer side (driven by the benchmark / tests)
+// ============================================================================
+
+// Open a TCP connection to a LISTEN socket on `port`. Returns the socket index or -1 (RST).
+inline int host_peer_connect(uint16_t port, IPAddress remote = IPAddress(192, 168, 1, 10), uint16_t remote_port = 50000) {
+    for (int s = 0; s < MAX_SOCK_NUM; s++) {
+        HostSocket& sock = host_sockets[s];
+        if (sock.status == SnSR::LISTEN && sock.port == port) {
+            sock.status = SnSR::ESTABLISHED;
+            sock.remote_ip = remote;
+            sock.remote_port = remote_port;
+            sock.rx.clear();
+            sock.rx_pos = 0;
+            sock.tx.clear();
+            return s;
+        }
+    }
+    return -1;
+}
+
+inline void host_peer_send(int s, const void* data, size_t len) {
+    if (s < 0 || s >= MAX_SOCK_NUM) return;
+    HostSocket& sock = host_sockets[s];
+    if (sock.rx_pos > 0 && sock.rx_pos == sock.rx.size()) { sock.rx.clear(); sock.rx_pos = 0; }
+    sock.rx.append((const char*) data, len);
+}
+
+inline void host_peer_send(int s, const char* text) { host_peer_send(s, text, strlen(text)); }
+
+// Take everything the device has written to socket `s` so far
+inline std::string host_peer_recv(int s) {
+    if (s < 0 || s >= MAX_SOCK_NUM) return std::string();
+    std::string out;
+    out.swap(host_sockets[s].tx);
+    return out;
+}
+
+// Peer sends FIN: ESTABLISHED -> CLOSE_WAIT
+inline void host_peer_close(int s) {
+    if (s < 0 || s >= MAX_SOCK_NUM) return;
+    if (host_sockets[s].status == SnSR::ESTABLISHED) host_sockets[s].status = SnSR::CLOSE_WAIT;
+}
+
+inline uint8_t host_peer_status(int s) { return (s >= 0 && s < MAX_SOCK_NUM) ? host_sockets[s].status : SnSR::CLOSED; }
+
+inline void host_net_reset() {
+    for (int s = 0; s < MAX_SOCK_NUM; s++) {
+        host_sockets[s].clear();
+        host_sockets[s].server_port = 0;
+        host_sockets[s].tx.clear();
+        host_sockets[s].tx_total = 0;
+    }
+}